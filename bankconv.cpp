@@ -0,0 +1,339 @@
+// Builds a .qbank question bank (see question_bank.h) from CSV or JSON.
+//
+//   g++ -O2 bankconv.cpp -o bankconv
+//   ./bankconv questions.csv questions.qbank
+//   ./bankconv questions.json questions.qbank
+//
+// CSV: one question per line,
+//   category,difficulty,question,A,B,C,D,answer
+// Fields may be double-quoted ("" inside quotes is a literal quote). A first
+// line starting with "category" is taken as a header and skipped.
+//
+// JSON: an array of objects,
+//   [{"category": "Pilipinas", "difficulty": 1, "question": "...",
+//     "options": ["...", "...", "...", "..."], "answer": "B"}, ...]
+//
+// Options are stored as the client shows them ("A) ..."); the prefix is
+// added when the source leaves it out.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cctype>
+#include "question_bank.h"
+
+static std::string withPrefix(const std::string& option, int index) {
+    char letter = (char)('A' + index);
+    if (option.size() >= 2 && option[0] == letter && option[1] == ')') return option;
+    return std::string(1, letter) + ") " + option;
+}
+
+static bool addQuestion(std::vector<Question>& out, const std::string& category, int difficulty,
+                        const std::string& text, std::vector<std::string> options,
+                        const std::string& answer, int line) {
+    if (text.empty() || options.size() < 2 || options.size() > MAX_OPTIONS || answer.size() != 1) {
+        std::cerr << "entry " << line << ": skipped (needs a question, 2-" << MAX_OPTIONS
+                  << " options and a one-letter answer)" << std::endl;
+        return false;
+    }
+    char correct = (char)toupper((unsigned char)answer[0]);
+    if (correct < 'A' || correct >= 'A' + (int)options.size()) {
+        std::cerr << "entry " << line << ": skipped (answer " << answer << " is not an option)" << std::endl;
+        return false;
+    }
+    bool bar = text.find('|') != std::string::npos;
+    for (const std::string& option : options) bar |= option.find('|') != std::string::npos;
+    if (bar) {
+        std::cerr << "entry " << line << ": skipped ('|' separates the protocol's fields)" << std::endl;
+        return false;
+    }
+    if (difficulty < 0 || difficulty > 255) {
+        std::cerr << "entry " << line << ": skipped (difficulty must be 0-255)" << std::endl;
+        return false;
+    }
+    for (size_t i = 0; i < options.size(); ++i) {
+        options[i] = withPrefix(options[i], (int)i);
+    }
+    out.emplace_back(text, options, correct, category.empty() ? "general" : category, difficulty);
+    return true;
+}
+
+// --- CSV --------------------------------------------------------------------
+
+// Splits one record, which may span lines when a quoted field holds newlines
+static bool readCsvRecord(std::istream& in, std::vector<std::string>& fields) {
+    fields.clear();
+    std::string field;
+    bool quoted = false, any = false;
+    char c;
+    while (in.get(c)) {
+        any = true;
+        if (quoted) {
+            if (c == '"') {
+                if (in.peek() == '"') {
+                    in.get(c);
+                    field += '"';
+                } else {
+                    quoted = false;
+                }
+            } else {
+                field += c;
+            }
+        } else if (c == '"') {
+            quoted = true;
+        } else if (c == ',') {
+            fields.push_back(field);
+            field.clear();
+        } else if (c == '\n') {
+            break;
+        } else if (c != '\r') {
+            field += c;
+        }
+    }
+    if (!any) return false;
+    fields.push_back(field);
+    return true;
+}
+
+static bool loadCsv(std::istream& in, std::vector<Question>& out) {
+    std::vector<std::string> fields;
+    int line = 0;
+    while (readCsvRecord(in, fields)) {
+        ++line;
+        if (fields.size() == 1 && fields[0].empty()) continue;
+        if (line == 1 && fields[0] == "category") continue;
+        if (fields.size() < 5) {
+            std::cerr << "line " << line << ": skipped (too few columns)" << std::endl;
+            continue;
+        }
+        // category, difficulty, question, options..., answer
+        std::vector<std::string> options(fields.begin() + 3, fields.end() - 1);
+        addQuestion(out, fields[0], atoi(fields[1].c_str()), fields[2], options, fields.back(), line);
+    }
+    return true;
+}
+
+// --- JSON -------------------------------------------------------------------
+
+// Just enough JSON for the format above: objects, arrays, strings, numbers
+class JsonReader {
+private:
+    const std::string& src;
+    size_t pos;
+
+public:
+    std::string error;
+
+    JsonReader(const std::string& s) : src(s), pos(0) {}
+
+    void skipSpace() {
+        while (pos < src.size() && isspace((unsigned char)src[pos])) ++pos;
+    }
+
+    bool consume(char c) {
+        skipSpace();
+        if (pos < src.size() && src[pos] == c) {
+            ++pos;
+            return true;
+        }
+        return false;
+    }
+
+    bool expect(char c) {
+        if (consume(c)) return true;
+        error = std::string("expected '") + c + "' at offset " + std::to_string(pos);
+        return false;
+    }
+
+    bool atEnd() {
+        skipSpace();
+        return pos >= src.size();
+    }
+
+    bool readString(std::string& out) {
+        out.clear();
+        if (!expect('"')) return false;
+        while (pos < src.size() && src[pos] != '"') {
+            char c = src[pos++];
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (pos >= src.size()) break;
+            char e = src[pos++];
+            switch (e) {
+                case 'n': out += '\n'; break;
+                case 't': out += '\t'; break;
+                case 'r': out += '\r'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'u': {
+                    if (pos + 4 > src.size()) break;
+                    unsigned cp = (unsigned)strtoul(src.substr(pos, 4).c_str(), nullptr, 16);
+                    pos += 4;
+                    // UTF-8 encode (surrogate pairs are passed through as is)
+                    if (cp < 0x80) {
+                        out += (char)cp;
+                    } else if (cp < 0x800) {
+                        out += (char)(0xc0 | (cp >> 6));
+                        out += (char)(0x80 | (cp & 0x3f));
+                    } else {
+                        out += (char)(0xe0 | (cp >> 12));
+                        out += (char)(0x80 | ((cp >> 6) & 0x3f));
+                        out += (char)(0x80 | (cp & 0x3f));
+                    }
+                    break;
+                }
+                default: out += e; break;
+            }
+        }
+        if (pos >= src.size()) {
+            error = "unterminated string";
+            return false;
+        }
+        ++pos;
+        return true;
+    }
+
+    // A string or a bare number, as text
+    bool readScalar(std::string& out) {
+        skipSpace();
+        if (pos < src.size() && src[pos] == '"') return readString(out);
+        size_t start = pos;
+        while (pos < src.size() && (isalnum((unsigned char)src[pos]) || src[pos] == '-' ||
+                                    src[pos] == '+' || src[pos] == '.')) {
+            ++pos;
+        }
+        if (pos == start) {
+            error = "expected a value at offset " + std::to_string(pos);
+            return false;
+        }
+        out = src.substr(start, pos - start);
+        return true;
+    }
+
+    bool readStringArray(std::vector<std::string>& out) {
+        out.clear();
+        if (!expect('[')) return false;
+        if (consume(']')) return true;
+        do {
+            std::string value;
+            if (!readScalar(value)) return false;
+            out.push_back(value);
+        } while (consume(','));
+        return expect(']');
+    }
+
+    // Skips any value we do not care about
+    bool skipValue() {
+        skipSpace();
+        if (pos >= src.size()) return false;
+        char c = src[pos];
+        if (c == '{' || c == '[') {
+            char close = c == '{' ? '}' : ']';
+            ++pos;
+            if (consume(close)) return true;
+            do {
+                if (c == '{') {
+                    std::string key;
+                    if (!readString(key) || !expect(':')) return false;
+                }
+                if (!skipValue()) return false;
+            } while (consume(','));
+            return expect(close);
+        }
+        std::string ignored;
+        return readScalar(ignored);
+    }
+};
+
+static bool loadJson(const std::string& text, std::vector<Question>& out) {
+    JsonReader json(text);
+    if (!json.expect('[')) {
+        std::cerr << "JSON: " << json.error << std::endl;
+        return false;
+    }
+    int entry = 0;
+    if (!json.consume(']')) {
+        do {
+            ++entry;
+            std::string category, text_field, answer, difficulty = "1";
+            std::vector<std::string> options;
+            if (!json.expect('{')) break;
+            if (!json.consume('}')) {
+                do {
+                    std::string key;
+                    if (!json.readString(key) || !json.expect(':')) break;
+                    bool ok;
+                    if (key == "category") ok = json.readScalar(category);
+                    else if (key == "difficulty") ok = json.readScalar(difficulty);
+                    else if (key == "question") ok = json.readScalar(text_field);
+                    else if (key == "answer") ok = json.readScalar(answer);
+                    else if (key == "options") ok = json.readStringArray(options);
+                    else ok = json.skipValue();
+                    if (!ok) break;
+                } while (json.consume(','));
+                if (!json.error.empty() || !json.expect('}')) break;
+            }
+            addQuestion(out, category, atoi(difficulty.c_str()), text_field, options, answer, entry);
+        } while (json.consume(','));
+    }
+    if (!json.error.empty() || !json.expect(']') || !json.atEnd()) {
+        std::cerr << "JSON: " << (json.error.empty() ? "trailing data" : json.error) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " input.csv|input.json output.qbank" << std::endl;
+        return 1;
+    }
+
+    std::ifstream in(argv[1], std::ios::binary);
+    if (!in) {
+        std::cerr << "cannot open " << argv[1] << std::endl;
+        return 1;
+    }
+    std::stringstream contents;
+    contents << in.rdbuf();
+    std::string text = contents.str();
+
+    // Sniff the format rather than trusting the extension
+    size_t first = text.find_first_not_of(" \t\r\n\xef\xbb\xbf");
+    std::vector<Question> questions;
+    bool ok;
+    if (first != std::string::npos && text[first] == '[') {
+        ok = loadJson(text, questions);
+    } else {
+        std::istringstream csv(text);
+        ok = loadCsv(csv, questions);
+    }
+    if (!ok) return 1;
+    if (questions.empty()) {
+        std::cerr << "no questions found in " << argv[1] << std::endl;
+        return 1;
+    }
+
+    std::string bank = buildBank(questions);
+    std::ofstream out(argv[2], std::ios::binary | std::ios::trunc);
+    if (!out.write(bank.data(), bank.size())) {
+        std::cerr << "cannot write " << argv[2] << std::endl;
+        return 1;
+    }
+    out.close();
+
+    // Read it back the way the server will
+    QuestionBank check;
+    std::string error;
+    if (!check.open(argv[2], error)) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    std::cout << "Wrote " << check.size() << " questions (" << bank.size() << " bytes) to "
+              << argv[2] << std::endl;
+    return 0;
+}
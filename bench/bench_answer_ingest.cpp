@@ -0,0 +1,192 @@
+// Answer ingestion under contention: I/O threads handing answers to a room
+// through one mutex (the old players_mutex path) against the room's
+// lock-free MPSC queue (mpsc_queue.h).
+//
+// P producer threads play the reactors and submit answers as fast as they
+// can. One consumer plays the game worker: it applies answers to a score
+// table and, every so often, does a stretch of result formatting. In the
+// mutex model that formatting happens under the same lock the producers
+// need, as sendRoundResults used to; in the queue model nobody waits for it.
+//
+// Reported per model: answers per second, the time a producer spends
+// handing one answer over (p50/p99/p999), and how long an answer waits
+// before the game thread applies it.
+//
+//   g++ -O2 -std=c++17 bench/bench_answer_ingest.cpp -o bench_answer_ingest -pthread
+//   ./bench_answer_ingest [producers...]
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <atomic>
+#include <cstdlib>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include "../mpsc_queue.h"
+#include "../histogram.h"
+
+#define BENCH_ANSWERS_PER_PRODUCER 200000
+#define BENCH_SLOTS 1024
+#define BENCH_FORMAT_EVERY 256      // answers between two formatting passes
+#define BENCH_FORMAT_NS 20000       // one formatting pass
+#define BENCH_QUEUE_CAPACITY 4096
+#define BENCH_BATCH 64
+
+static long long nowNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void spinFor(long long ns) {
+    long long end = nowNs() + ns;
+    while (nowNs() < end) {}
+}
+
+struct Answer {
+    uint32_t slot;
+    char choice;
+    long long sent_ns;
+};
+
+struct Room {
+    char answers[BENCH_SLOTS];
+    int scores[BENCH_SLOTS];
+    uint64_t applied;
+    
+    Room() : applied(0) {
+        for (int i = 0; i < BENCH_SLOTS; ++i) {
+            answers[i] = '?';
+            scores[i] = 0;
+        }
+    }
+    
+    void apply(const Answer& a) {
+        answers[a.slot] = a.choice;
+        scores[a.slot] += a.choice == 'B' ? 10 : 0;
+        applied++;
+    }
+};
+
+struct Shared {
+    Room room;
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    MpscQueue<Answer> queue;
+    std::atomic<int> producers_left;
+    bool use_queue;
+    LatencyHistogram wait;     // consumer side: answer sent -> applied
+    
+    Shared(bool q, int producers) : queue(BENCH_QUEUE_CAPACITY), producers_left(producers), use_queue(q) {}
+};
+
+struct Producer {
+    Shared* shared;
+    int index;
+    pthread_t thread;
+    LatencyHistogram handoff;
+};
+
+static void* producerMain(void* arg) {
+    Producer* p = static_cast<Producer*>(arg);
+    Shared* s = p->shared;
+    uint32_t slot = (uint32_t)p->index;
+    
+    for (int i = 0; i < BENCH_ANSWERS_PER_PRODUCER; ++i) {
+        Answer a{slot, (char)('A' + i % 4), nowNs()};
+        if (s->use_queue) {
+            while (!s->queue.tryPush(a)) sched_yield();
+        } else {
+            pthread_mutex_lock(&s->mutex);
+            s->room.apply(a);
+            s->wait.record(0);
+            pthread_mutex_unlock(&s->mutex);
+        }
+        p->handoff.record(nowNs() - a.sent_ns);
+        slot = (slot + 7) % BENCH_SLOTS;
+    }
+    s->producers_left.fetch_sub(1);
+    return nullptr;
+}
+
+// The game worker
+static void consume(Shared* s) {
+    uint64_t since_format = 0;
+    Answer batch[BENCH_BATCH];
+    
+    while (true) {
+        bool done = s->producers_left.load() == 0;
+        
+        if (s->use_queue) {
+            size_t n;
+            while ((n = s->queue.drain(batch, BENCH_BATCH)) > 0) {
+                long long now = nowNs();
+                for (size_t i = 0; i < n; ++i) {
+                    s->room.apply(batch[i]);
+                    s->wait.record(now - batch[i].sent_ns);
+                }
+                since_format += n;
+                if (since_format >= BENCH_FORMAT_EVERY) {
+                    spinFor(BENCH_FORMAT_NS);
+                    since_format = 0;
+                }
+            }
+            if (done && s->queue.empty()) return;
+            sched_yield();   // the real worker sleeps on its eventfd here
+        } else {
+            // Producers apply their own answers; the worker still formats
+            // results under the same lock every so often
+            pthread_mutex_lock(&s->mutex);
+            uint64_t applied = s->room.applied;
+            if (applied - since_format >= BENCH_FORMAT_EVERY) {
+                spinFor(BENCH_FORMAT_NS);
+                since_format = applied;
+            }
+            pthread_mutex_unlock(&s->mutex);
+            if (done) return;
+            sched_yield();
+        }
+    }
+}
+
+static void runModel(bool use_queue, int producers) {
+    Shared shared(use_queue, producers);
+    std::vector<Producer> workers(producers);
+    
+    long long start = nowNs();
+    for (int i = 0; i < producers; ++i) {
+        workers[i].shared = &shared;
+        workers[i].index = i;
+        pthread_create(&workers[i].thread, nullptr, producerMain, &workers[i]);
+    }
+    consume(&shared);
+    for (auto& w : workers) pthread_join(w.thread, nullptr);
+    double seconds = (nowNs() - start) / 1e9;
+    
+    LatencyHistogram handoff;
+    for (auto& w : workers) handoff.merge(w.handoff);
+    
+    std::cout << std::setw(5) << producers << std::setw(8) << (use_queue ? "mpsc" : "mutex")
+              << std::setw(14) << std::fixed << std::setprecision(0)
+              << shared.room.applied / seconds
+              << std::setw(10) << handoff.percentile(50)
+              << std::setw(10) << handoff.percentile(99)
+              << std::setw(10) << handoff.percentile(99.9)
+              << std::setw(12) << (use_queue ? std::to_string(shared.wait.percentile(99) / 1000) : std::string("-"))
+              << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<int> counts;
+    for (int i = 1; i < argc; ++i) counts.push_back(atoi(argv[i]));
+    if (counts.empty()) counts = {1, 2, 4, 8};
+    
+    std::cout << std::setw(5) << "prod" << std::setw(8) << "model" << std::setw(14) << "answers/s"
+              << std::setw(10) << "p50_ns" << std::setw(10) << "p99_ns" << std::setw(10) << "p999_ns"
+              << std::setw(12) << "wait_p99_us" << std::endl;
+    for (int n : counts) {
+        runModel(false, n);
+        runModel(true, n);
+    }
+    return 0;
+}
@@ -0,0 +1,176 @@
+// Question bank startup: mmap'ing a .qbank file (question_bank.h) against
+// the old approach of building every Question as heap strings at startup.
+//
+// Each approach runs in a forked child so its memory is measured in
+// isolation. A child loads N questions, then plays G games' worth of draws
+// (ROUNDS distinct questions each) and touches every drawn question so the
+// pages it needs are actually faulted in.
+//
+//   g++ -O2 -std=c++17 bench/bench_bank_startup.cpp -o bench_bank_startup
+//   ./bench_bank_startup [questions...]
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <iomanip>
+#include <fstream>
+#include "../question_bank.h"
+
+#define BENCH_BANK_PATH "/tmp/bench_bank_startup.qbank"
+#define BENCH_GAMES 10000
+#define BENCH_ROUNDS 5
+#define BENCH_CATEGORIES 16
+#define BENCH_DIFFICULTIES 3
+
+struct Report {
+    double load_ms;
+    double draw_ms;
+    long rss_kb;
+    unsigned long checksum;   // keeps the draws from being optimized away
+};
+
+static long currentRssKb() {
+    FILE* f = fopen("/proc/self/status", "r");
+    if (!f) return -1;
+    char line[256];
+    long kb = -1;
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, "VmRSS:", 6) == 0) {
+            kb = atol(line + 6);
+            break;
+        }
+    }
+    fclose(f);
+    return kb;
+}
+
+static double nowMs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static Question makeQuestion(uint32_t i) {
+    std::string n = std::to_string(i);
+    return Question("Synthetic question number " + n + ", which answer is right?",
+                    {"A) First option " + n, "B) Second option " + n,
+                     "C) Third option " + n, "D) Fourth option " + n},
+                    (char)('A' + i % 4),
+                    "category" + std::to_string(i % BENCH_CATEGORIES),
+                    1 + (int)(i / BENCH_CATEGORIES) % BENCH_DIFFICULTIES);
+}
+
+// --- Old: everything on the heap --------------------------------------------
+
+static Report runHeap(uint32_t count) {
+    Report r{};
+    double start = nowMs();
+    std::vector<Question> questions;
+    questions.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) questions.push_back(makeQuestion(i));
+    r.load_ms = nowMs() - start;
+
+    std::mt19937_64 rng(42);
+    start = nowMs();
+    for (int g = 0; g < BENCH_GAMES; ++g) {
+        for (int k = 0; k < BENCH_ROUNDS; ++k) {
+            const Question& q = questions[rng() % questions.size()];
+            r.checksum += q.text.size() + q.options[3].size() + q.correct_answer;
+        }
+    }
+    r.draw_ms = nowMs() - start;
+    r.rss_kb = currentRssKb();
+    return r;
+}
+
+// --- New: mmap'd bank -------------------------------------------------------
+
+static Report runBank() {
+    Report r{};
+    double start = nowMs();
+    QuestionBank bank;
+    std::string error;
+    if (!bank.open(BENCH_BANK_PATH, error)) {
+        std::cerr << error << std::endl;
+        _exit(1);
+    }
+    std::vector<QuestionBank::Range> ranges = bank.select(-1, -1);
+    r.load_ms = nowMs() - start;
+
+    std::mt19937_64 rng(42);
+    std::vector<QuestionView> drawn;
+    start = nowMs();
+    for (int g = 0; g < BENCH_GAMES; ++g) {
+        bank.sample(ranges, BENCH_ROUNDS, rng, drawn);
+        for (const QuestionView& q : drawn) {
+            r.checksum += q.text.size() + q.options[3].size() + q.correct_answer;
+        }
+    }
+    r.draw_ms = nowMs() - start;
+    r.rss_kb = currentRssKb();
+    return r;
+}
+
+static void writeBank(uint32_t count) {
+    std::vector<Question> questions;
+    questions.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) questions.push_back(makeQuestion(i));
+    std::string bytes = buildBank(questions);
+    std::ofstream(BENCH_BANK_PATH, std::ios::binary | std::ios::trunc).write(bytes.data(), bytes.size());
+}
+
+static bool runChild(bool use_bank, uint32_t count, Report& report) {
+    int report_pipe[2];
+    if (pipe(report_pipe) < 0) return false;
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        Report r = use_bank ? runBank() : runHeap(count);
+        write(report_pipe[1], &r, sizeof(r));
+        _exit(0);
+    }
+
+    bool ok = read(report_pipe[0], &report, sizeof(report)) == sizeof(report);
+    waitpid(pid, nullptr, 0);
+    close(report_pipe[0]);
+    close(report_pipe[1]);
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<uint32_t> counts;
+    for (int i = 1; i < argc; ++i) counts.push_back((uint32_t)atol(argv[i]));
+    if (counts.empty()) counts = {10000, 100000, 1000000};
+
+    std::cout << std::setw(10) << "questions" << std::setw(8) << "model"
+              << std::setw(12) << "load_ms" << std::setw(12) << "draw_ms"
+              << std::setw(12) << "rss_kb" << std::endl;
+
+    for (uint32_t n : counts) {
+        // Build the file outside the measurement, as bankconv would, in a
+        // child of its own so the measured children do not inherit its heap
+        pid_t pid = fork();
+        if (pid == 0) {
+            writeBank(n);
+            _exit(0);
+        }
+        waitpid(pid, nullptr, 0);
+
+        for (int model = 0; model < 2; ++model) {
+            Report r{};
+            bool ok = runChild(model == 1, n, r);
+            std::cout << std::setw(10) << n << std::setw(8) << (model ? "mmap" : "heap")
+                      << std::setw(12) << std::fixed << std::setprecision(2) << r.load_ms
+                      << std::setw(12) << r.draw_ms << std::setw(12) << r.rss_kb
+                      << (ok ? "" : "  (failed)") << std::endl;
+        }
+    }
+    unlink(BENCH_BANK_PATH);
+    return 0;
+}
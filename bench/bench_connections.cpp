@@ -0,0 +1,212 @@
+// Connection count vs. server RSS and CPU: the old thread-per-client model
+// (one blocking recv loop per pthread, as handle_client used to do) against
+// the epoll Reactor from reactor.h.
+//
+// Each model runs in a forked child so its memory is measured in isolation.
+// The parent opens N client sockets and plays a few "rounds": every client
+// sends an ANSWER-sized message and waits for the server to echo it.
+//
+//   g++ -O2 bench/bench_connections.cpp -o bench_connections -pthread
+//   ./bench_connections [connections...]
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <time.h>
+#include <iomanip>
+#include "../reactor.h"
+
+#define BENCH_PORT 18080
+#define BENCH_ROUNDS 5
+
+struct Report {
+    long rss_kb;
+    double cpu_ms;
+};
+
+static long peakRssKb() {
+    FILE* f = fopen("/proc/self/status", "r");
+    if (!f) return -1;
+    char line[256];
+    long kb = -1;
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, "VmHWM:", 6) == 0) {
+            kb = atol(line + 6);
+            break;
+        }
+    }
+    fclose(f);
+    return kb;
+}
+
+static double cpuMs() {
+    rusage ru{};
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec * 1e3 + ru.ru_utime.tv_usec / 1e3 +
+           ru.ru_stime.tv_sec * 1e3 + ru.ru_stime.tv_usec / 1e3;
+}
+
+static double nowMs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// --- Model 1: thread per client -------------------------------------------
+
+static void* echoClientThread(void* arg) {
+    int sock = (int)(long)arg;
+    char buffer[1024];
+    while (true) {
+        int n = recv(sock, buffer, sizeof(buffer), 0);
+        if (n <= 0) break;
+        send(sock, buffer, n, MSG_NOSIGNAL);
+    }
+    close(sock);
+    return nullptr;
+}
+
+static void* threadAcceptLoop(void* arg) {
+    int listen_fd = (int)(long)arg;
+    while (true) {
+        int sock = accept(listen_fd, nullptr, nullptr);
+        if (sock < 0) continue;
+        pthread_t tid;
+        pthread_create(&tid, nullptr, echoClientThread, (void*)(long)sock);
+        pthread_detach(tid);
+    }
+    return nullptr;
+}
+
+static bool startThreadModel() {
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int opt = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(BENCH_PORT);
+    if (bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listen_fd, SOMAXCONN) < 0) {
+        perror("bind/listen");
+        return false;
+    }
+    pthread_t tid;
+    pthread_create(&tid, nullptr, threadAcceptLoop, (void*)(long)listen_fd);
+    pthread_detach(tid);
+    return true;
+}
+
+// --- Model 2: epoll reactor -----------------------------------------------
+
+class EchoHandler : public ReactorHandler {
+public:
+    void onMessage(Connection* conn, std::string_view message) override {
+        conn->send(makeFrame(message));
+    }
+    void onClose(Connection*) override {}
+};
+
+static bool startReactorModel() {
+    static EchoHandler handler;
+    Reactor* reactor = new Reactor(&handler);
+    if (!reactor->listenOn(BENCH_PORT)) return false;
+    pthread_t tid;
+    pthread_create(&tid, nullptr, Reactor::threadMain, reactor);
+    pthread_detach(tid);
+    return true;
+}
+
+// --- Driver -----------------------------------------------------------------
+
+static bool runModel(bool use_reactor, int connections, Report& report, double& wall_ms) {
+    int ready_pipe[2], done_pipe[2], report_pipe[2];
+    if (pipe(ready_pipe) < 0 || pipe(done_pipe) < 0 || pipe(report_pipe) < 0) return false;
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        bool ok = use_reactor ? startReactorModel() : startThreadModel();
+        char c = ok ? 1 : 0;
+        write(ready_pipe[1], &c, 1);
+        read(done_pipe[0], &c, 1);
+        Report r{peakRssKb(), cpuMs()};
+        write(report_pipe[1], &r, sizeof(r));
+        _exit(0);
+    }
+
+    char ok = 0;
+    read(ready_pipe[0], &ok, 1);
+    if (!ok) return false;
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(BENCH_PORT);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+    std::vector<int> socks;
+    for (int i = 0; i < connections; ++i) {
+        int s = socket(AF_INET, SOCK_STREAM, 0);
+        if (s < 0 || connect(s, (sockaddr*)&addr, sizeof(addr)) < 0) {
+            perror("connect");
+            break;
+        }
+        socks.push_back(s);
+    }
+
+    double start = nowMs();
+    std::string msg = frameMessage("ANSWER|1|B");
+    char buffer[64];
+    for (int round = 0; round < BENCH_ROUNDS; ++round) {
+        for (int s : socks) send(s, msg.data(), msg.size(), 0);
+        for (int s : socks) recv(s, buffer, sizeof(buffer), 0);
+    }
+    wall_ms = nowMs() - start;
+
+    // Sample while every connection is still open
+    char c = 1;
+    write(done_pipe[1], &c, 1);
+    read(report_pipe[0], &report, sizeof(report));
+
+    for (int s : socks) close(s);
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+    close(ready_pipe[0]); close(ready_pipe[1]);
+    close(done_pipe[0]); close(done_pipe[1]);
+    close(report_pipe[0]); close(report_pipe[1]);
+    return (int)socks.size() == connections;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<int> counts;
+    for (int i = 1; i < argc; ++i) counts.push_back(atoi(argv[i]));
+    if (counts.empty()) counts = {100, 1000, 5000};
+
+    rlimit rl{};
+    getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+
+    std::cout << std::setw(8) << "conns" << std::setw(10) << "model"
+              << std::setw(12) << "rss_kb" << std::setw(12) << "cpu_ms"
+              << std::setw(12) << "wall_ms" << std::endl;
+
+    for (int n : counts) {
+        for (int model = 0; model < 2; ++model) {
+            Report r{};
+            double wall_ms = 0;
+            bool ok = runModel(model == 1, n, r, wall_ms);
+            std::cout << std::setw(8) << n << std::setw(10) << (model ? "epoll" : "thread")
+                      << std::setw(12) << r.rss_kb << std::setw(12) << std::fixed
+                      << std::setprecision(1) << r.cpu_ms << std::setw(12) << wall_ms
+                      << (ok ? "" : "  (incomplete)") << std::endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,192 @@
+// Spectator fan-out (spectator.h): what a room's worker pays to get one
+// frame to every viewer, and how many frame deliveries per second the
+// viewers get, as the audience grows.
+//
+// "room loop" is what broadcastToAll does for players: the room's own
+// thread queues the frame on every connection, so its cost grows with the
+// audience and the next round waits for it. "hub, N" publishes to a
+// SpectatorChannel and lets N fan-out threads do the queueing; the room
+// only pays for a task per shard.
+//
+// Viewers are stand-in connections with no socket behind them (like a
+// replay's), so the numbers are the fan-out machinery alone; up to
+// BENCH_SOCKET_MAX viewers are run again over socketpairs, drained by a
+// reader thread, to add the kernel's share. Reported: publish time on the
+// room's thread (p50/p99) and deliveries per second until the last viewer
+// has the last frame.
+//
+//   g++ -O2 -std=c++17 bench/bench_fanout.cpp -o bench_fanout -pthread
+//   ./bench_fanout [viewers...]    (default: 100 1000 10000 100000)
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <atomic>
+#include <cstdlib>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "../spectator.h"
+#include "../histogram.h"
+
+#define BENCH_FRAMES 100
+#define BENCH_SOCKET_MAX 2000
+#define BENCH_ROOM 1
+
+static long long nowNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// A QUESTION about the size the server sends
+static FramePtr benchFrame(int round) {
+    std::string encode;
+    return shareFrame(encodeFrame(encode, [&](MessageWriter& w) {
+        w.message<QuestionSchema>(round, "Ano ang tawag sa pinakamataas na bundok sa Pilipinas?");
+        for (const char* option : {"A) Bundok Banahaw", "B) Bundok Mayon", "C) Bundok Apo", "D) Bundok Makiling"}) {
+            w.group<OptionSchema>(option);
+        }
+    }));
+}
+
+// The far ends of socket viewers, read and thrown away until stopped
+struct Drain {
+    int epoll_fd;
+    std::atomic<bool> stopping;
+    pthread_t thread;
+    
+    void run() {
+        epoll_event events[REACTOR_MAX_EVENTS];
+        char buffer[65536];
+        while (!stopping.load()) {
+            int n = epoll_wait(epoll_fd, events, REACTOR_MAX_EVENTS, 10);
+            for (int i = 0; i < n; ++i) {
+                while (read(events[i].data.fd, buffer, sizeof(buffer)) > 0) {}
+            }
+        }
+    }
+    
+    static void* threadMain(void* arg) {
+        static_cast<Drain*>(arg)->run();
+        return nullptr;
+    }
+};
+
+struct Audience {
+    std::vector<Connection*> conns;
+    std::vector<int> peers;
+    Drain drain;
+    
+    Audience(int viewers, bool sockets) {
+        drain.epoll_fd = sockets ? epoll_create1(0) : -1;
+        drain.stopping = false;
+        for (int i = 0; i < viewers; ++i) {
+            int fds[2] = {-1, -1};
+            if (sockets) {
+                socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds);
+                epoll_event ev{};
+                ev.events = EPOLLIN | EPOLLET;
+                ev.data.fd = fds[1];
+                epoll_ctl(drain.epoll_fd, EPOLL_CTL_ADD, fds[1], &ev);
+                peers.push_back(fds[1]);
+            }
+            conns.push_back(new Connection(fds[0], -1));
+        }
+        if (sockets) pthread_create(&drain.thread, nullptr, Drain::threadMain, &drain);
+    }
+    
+    ~Audience() {
+        for (Connection* conn : conns) conn->release();
+        if (drain.epoll_fd >= 0) {
+            drain.stopping = true;
+            pthread_join(drain.thread, nullptr);
+            close(drain.epoll_fd);
+        }
+        for (int fd : peers) close(fd);
+    }
+};
+
+static void printRow(int viewers, bool sockets, const std::string& mode, const LatencyHistogram& publish,
+                     double seconds) {
+    std::cout << std::setw(9) << viewers << std::setw(8) << (sockets ? "socket" : "sink") << std::setw(12) << mode
+              << std::fixed << std::setprecision(1) << std::setw(12) << publish.percentile(50) / 1000.0
+              << std::setw(12) << publish.percentile(99) / 1000.0 << std::setw(14) << std::setprecision(0)
+              << (double)viewers * BENCH_FRAMES / seconds << std::endl;
+}
+
+// The room's thread queues every frame on every viewer itself
+static void runRoomLoop(int viewers, bool sockets) {
+    Audience audience(viewers, sockets);
+    LatencyHistogram publish;
+    long long start = nowNs();
+    for (int f = 0; f < BENCH_FRAMES; ++f) {
+        FramePtr frame = benchFrame(f + 1);
+        long long t = nowNs();
+        for (Connection* conn : audience.conns) conn->send(frame);
+        publish.record(nowNs() - t);
+    }
+    printRow(viewers, sockets, "room loop", publish, (nowNs() - start) / 1e9);
+}
+
+// The room publishes once; the hub's shards do the rest
+static void runHub(int viewers, bool sockets, int shards) {
+    Audience audience(viewers, sockets);
+    SpectatorHub hub(shards);
+    hub.start();
+    std::shared_ptr<SpectatorChannel> channel = hub.open(BENCH_ROOM);
+    for (Connection* conn : audience.conns) hub.subscribe(conn, BENCH_ROOM);
+    
+    // Subscribed means queued; wait until every shard has taken its viewers
+    uint64_t base = metricTotal(SPECTATOR_FRAMES);
+    channel->publish(benchFrame(0));
+    while (metricTotal(SPECTATOR_FRAMES) - base < (uint64_t)viewers) sched_yield();
+    
+    LatencyHistogram publish;
+    base = metricTotal(SPECTATOR_FRAMES);
+    long long start = nowNs();
+    for (int f = 0; f < BENCH_FRAMES; ++f) {
+        FramePtr frame = benchFrame(f + 1);
+        long long t = nowNs();
+        channel->publish(frame);
+        publish.record(nowNs() - t);
+    }
+    while (metricTotal(SPECTATOR_FRAMES) - base < (uint64_t)viewers * BENCH_FRAMES) sched_yield();
+    double seconds = (nowNs() - start) / 1e9;
+    
+    channel->close();
+    hub.stop();
+    printRow(viewers, sockets, "hub, " + std::to_string(shards), publish, seconds);
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<int> sizes;
+    for (int i = 1; i < argc; ++i) sizes.push_back(atoi(argv[i]));
+    if (sizes.empty()) sizes = {100, 1000, 10000, 100000};
+    for (int viewers : sizes) {
+        if (viewers < 1) {
+            std::cerr << "Usage: " << argv[0] << " [viewers...]" << std::endl;
+            return 1;
+        }
+    }
+    
+    // Two descriptors per socket viewer
+    rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    
+    std::cout << BENCH_FRAMES << " frames of " << benchFrame(1)->size() << " bytes per run, one room" << std::endl;
+    std::cout << std::setw(9) << "viewers" << std::setw(8) << "via" << std::setw(12) << "mode" << std::setw(12)
+              << "pub_p50_us" << std::setw(12) << "pub_p99_us" << std::setw(14) << "deliveries/s" << std::endl;
+    for (int viewers : sizes) {
+        for (int sockets = 0; sockets <= (viewers <= BENCH_SOCKET_MAX ? 1 : 0); ++sockets) {
+            runRoomLoop(viewers, sockets);
+            runHub(viewers, sockets, 1);
+            runHub(viewers, sockets, 2);
+            runHub(viewers, sockets, 4);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,350 @@
+// The hot paths of a round, one at a time and with nothing else running:
+// what each costs in time and in heap allocations as the room grows from
+// a handful of players to 100k.
+//
+//   question   encodeQuestion, and broadcastToAll queueing the one shared
+//              frame on every player's connection
+//   answer     processAnswer: an ANSWER decoded and posted to the room's
+//              queue, plus the worker's drainEvents applying them every
+//              ROOM_DRAIN_BATCH answers
+//   lookup     applyAnswer: the event checked against its player's slot,
+//              stored there and logged
+//   evaluate   evaluateAnswers: a round scored, the leaderboard updated;
+//              the scores are put back between runs, untimed, so every
+//              run scores the same round from the same standings
+//   result     sendRoundResults: the top of the board once, then every
+//              player's own RESULT
+//   final      sendFinalResults: the same for FINAL
+//   dispatch   the client: a round's frames (QUESTION, RESULT) split out of
+//              the read buffer and decoded by its dispatchMessage
+//              (client_handler.h), every field the terminal would print
+//              read but nothing printed
+//
+// The room is the server's own TriviaServer (game.h), so what is timed is
+// the server's code and changes with it. As in a replay (-P), the
+// connections are stand-ins with no socket behind them: a frame queued on
+// one counts as written. Logging is on at the server's default level and
+// rate, into /dev/null; there is no journal, as without -J. An op is one answer for answer and lookup, one round for the rest;
+// allocations are counted by replacing operator new and delete.
+//
+//   g++ -O2 -std=c++17 bench/bench_hot_paths.cpp -o bench_hot_paths -pthread
+//   ./bench_hot_paths [players...]     (default: 3 100 1000 10000 100000)
+
+#define BENCH_MAX_PLAYERS 1000000
+#define BENCH_MIN_NS 200000000LL   // each path runs at least this long per room size
+#define BENCH_MIN_OPS 5
+#define BENCH_ROUNDS 5
+
+#include <iostream>
+#include <iomanip>
+#include <new>
+#include <cstddef>
+#include <cstdlib>
+#include <fcntl.h>
+#include "../game.h"
+#include "../client_handler.h"
+
+// Every allocation on any thread. The whole set of operators is replaced,
+// so whatever form allocates, the matching delete frees it with free().
+static std::atomic<uint64_t> allocations(0);
+
+static void* countedAlloc(size_t size, size_t align) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (size == 0) size = 1;
+    if (align <= alignof(std::max_align_t)) return malloc(size);
+    void* p;
+    return posix_memalign(&p, align, size) == 0 ? p : nullptr;
+}
+
+static void* countedNew(size_t size, size_t align) {
+    void* p = countedAlloc(size, align);
+    if (p == nullptr) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(size_t size) { return countedNew(size, 0); }
+void* operator new[](size_t size) { return countedNew(size, 0); }
+void* operator new(size_t size, std::align_val_t align) { return countedNew(size, (size_t)align); }
+void* operator new[](size_t size, std::align_val_t align) { return countedNew(size, (size_t)align); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return countedAlloc(size, 0); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return countedAlloc(size, 0); }
+void* operator new(size_t size, std::align_val_t align, const std::nothrow_t&) noexcept {
+    return countedAlloc(size, (size_t)align);
+}
+void* operator new[](size_t size, std::align_val_t align, const std::nothrow_t&) noexcept {
+    return countedAlloc(size, (size_t)align);
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { free(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { free(p); }
+
+static long long nowNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Where results go so the compiler cannot drop the work
+static volatile uint64_t sink;
+
+// A room of `n` players in the last round of a game, brought there the way
+// the server does it: everyone joins the lobby, the game starts, and every
+// round before the last is answered and closed. The worker has no thread
+// (as in a replay); the bench calls into the room where it would.
+struct BenchRoom {
+    GameConfig config;
+    GameWorker worker;
+    TriviaServer* room;
+    std::vector<Connection*> conns;   // conns[i] holds slot i
+    int round;
+    
+    BenchRoom(int n, const QuestionBank& bank, std::mt19937& rng)
+        : config{DEFAULT_ANSWER_TIMEOUT_MS, DEFAULT_ROUND_DELAY_MS, DEFAULT_LOBBY_TIMEOUT_MS, BENCH_ROUNDS,
+                 BENCH_MAX_PLAYERS},   // one room holds the lot
+          worker(BENCH_ROUNDS), round(BENCH_ROUNDS - 1) {
+        worker.drive();
+        std::vector<uint32_t> ids;
+        for (uint32_t q = 0; q < BENCH_ROUNDS; ++q) ids.push_back(q % bank.size());
+        room = new TriviaServer(1, bank, std::move(ids), config, &worker, nullptr, nullptr, nullptr);
+        for (int i = 0; i < n; ++i) {
+            conns.push_back(new Connection(-1, -1));
+            room->addPlayer(conns.back(), "player" + std::to_string(i), i + 1);
+        }
+        room->closeLobby(1);
+        room->startGame();
+        for (int r = 0; r < round; ++r) {
+            randomAnswers(r, rng);
+            room->closeRound(false);
+            room->startRound(r + 1);
+        }
+        randomAnswers(round, rng);
+    }
+    
+    // Everyone leaves, so the room lets go of the connections
+    ~BenchRoom() {
+        for (size_t i = 0; i < conns.size(); ++i) {
+            room->removePlayer(conns[i]);
+            if ((i + 1) % ROOM_DRAIN_BATCH == 0) room->drainEvents();
+        }
+        room->drainEvents();
+        room->cancelTimer();
+        delete room;
+        for (Connection* conn : conns) conn->release();
+    }
+    
+    // An ANSWER from everyone for round `r`, within the answer time
+    void randomAnswers(int r, std::mt19937& rng) {
+        for (size_t i = 0; i < conns.size(); ++i) {
+            conns[i]->recv_us = nowUs() + rng() % (DEFAULT_ANSWER_TIMEOUT_MS * 1000LL);
+            room->processAnswer(conns[i], answerMessage(r, (char)('A' + rng() % 4)));
+            if ((i + 1) % ROOM_DRAIN_BATCH == 0) room->drainEvents();
+        }
+        room->drainEvents();
+    }
+    
+    static std::string answerMessage(int r, char choice) {
+        char buffer[64];
+        MessageWriter w(buffer, sizeof(buffer));
+        w.message<AnswerSchema>(r + 1, choice);
+        return std::string(w.payload());
+    }
+    
+    // What evaluateAnswers changes, to undo it with restoreScores
+    struct Scores {
+        std::vector<int> score;
+        std::vector<int> correct;
+        Leaderboard leaderboard;
+    };
+    
+    Scores saveScores() const {
+        return Scores{room->players.score, room->players.correct, room->leaderboard};
+    }
+    
+    void restoreScores(const Scores& saved) {
+        room->players.score = saved.score;
+        room->players.correct = saved.correct;
+        room->leaderboard = saved.leaderboard;
+    }
+    
+    // The frames `send` queues for the first player, held on its connection
+    // as if a write were in flight and then taken off it
+    template <class Send>
+    std::string capture(Send&& send) {
+        Connection* conn = conns[0];
+        conn->sending = true;
+        send();
+        std::string frames;
+        pthread_mutex_lock(&conn->out_mutex);
+        for (const FramePtr& frame : conn->out_queue) frames += *frame;
+        conn->out_queue.clear();
+        conn->out_bytes = 0;
+        conn->sending = false;
+        pthread_mutex_unlock(&conn->out_mutex);
+        return frames;
+    }
+};
+
+// The client with the terminal taken out: every field the display code
+// reads is read, into a sum, and nothing is printed
+struct FieldReader : ClientHandler {
+    uint64_t seen = 0;
+    
+    void onWelcome(const Decoded<WelcomeSchema>& msg) override {
+        seen += msg.get<WelcomeSchema::TEXT>().size();
+    }
+    
+    void onQuestion(const Decoded<QuestionSchema>& msg) override {
+        GroupReader<OptionSchema> options(msg.rest);
+        if (options.count() < 3) return;
+        Decoded<OptionSchema> option;
+        while (options.next(option)) seen += option.get<OptionSchema::TEXT>().size();
+        seen += msg.get<QuestionSchema::ROUND>() + msg.get<QuestionSchema::TEXT>().size();
+    }
+    
+    void onResult(const Decoded<ResultSchema>& msg) override {
+        GroupReader<ResultEntrySchema> board(msg.rest);
+        Decoded<ResultEntrySchema> e;
+        while (board.next(e)) seen += e.get<ResultEntrySchema::SCORE>() + e.get<ResultEntrySchema::VERDICT>();
+        seen += msg.get<ResultSchema::RANK>();
+    }
+    
+    void onFinal(const Decoded<FinalSchema>& msg) override {
+        Tokenizer rest = GroupReader<RoundTimingSchema>(msg.rest).after(msg.get<FinalSchema::ROUNDS>());
+        GroupReader<FinalEntrySchema> board(rest);
+        Decoded<FinalEntrySchema> e;
+        while (board.next(e)) seen += e.get<FinalEntrySchema::SCORE>();
+    }
+};
+
+static void report(const char* path, int players, long long ns, uint64_t allocs, long long ops) {
+    std::cout << std::setw(8) << players << std::setw(10) << path << std::fixed << std::setprecision(1)
+              << std::setw(14) << (double)ns / ops << std::setw(12) << (double)allocs / ops << std::endl;
+}
+
+// Run `op` until both BENCH_MIN_OPS and BENCH_MIN_NS are reached, after one
+// untimed call to warm the buffers up
+template <class Op>
+static void measure(const char* path, int players, Op&& op) {
+    op();
+    uint64_t allocs_before = allocations.load();
+    long long start = nowNs();
+    long long ops = 0;
+    long long elapsed;
+    do {
+        op();
+        ops++;
+    } while ((elapsed = nowNs() - start) < BENCH_MIN_NS || ops < BENCH_MIN_OPS);
+    report(path, players, elapsed, allocations.load() - allocs_before, ops);
+}
+
+// The same for an op that changes what the next one would see: `reset`
+// runs before each, outside the time and the allocation count
+template <class Op, class Reset>
+static void measure(const char* path, int players, Op&& op, Reset&& reset) {
+    reset();
+    op();
+    uint64_t allocs = 0;
+    long long timed = 0;
+    long long ops = 0;
+    long long start = nowNs();
+    do {
+        reset();
+        uint64_t allocs_before = allocations.load();
+        long long op_start = nowNs();
+        op();
+        timed += nowNs() - op_start;
+        allocs += allocations.load() - allocs_before;
+        ops++;
+    } while (nowNs() - start < BENCH_MIN_NS || ops < BENCH_MIN_OPS);
+    report(path, players, timed, allocs, ops);
+}
+
+static void runRoom(int n, const QuestionBank& bank) {
+    std::mt19937 rng(n);
+    BenchRoom bench(n, bank, rng);
+    TriviaServer* room = bench.room;
+    int round = bench.round;
+    QuestionView question = bank.get(round % bank.size());
+    
+    measure("question", n, [&]() { room->broadcastToAll(room->encodeQuestion(question, round)); });
+    
+    // An ANSWER from every player for the open round, arriving in no order
+    std::vector<uint32_t> order(n);
+    for (int i = 0; i < n; ++i) order[i] = i;
+    std::shuffle(order.begin(), order.end(), rng);
+    std::vector<std::string> answers(n);
+    std::vector<RoomEvent> events(n);
+    for (int i = 0; i < n; ++i) {
+        char choice = (char)('A' + rng() % 4);
+        Connection* conn = bench.conns[order[i]];
+        answers[i] = BenchRoom::answerMessage(round, choice);
+        events[i] = RoomEvent{RoomEvent::ANSWER, choice, round, conn->slot, conn, nowUs()};
+    }
+    size_t next = 0;
+    measure("answer", n, [&]() {
+        size_t i = next++ % n;
+        room->processAnswer(bench.conns[order[i]], answers[i]);
+        if (next % ROOM_DRAIN_BATCH == 0) room->drainEvents();
+    });
+    room->drainEvents();
+    next = 0;
+    measure("lookup", n, [&]() { room->applyAnswer(events[next++ % n]); });
+    
+    BenchRoom::Scores standings = bench.saveScores();
+    measure("evaluate", n, [&]() { room->evaluateAnswers(round); }, [&]() { bench.restoreScores(standings); });
+    bench.restoreScores(standings);
+    room->evaluateAnswers(round);   // scored once, for result and final
+    measure("result", n, [&]() { room->sendRoundResults(round); });
+    measure("final", n, [&]() { room->sendFinalResults(); });
+    
+    // The client: one round's frames for the first player, as one read
+    std::string stream = bench.capture([&]() {
+        room->broadcastToAll(room->encodeQuestion(question, round));
+        room->sendRoundResults(round);
+    });
+    FrameBuffer in;
+    FieldReader reader;
+    measure("dispatch", n, [&]() {
+        in.append(stream.data(), stream.size());
+        std::string_view message;
+        while (in.nextFrame(message) == FrameBuffer::FRAME_OK) dispatchMessage(message, reader);
+        sink = sink + reader.seen;
+    });
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<int> sizes;
+    for (int i = 1; i < argc; ++i) sizes.push_back(atoi(argv[i]));
+    if (sizes.empty()) sizes = {3, 100, 1000, 10000, 100000};
+    for (int n : sizes) {
+        if (n < 1 || n > BENCH_MAX_PLAYERS) {
+            std::cerr << "Usage: " << argv[0] << " [players...]   (1 to " << BENCH_MAX_PLAYERS << " each)"
+                      << std::endl;
+            return 1;
+        }
+    }
+    
+    QuestionBank bank;
+    std::string error;
+    if (!bank.load(buildBank(RoomManager::builtinQuestions()), error)) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    logStart(open("/dev/null", O_WRONLY | O_CLOEXEC));
+    
+    std::cout << std::setw(8) << "players" << std::setw(10) << "path" << std::setw(14) << "ns/op"
+              << std::setw(12) << "allocs/op" << std::endl;
+    for (int n : sizes) runRoom(n, bank);
+    logStop();
+    return 0;
+}
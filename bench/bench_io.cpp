@@ -0,0 +1,224 @@
+// System calls per round, and what they cost in round-trip time, for the
+// reactor's three ways of doing socket I/O (-O): direct (a read and a write
+// per message, the old path), batch (one read per ready socket per wakeup,
+// a pass's writes coalesced per connection) and uring (multishot receives
+// and one submission for a broadcast's writes).
+//
+// A round is what a room does with its players: queue a QUESTION to every
+// one of them in one pass, as a game worker does, and wait for all the
+// ANSWERs. The players are plain sockets on a thread of their own that
+// answer as soon as the question is in. Counted are the server side's
+// reads, writes, io_uring_enters and epoll_waits (metrics.h), per round;
+// the round trip is from queueing the QUESTION to the reactor reading that
+// player's ANSWER. Each mode runs in a child process of its own, since the
+// reactor threads never stop.
+//
+//   g++ -O2 -std=c++17 bench/bench_io.cpp -o bench_io -pthread
+//   ./bench_io [players] [rounds]     (default: 1000, 200)
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <arpa/inet.h>
+#include "../reactor.h"
+#include "../schema.h"
+#include "../histogram.h"
+
+#define BENCH_PORT 18082
+#define BENCH_WARMUP_ROUNDS 5
+
+// The room: every player that says hello, and the answers to this round
+class BenchRoom : public ReactorHandler {
+public:
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t changed = PTHREAD_COND_INITIALIZER;
+    std::vector<Connection*> players;
+    size_t answered = 0;
+    long long round_us = 0;   // when this round's QUESTION was queued
+    LatencyHistogram round_trip;
+    
+    void onMessage(Connection* conn, std::string_view /*message*/) override {
+        pthread_mutex_lock(&mutex);
+        if (!conn->named) {
+            conn->named = true;
+            conn->retain();
+            players.push_back(conn);
+        } else {
+            round_trip.record((conn->recv_us - round_us) * 1000);
+            answered++;
+        }
+        pthread_cond_signal(&changed);
+        pthread_mutex_unlock(&mutex);
+    }
+    
+    void onClose(Connection* /*conn*/) override {}
+    
+    // Until `count` players are in, and have all answered `answers` times
+    void waitFor(size_t count, size_t answers) {
+        pthread_mutex_lock(&mutex);
+        while (players.size() < count || answered < answers) pthread_cond_wait(&changed, &mutex);
+        pthread_mutex_unlock(&mutex);
+    }
+};
+
+// The players' side: an ANSWER back for every QUESTION, straight away
+struct Players {
+    int epoll_fd;
+    std::vector<int> fds;
+    std::vector<FrameBuffer*> in;
+    pthread_t thread;
+    
+    bool connectAll(int count) {
+        epoll_fd = epoll_create1(0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(BENCH_PORT);
+        inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+        for (int i = 0; i < count; ++i) {
+            int fd = socket(AF_INET, SOCK_STREAM, 0);
+            if (fd < 0 || connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+                perror("connect");
+                return false;
+            }
+            int opt = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+            fcntl(fd, F_SETFL, O_NONBLOCK);
+            sendFrame(fd, "bench");
+            epoll_event ev{};
+            ev.events = EPOLLIN | EPOLLET;
+            ev.data.u32 = i;
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+            fds.push_back(fd);
+            in.push_back(new FrameBuffer());
+        }
+        return true;
+    }
+    
+    void run() {
+        epoll_event events[REACTOR_MAX_EVENTS];
+        std::string encode;
+        while (true) {
+            int n = epoll_wait(epoll_fd, events, REACTOR_MAX_EVENTS, -1);
+            for (int i = 0; i < n; ++i) {
+                int index = events[i].data.u32;
+                while (in[index]->readFrom(fds[index]) > 0) {}
+                std::string_view message;
+                while (in[index]->nextFrame(message) == FrameBuffer::FRAME_OK) {
+                    Decoded<QuestionSchema> question;
+                    if (!question.parse(message)) continue;
+                    std::string_view answer = encodeFrame(encode, [&](MessageWriter& w) {
+                        w.message<AnswerSchema>(question.get<QuestionSchema::ROUND>(), 'A');
+                    });
+                    write(fds[index], answer.data(), answer.size());
+                }
+            }
+        }
+    }
+    
+    static void* threadMain(void* arg) {
+        static_cast<Players*>(arg)->run();
+        return nullptr;
+    }
+};
+
+// A QUESTION about the size the server sends
+static FramePtr benchQuestion(int round) {
+    std::string encode;
+    return shareFrame(encodeFrame(encode, [&](MessageWriter& w) {
+        w.message<QuestionSchema>(round, "Ano ang tawag sa pinakamataas na bundok sa Pilipinas?");
+        for (const char* option : {"A) Bundok Banahaw", "B) Bundok Mayon", "C) Bundok Apo", "D) Bundok Makiling"}) {
+            w.group<OptionSchema>(option);
+        }
+    }));
+}
+
+static uint64_t ioTotal(uint64_t* calls) {
+    static const MetricCounter io[4] = {IO_READS, IO_WRITES, IO_URING_ENTERS, IO_WAITS};
+    uint64_t sum = 0;
+    for (int i = 0; i < 4; ++i) sum += calls[i] = metricTotal(io[i]);
+    return sum;
+}
+
+// In a child: one mode, from connecting the players to the last round
+static int runMode(IoBackend backend, const char* name, int players, int rounds) {
+    std::string error;
+    if (backend == IO_URING && !uringAvailable(error)) {
+        std::cout << std::setw(8) << name << "  unavailable: " << error << std::endl;
+        return 0;
+    }
+    io_backend = backend;
+    
+    BenchRoom room;
+    Reactor reactor(&room);
+    if (!reactor.listenOn(BENCH_PORT)) return 1;
+    pthread_t tid;
+    pthread_create(&tid, nullptr, Reactor::threadMain, &reactor);
+    
+    Players clients;
+    if (!clients.connectAll(players)) return 1;
+    room.waitFor(players, 0);
+    pthread_create(&clients.thread, nullptr, Players::threadMain, &clients);
+    
+    uint64_t before[4], after[4];
+    uint64_t start_calls = 0;
+    long long start_us = 0;
+    for (int r = 0; r < BENCH_WARMUP_ROUNDS + rounds; ++r) {
+        if (r == BENCH_WARMUP_ROUNDS) {
+            room.round_trip.reset();
+            start_calls = ioTotal(before);
+            start_us = reactorNowUs();
+        }
+        FramePtr question = benchQuestion(r + 1);
+        {
+            // The game worker's pass: every player's QUESTION, then the writes
+            SendBatch writes;
+            pthread_mutex_lock(&room.mutex);
+            room.round_us = reactorNowUs();
+            pthread_mutex_unlock(&room.mutex);
+            for (Connection* conn : room.players) conn->send(question);
+        }
+        room.waitFor(players, (size_t)players * (r + 1));
+    }
+    double seconds = (reactorNowUs() - start_us) / 1e6;
+    double calls = (double)(ioTotal(after) - start_calls) / rounds;
+    
+    std::cout << std::setw(8) << name << std::fixed << std::setprecision(1) << std::setw(12) << calls;
+    for (int i = 0; i < 4; ++i) std::cout << std::setw(8) << (double)(after[i] - before[i]) / rounds;
+    std::cout << std::setw(12) << room.round_trip.percentile(50) / 1000.0 << std::setw(12)
+              << room.round_trip.percentile(99) / 1000.0 << std::setw(10) << std::setprecision(0)
+              << rounds / seconds << std::endl;
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    int players = argc > 1 ? atoi(argv[1]) : 1000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 200;
+    if (players < 1 || rounds < 1) {
+        std::cerr << "Usage: " << argv[0] << " [players] [rounds]" << std::endl;
+        return 1;
+    }
+    
+    // Two descriptors per player
+    rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    
+    std::cout << players << " players over TCP loopback, " << rounds << " rounds of a " << benchQuestion(1)->size()
+              << "-byte QUESTION out and an ANSWER back" << std::endl;
+    std::cout << std::setw(8) << "mode" << std::setw(12) << "calls/round" << std::setw(8) << "read"
+              << std::setw(8) << "write" << std::setw(8) << "enter" << std::setw(8) << "wait" << std::setw(12)
+              << "rtt_p50_us" << std::setw(12) << "rtt_p99_us" << std::setw(10) << "rounds/s" << std::endl;
+    static const char* names[] = {"direct", "batch", "uring"};
+    for (int backend = IO_DIRECT; backend <= IO_URING; ++backend) {
+        pid_t child = fork();
+        if (child == 0) _exit(runMode((IoBackend)backend, names[backend], players, rounds));
+        int status = 0;
+        waitpid(child, &status, 0);
+    }
+    return 0;
+}
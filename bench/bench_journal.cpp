@@ -0,0 +1,265 @@
+// Game journal (journal.h): how many answers per second it takes, and how
+// long recovery takes as the journal grows.
+//
+// Throughput: every thread plays one game worker appending ANSWER records.
+// "fsync each" is the naive way: write the record and fdatasync it under a
+// shared lock before going on. "group, wait" appends through the journal
+// and waits until its record is durable, so it is as safe as the naive way
+// but shares each sync with whatever else arrived meanwhile. "group, async"
+// is what the server does: append and move on; the record is on disk one
+// group commit later. Reported: records per second over all threads,
+// fdatasyncs, and append -> durable latency where the thread waited.
+//
+// Recovery: play games through the journal (a snapshot per round, three
+// answers in between, an end marker), 1000 of them in flight at a time,
+// with small segments so compaction runs, then time replaying what is left
+// on disk, which is what a restart pays.
+//
+//   g++ -O2 -std=c++17 bench/bench_journal.cpp -o bench_journal -pthread
+//   ./bench_journal [dir] [threads] [games...]    (default: /tmp/trivia-journal-bench, 4, 1000 10000 100000)
+
+#define JOURNAL_SEGMENT_BYTES (4LL * 1024 * 1024)
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <pthread.h>
+#include <time.h>
+#include "../journal.h"
+#include "../histogram.h"
+
+#define BENCH_RECORDS_PER_THREAD 2000
+#define BENCH_IN_FLIGHT 1000
+#define BENCH_ROUNDS 5
+#define BENCH_PLAYERS 3
+
+enum Mode { FSYNC_EACH, GROUP_WAIT, GROUP_ASYNC };
+
+static long long nowNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static std::string bench_dir;
+
+static void clearDir() {
+    for (uint32_t segment : journalSegments(bench_dir)) unlink(journalSegmentPath(bench_dir, segment).c_str());
+}
+
+// The naive journal: one file, one lock, one sync per record
+struct SyncedFile {
+    int fd;
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    uint64_t syncs = 0;
+    
+    void append(std::string_view record) {
+        pthread_mutex_lock(&mutex);
+        (void)!write(fd, record.data(), record.size());
+        fdatasync(fd);
+        syncs++;
+        pthread_mutex_unlock(&mutex);
+    }
+};
+
+struct Worker {
+    Mode mode;
+    int room;
+    Journal* journal;
+    SyncedFile* file;
+    LatencyHistogram latency;
+    pthread_t thread;
+    
+    void run() {
+        for (int i = 0; i < BENCH_RECORDS_PER_THREAD; ++i) {
+            JournalRecord record(JOURNAL_ANSWER, room);
+            record.u32(i % BENCH_PLAYERS).i32(i % BENCH_ROUNDS).u8('A' + i % 4);
+            long long start = nowNs();
+            if (mode == FSYNC_EACH) {
+                file->append(record.finish());
+            } else if (mode == GROUP_WAIT) {
+                if (!journal->waitDurable(journal->append(record.finish()))) return;
+            } else {
+                journal->append(record.finish());
+                continue;
+            }
+            latency.record(nowNs() - start);
+        }
+    }
+    
+    static void* threadMain(void* arg) {
+        static_cast<Worker*>(arg)->run();
+        return nullptr;
+    }
+};
+
+static void runThroughput(Mode mode, int threads) {
+    static const char* names[] = {"fsync each", "group, wait", "group, async"};
+    clearDir();
+    Journal journal;
+    SyncedFile file;
+    std::string error;
+    if (mode == FSYNC_EACH) {
+        file.fd = open((bench_dir + "/naive.log").c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    } else if (!journal.open(bench_dir.c_str(), 0, JournalReplay(), error)) {
+        std::cerr << error << std::endl;
+        return;
+    } else {
+        journal.start();
+    }
+    
+    std::vector<Worker> workers(threads);
+    long long start = nowNs();
+    for (int t = 0; t < threads; ++t) {
+        workers[t].mode = mode;
+        workers[t].room = t;
+        workers[t].journal = &journal;
+        workers[t].file = &file;
+        pthread_create(&workers[t].thread, nullptr, Worker::threadMain, &workers[t]);
+    }
+    LatencyHistogram latency;
+    for (Worker& w : workers) {
+        pthread_join(w.thread, nullptr);
+        latency.merge(w.latency);
+    }
+    journal.stop();   // the async mode is only done once everything is on disk
+    double seconds = (nowNs() - start) / 1e9;
+    uint64_t syncs = mode == FSYNC_EACH ? file.syncs : journal.commits;
+    if (mode == FSYNC_EACH) {
+        close(file.fd);
+        unlink((bench_dir + "/naive.log").c_str());
+    }
+    
+    std::cout << std::setw(14) << names[mode] << std::setw(12) << std::fixed << std::setprecision(0)
+              << threads * BENCH_RECORDS_PER_THREAD / seconds << std::setw(10) << syncs;
+    if (latency.count() > 0) {
+        std::cout << std::setprecision(1) << std::setw(10) << latency.percentile(50) / 1000.0 << std::setw(10)
+                  << latency.percentile(99) / 1000.0;
+    } else {
+        std::cout << std::setw(10) << "-" << std::setw(10) << "-";
+    }
+    std::cout << std::endl;
+}
+
+static uint64_t bytes_written;   // by the recovery run, before compaction
+
+static void appendCounted(Journal& journal, JournalRecord& record) {
+    std::string_view bytes = record.finish();
+    bytes_written += bytes.size();
+    journal.append(bytes);
+}
+
+// A game as the journal sees it; mirrors what TriviaServer writes
+struct BenchRoom {
+    int id;
+    int round;
+    uint32_t segment;
+    
+    void snapshot(Journal& journal) {
+        segment = journal.segment();
+        JournalRecord record(JOURNAL_SNAPSHOT, id);
+        record.i32(round).i32(BENCH_ROUNDS);
+        for (int r = 0; r < BENCH_ROUNDS; ++r) record.u32(r);
+        for (int r = 0; r < round; ++r) record.i32(BENCH_PLAYERS).i64(2000000).i64(4000000);
+        record.u32(BENCH_PLAYERS);
+        for (int p = 0; p < BENCH_PLAYERS; ++p) {
+            record.u64(0x9e3779b97f4a7c15ULL + p).str("player").i32(round * 15).i32(round).i64(round * 2000000LL)
+                .i32(round);
+            for (int r = 0; r < BENCH_ROUNDS; ++r) record.u8(r < round ? 'B' : '?');
+        }
+        appendCounted(journal, record);
+    }
+    
+    void append(Journal& journal, JournalRecord& record) {
+        if (segment != journal.segment()) snapshot(journal);
+        appendCounted(journal, record);
+    }
+    
+    // One round: every player answers, then the round closes. False once
+    // the game is over.
+    bool playRound(Journal& journal) {
+        for (int p = 0; p < BENCH_PLAYERS; ++p) {
+            JournalRecord answer(JOURNAL_ANSWER, id);
+            answer.u32(p).i32(round).u8('B');
+            append(journal, answer);
+        }
+        if (++round < BENCH_ROUNDS) {
+            snapshot(journal);
+            return true;
+        }
+        JournalRecord end(JOURNAL_END, id);
+        append(journal, end);
+        return false;
+    }
+};
+
+static void runRecovery(int games) {
+    clearDir();
+    Journal journal;
+    std::string error;
+    if (!journal.open(bench_dir.c_str(), 0, JournalReplay(), error)) {
+        std::cerr << error << std::endl;
+        return;
+    }
+    journal.start();
+    
+    // Rooms take turns a round at a time; a finished one makes way for a
+    // new game until `games` have started
+    std::vector<BenchRoom> rooms;
+    int started = 0;
+    bytes_written = 0;
+    while (started < games && (int)rooms.size() < BENCH_IN_FLIGHT) {
+        rooms.push_back(BenchRoom{started++, 0, 0});
+        rooms.back().snapshot(journal);
+    }
+    for (size_t i = 0; started < games; i = (i + 1) % rooms.size()) {
+        if (!rooms[i].playRound(journal)) {
+            rooms[i] = BenchRoom{started++, 0, 0};
+            rooms[i].snapshot(journal);
+        }
+    }
+    journal.stop();
+    
+    JournalReplay replay;
+    long long start = nowNs();
+    if (!replay.run(bench_dir, 0, error)) {
+        std::cerr << error << std::endl;
+        return;
+    }
+    double ms = (nowNs() - start) / 1e6;
+    
+    std::cout << std::setw(10) << games << std::setw(12) << std::fixed << std::setprecision(1) << bytes_written / 1e6
+              << std::setw(10) << replay.segments.size() << std::setw(12) << replay.bytes / 1e6 << std::setw(12)
+              << replay.records << std::setw(10) << replay.rooms.size() << std::setw(12) << ms << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    bench_dir = argc > 1 ? argv[1] : "/tmp/trivia-journal-bench";
+    int threads = argc > 2 ? atoi(argv[2]) : 4;
+    std::vector<int> sizes;
+    for (int i = 3; i < argc; ++i) sizes.push_back(atoi(argv[i]));
+    if (sizes.empty()) sizes = {1000, 10000, 100000};
+    if (threads < 1 || (mkdir(bench_dir.c_str(), 0755) < 0 && errno != EEXIST)) {
+        std::cerr << "Usage: " << argv[0] << " [dir] [threads] [games...]" << std::endl;
+        return 1;
+    }
+    
+    std::cout << threads << " thread(s) x " << BENCH_RECORDS_PER_THREAD << " answers, journal in " << bench_dir
+              << std::endl;
+    std::cout << std::setw(14) << "mode" << std::setw(12) << "records/s" << std::setw(10) << "syncs"
+              << std::setw(10) << "p50_us" << std::setw(10) << "p99_us" << std::endl;
+    runThroughput(FSYNC_EACH, threads);
+    runThroughput(GROUP_WAIT, threads);
+    runThroughput(GROUP_ASYNC, threads);
+    
+    std::cout << "\nRecovery, " << BENCH_IN_FLIGHT << " games in flight, "
+              << JOURNAL_SEGMENT_BYTES / (1024 * 1024) << " MB segments" << std::endl;
+    std::cout << std::setw(10) << "games" << std::setw(12) << "MB_written" << std::setw(10) << "segments"
+              << std::setw(12) << "MB_on_disk" << std::setw(12) << "replayed" << std::setw(10) << "rooms"
+              << std::setw(12) << "replay_ms" << std::endl;
+    for (int games : sizes) runRecovery(games);
+    clearDir();
+    return 0;
+}
@@ -0,0 +1,138 @@
+// Answer throughput with logging off, with the old synchronous logging
+// (std::endl on a shared stream, inside the room's lock, as handlePlayerAnswer
+// and addPlayer used to do) and with the asynchronous logger (logger.h).
+//
+// Every thread plays one game worker applying answers to its own room: lock
+// the room, record the answer, log one "answered" line, unlock. Reported per
+// mode: answers per second over all threads, per-answer latency percentiles,
+// and for the async logger how many lines were written and dropped (its ring
+// was full, or the per-thread rate limit kicked in).
+//
+//   g++ -O2 -std=c++17 bench/bench_logging.cpp -o bench_logging -pthread
+//   ./bench_logging [threads] [log_file]      (default: 4 threads, /dev/null)
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include "../logger.h"
+#include "../histogram.h"
+
+#define BENCH_ANSWERS_PER_THREAD 200000
+#define BENCH_PLAYERS 3
+
+enum Mode { OFF, SYNC, ASYNC, ASYNC_LIMITED };
+
+static long long nowNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static std::ofstream sync_sink;   // the old std::cout, shared by every thread
+
+struct Worker {
+    Mode mode;
+    int room_id;
+    pthread_t thread;
+    pthread_mutex_t room_mutex = PTHREAD_MUTEX_INITIALIZER;
+    char answers[BENCH_PLAYERS];
+    LatencyHistogram latency;
+};
+
+static const char* player_names[BENCH_PLAYERS] = {"ana", "ben", "cy"};
+
+static void* workerMain(void* arg) {
+    Worker* w = static_cast<Worker*>(arg);
+    for (int i = 0; i < BENCH_ANSWERS_PER_THREAD; ++i) {
+        int slot = i % BENCH_PLAYERS;
+        char choice = (char)('A' + i % 4);
+        long long start = nowNs();
+        
+        pthread_mutex_lock(&w->room_mutex);
+        w->answers[slot] = choice;
+        if (w->mode == SYNC) {
+            sync_sink << "[Room " << w->room_id << "][" << player_names[slot] << "] answered: " << choice << std::endl;
+        } else if (w->mode != OFF) {
+            LogEvent(LOG_INFO, "answered").kv("room", w->room_id).kv("round", i % 5 + 1)
+                .kv("player", player_names[slot]).kv("choice", choice);
+        }
+        pthread_mutex_unlock(&w->room_mutex);
+        
+        w->latency.record(nowNs() - start);
+    }
+    return nullptr;
+}
+
+static uint64_t droppedLines() {
+    uint64_t dropped = 0;
+    for (LogRing* r = log_rings.load(); r != nullptr; r = r->next) {
+        dropped += r->dropped_full.load() + r->dropped_rate.load();
+    }
+    return dropped;
+}
+
+static void runMode(Mode mode, int threads, int fd) {
+    static const char* names[] = {"off", "sync", "async", "async+rate"};
+    if (mode == ASYNC || mode == ASYNC_LIMITED) {
+        logSetLevel(LOG_INFO);
+        logSetRate(mode == ASYNC ? 0 : DEFAULT_LOG_RATE);
+        logStart(fd);
+    }
+    uint64_t dropped_before = droppedLines();
+    
+    std::vector<Worker> workers(threads);
+    long long start = nowNs();
+    for (int i = 0; i < threads; ++i) {
+        workers[i].mode = mode;
+        workers[i].room_id = i + 1;
+        pthread_create(&workers[i].thread, nullptr, workerMain, &workers[i]);
+    }
+    for (auto& w : workers) pthread_join(w.thread, nullptr);
+    double seconds = (nowNs() - start) / 1e9;
+    if (mode == ASYNC || mode == ASYNC_LIMITED) logStop();   // drain before the next mode
+    
+    LatencyHistogram all;
+    for (auto& w : workers) all.merge(w.latency);
+    uint64_t total = (uint64_t)threads * BENCH_ANSWERS_PER_THREAD;
+    uint64_t dropped = droppedLines() - dropped_before;
+    
+    std::cout << std::setw(12) << names[mode] << std::setw(14) << std::fixed << std::setprecision(0)
+              << total / seconds << std::setw(10) << all.percentile(50) << std::setw(10) << all.percentile(99)
+              << std::setw(10) << all.percentile(99.9) << std::setw(10) << all.max();
+    if (mode == ASYNC || mode == ASYNC_LIMITED) {
+        std::cout << std::setw(12) << total - dropped << std::setw(12) << dropped;
+    } else {
+        std::cout << std::setw(12) << (mode == SYNC ? total : 0) << std::setw(12) << 0;
+    }
+    std::cout << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    int threads = argc > 1 ? atoi(argv[1]) : 4;
+    const char* path = argc > 2 ? argv[2] : "/dev/null";
+    
+    sync_sink.open(path, std::ios::app);
+    int fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (!sync_sink || fd < 0 || threads < 1) {
+        std::cerr << "Usage: " << argv[0] << " [threads] [log_file]" << std::endl;
+        return 1;
+    }
+    
+    std::cout << threads << " thread(s), " << BENCH_ANSWERS_PER_THREAD << " answers each, logging to " << path
+              << std::endl;
+    std::cout << std::setw(12) << "mode" << std::setw(14) << "answers/s" << std::setw(10) << "p50_ns"
+              << std::setw(10) << "p99_ns" << std::setw(10) << "p999_ns" << std::setw(10) << "max_ns"
+              << std::setw(12) << "lines" << std::setw(12) << "dropped" << std::endl;
+    runMode(OFF, threads, fd);
+    runMode(SYNC, threads, fd);
+    runMode(ASYNC, threads, fd);
+    runMode(ASYNC_LIMITED, threads, fd);
+    close(fd);
+    return 0;
+}
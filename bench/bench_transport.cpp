@@ -0,0 +1,186 @@
+// Message round trip between two processes on one host: TCP over loopback
+// (what a co-located client used to get), a plain Unix socket, and the
+// shared memory rings from shm_ring.h with their eventfd doorbells.
+//
+// A forked child plays the client and echoes every frame; the parent plays
+// the server and times each round trip. Both sides block when there is
+// nothing to read, as the real client and reactor do.
+//
+//   g++ -O2 -std=c++17 bench/bench_transport.cpp -o bench_transport
+//   ./bench_transport [round_trips] [payload_bytes]     (default: 100000, 120)
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstdlib>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <time.h>
+#include "../shm_ring.h"
+#include "../histogram.h"
+
+#define BENCH_PORT 18081
+#define BENCH_SOCKET "/tmp/hulaan-bench.sock"
+
+enum Mode { TCP, UNIX, SHM };
+
+static long long nowNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// One end: a socket, or a ring pair plus the socket that set it up
+struct Link {
+    int fd;
+    ShmEndpoint* shm;
+    FrameBuffer in;
+    
+    Link(int f, ShmEndpoint* s) : fd(f), shm(s) {}
+    
+    bool send(std::string_view payload) {
+        return shm ? shm->sendFrame(payload) : sendFrame(fd, payload);
+    }
+    
+    bool receive(std::string_view& message) {
+        while (true) {
+            FrameBuffer::Status status = in.nextFrame(message);
+            if (status == FrameBuffer::FRAME_OK) return true;
+            if (status == FrameBuffer::FRAME_ERROR) return false;
+            
+            ssize_t n;
+            if (shm == nullptr) {
+                n = in.readFrom(fd);
+            } else if ((n = shm->receive(in, false)) < 0) {
+                pollfd fds[2] = {{shm->bell(), POLLIN, 0}, {fd, POLLIN, 0}};
+                poll(fds, 2, -1);
+                if (fds[1].revents != 0) return false;
+                continue;
+            }
+            if (n <= 0) return false;
+        }
+    }
+};
+
+static int listenOn(Mode mode) {
+    if (mode == TCP) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        int opt = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(BENCH_PORT);
+        if (bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 1) < 0) return -1;
+        return fd;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, BENCH_SOCKET);
+    unlink(BENCH_SOCKET);
+    if (bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 1) < 0) return -1;
+    return fd;
+}
+
+// Child: connect the way the client does and echo until the parent hangs up
+static void echoMain(Mode mode) {
+    Link link(-1, nullptr);
+    std::string error;
+    if (mode == SHM) {
+        link.shm = shmConnect(BENCH_SOCKET, link.fd, error);
+        if (link.shm == nullptr) _exit(1);
+    } else if (mode == UNIX) {
+        link.fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, BENCH_SOCKET);
+        if (connect(link.fd, (sockaddr*)&addr, sizeof(addr)) < 0) _exit(1);
+    } else {
+        link.fd = socket(AF_INET, SOCK_STREAM, 0);
+        int opt = 1;
+        setsockopt(link.fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(BENCH_PORT);
+        if (connect(link.fd, (sockaddr*)&addr, sizeof(addr)) < 0) _exit(1);
+    }
+    
+    std::string_view message;
+    while (link.receive(message)) {
+        std::string copy(message);   // the view dies with the next read
+        if (!link.send(copy)) break;
+    }
+    _exit(0);
+}
+
+static void runMode(Mode mode, int round_trips, int payload_bytes) {
+    static const char* names[] = {"tcp loopback", "unix socket", "shm rings"};
+    int listen_fd = listenOn(mode);
+    if (listen_fd < 0) {
+        perror("listen");
+        return;
+    }
+    
+    pid_t child = fork();
+    if (child == 0) {
+        close(listen_fd);
+        echoMain(mode);
+    }
+    
+    Link link(accept(listen_fd, nullptr, nullptr), nullptr);
+    close(listen_fd);
+    if (mode == TCP) {
+        int opt = 1;
+        setsockopt(link.fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    }
+    if (mode == SHM) link.shm = shmAccept(link.fd);
+    
+    std::string payload = "QUESTION|1|" + std::string(std::max(0, payload_bytes - 11), 'x');
+    LatencyHistogram rtt;
+    std::string_view echo;
+    long long start = nowNs();
+    for (int i = 0; i < round_trips; ++i) {
+        long long sent = nowNs();
+        if (!link.send(payload) || !link.receive(echo)) {
+            std::cerr << names[mode] << ": echo failed" << std::endl;
+            break;
+        }
+        rtt.record(nowNs() - sent);
+    }
+    double seconds = (nowNs() - start) / 1e9;
+    
+    shutdown(link.fd, SHUT_RDWR);
+    waitpid(child, nullptr, 0);
+    delete link.shm;
+    close(link.fd);
+    if (mode != TCP) unlink(BENCH_SOCKET);
+    
+    std::cout << std::setw(14) << names[mode] << std::setw(14) << std::fixed << std::setprecision(0)
+              << rtt.count() / seconds << std::setprecision(1) << std::setw(10) << rtt.percentile(50) / 1000.0
+              << std::setw(10) << rtt.percentile(99) / 1000.0 << std::setw(10) << rtt.percentile(99.9) / 1000.0 << std::setw(10) << rtt.max() / 1000.0 << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    int round_trips = argc > 1 ? atoi(argv[1]) : 100000;
+    int payload_bytes = argc > 2 ? atoi(argv[2]) : 120;
+    if (round_trips < 1 || payload_bytes < 0) {
+        std::cerr << "Usage: " << argv[0] << " [round_trips] [payload_bytes]" << std::endl;
+        return 1;
+    }
+    
+    std::cout << round_trips << " round trips of a " << payload_bytes << "-byte frame" << std::endl;
+    std::cout << std::setw(14) << "transport" << std::setw(14) << "trips/s" << std::setw(10) << "p50_us"
+              << std::setw(10) << "p99_us" << std::setw(10) << "p999_us" << std::setw(10) << "max_us" << std::endl;
+    runMode(TCP, round_trips, payload_bytes);
+    runMode(UNIX, round_trips, payload_bytes);
+    runMode(SHM, round_trips, payload_bytes);
+    return 0;
+}
@@ -1,228 +1,580 @@
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <vector>
 #include <cstring>
 #include <unistd.h>
 #include <arpa/inet.h>
-#include <pthread.h>
-#include <sstream>
+#include <poll.h>
 #include <iomanip>
+#include <getopt.h>
+#include "protocol.h"
+#include "schema.h"
+#include "client_handler.h"
+#include "multicast.h"
+#include "shm_ring.h"
+#include "loadgen.h"
 
 #define SERVER_IP "192.168.56.101" //this is based on my network i don't know with yours
 #define PORT 8080
-#define BUFFER_SIZE 1024
+#define LOADGEN_SERVER_IP "127.0.0.1"
+#define DEFAULT_BOT_GAMES 1
+#define DEFAULT_BOT_ACCURACY 0.7
+#define DEFAULT_THINK_MIN_MS 200
+#define DEFAULT_THINK_MAX_MS 2000
+#define RECONNECT_ATTEMPTS 10
+#define RECONNECT_DELAY_MS 500
 
-int client_socket;
+int client_socket;   // with -u, the Unix socket: only its hangup matters
+ShmEndpoint* local_link = nullptr;   // -u: frames go through shared memory
+const char* server_ip = nullptr;
+int server_port = PORT;
+const char* local_path = nullptr;
+int watch_room = -1;   // -w: a viewer of this room, not a player
 bool game_ended = false;
-pthread_mutex_t output_mutex = PTHREAD_MUTEX_INITIALIZER;
+int open_round = 0;    // the latest QUESTION's round while we owe it an answer, else 0
+std::string session;   // the SESSION message, for RESUME
 
-void safe_print(const std::string& message) {
-    pthread_mutex_lock(&output_mutex);
-    std::cout << message << std::endl;
-    pthread_mutex_unlock(&output_mutex);
-}
+// Set when the server offers multicast and joining the group works
+MulticastReceiver* mcast = nullptr;
 
-void displayQuestion(const std::vector<std::string>& parts) {
-    if (parts.size() < 6) return;
+// What the next write() puts on the terminal. Screens are rendered here
+// and go out whole, once per turn of the event loop, instead of a line at
+// a time.
+std::ostringstream screen;
+
+// Open client_socket (and local_link with -u); false with the reason
+bool connectToServer(std::string& error) {
+    if (local_path != nullptr) {
+        // Same host: handshake on the Unix socket, then shared memory
+        local_link = shmConnect(local_path, client_socket, error);
+        return local_link != nullptr;
+    }
+    
+    client_socket = socket(AF_INET, SOCK_STREAM, 0);
+    if (client_socket == -1) {
+        error = "socket creation failed";
+        return false;
+    }
     
-    std::string round = parts[1];
-    std::string question = parts[2];
+    // Configure server address
+    struct sockaddr_in server_addr{};
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(server_port);
+    inet_pton(AF_INET, server_ip, &server_addr.sin_addr);
+    
+    if (connect(client_socket, (struct sockaddr*)&server_addr, sizeof(server_addr)) == -1) {
+        error = strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+void sendToServer(std::string_view payload) {
+    if (local_link != nullptr) {
+        local_link->sendFrame(payload);
+    } else {
+        sendFrame(client_socket, payload);
+    }
+}
+
+// Everything we send is short enough for the stack
+template <class S, class... Args>
+void sendMessage(const Args&... values) {
+    char buffer[256];
+    MessageWriter w(buffer, sizeof(buffer));
+    w.message<S>(values...);
+    sendToServer(w.payload());
+}
+
+void requestRepair(int first, int last) {
+    sendMessage<NackSchema>(first, last);
+}
+
+// Everything rendered so far, in one write()
+void flushScreen() {
+    std::string out = screen.str();
+    screen.str("");
+    size_t done = 0;
+    while (done < out.size()) {
+        ssize_t n = write(STDOUT_FILENO, out.data() + done, out.size() - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        done += n;
+    }
+}
+
+void printLine(const std::string& message) {
+    screen << message << "\n";
+}
+
+void displayQuestion(int round, std::string_view text, GroupReader<OptionSchema> options) {
+    if (options.count() < 3) return;
+    open_round = round;
     
-    pthread_mutex_lock(&output_mutex);
-    std::cout << "\n" << std::string(60, '=') << std::endl;
-    std::cout << "ROUND " << round << " - TANONG:" << std::endl;
-    std::cout << std::string(60, '=') << std::endl;
-    std::cout << question << std::endl;
-    std::cout << std::string(60, '-') << std::endl;
+    screen << "\n" << std::string(60, '=') << "\n";
+    screen << "ROUND " << round << " - TANONG:\n";
+    screen << std::string(60, '=') << "\n";
+    screen << text << "\n";
+    screen << std::string(60, '-') << "\n";
     
-    for (int i = 3; i < parts.size(); ++i) {
-        std::cout << parts[i] << std::endl;
+    Decoded<OptionSchema> option;
+    while (options.next(option)) {
+        screen << option.get<OptionSchema::TEXT>() << "\n";
     }
     
-    std::cout << std::string(60, '-') << std::endl;
-    std::cout << "Isulat ang inyong sagot (A, B, C, o D): ";
-    std::cout.flush();
-    pthread_mutex_unlock(&output_mutex);
+    screen << std::string(60, '-') << "\n";
+    if (watch_room < 0) screen << "Isulat ang inyong sagot (A, B, C, o D): ";
 }
 
-void displayResult(const std::vector<std::string>& parts) {
-    if (parts.size() < 3) return;
-    
-    std::string round = parts[1];
-    std::string correct_answer = parts[2];
-    
-    pthread_mutex_lock(&output_mutex);
-    std::cout << "\n" << std::string(40, '*') << std::endl;
-    std::cout << "RESULTA NG ROUND " << round << std::endl;
-    std::cout << std::string(40, '*') << std::endl;
-    std::cout << "Tamang sagot: " << correct_answer << std::endl;
-    std::cout << std::string(40, '-') << std::endl;
-    
-    // Parse player results (name|answer|result|score)
-    for (int i = 3; i < parts.size(); i += 4) {
-        if (i + 3 < parts.size()) {
-            std::string name = parts[i];
-            std::string answer = parts[i + 1];
-            std::string result = parts[i + 2];
-            std::string score = parts[i + 3];
-            
-            std::cout << std::setw(8) << name 
-                      << " | Sagot: " << answer 
-                      << " | " << result << (result == "TAMA" ? " ✓" : " ✗")
-                      << " | Score: " << score << std::endl;
-        }
+const char* verdict(bool correct) {
+    return correct ? "TAMA ✓" : "MALI ✗";
+}
+
+// A round's correct answer and the top of the leaderboard, as players and
+// viewers both see it
+void printRoundBoard(int round, char correct, const Tokenizer& entries) {
+    screen << "\n" << std::string(40, '*') << "\n";
+    screen << "RESULTA NG ROUND " << round << "\n";
+    screen << std::string(40, '*') << "\n";
+    screen << "Tamang sagot: " << correct << "\n";
+    screen << std::string(40, '-') << "\n";
+    
+    typedef ResultEntrySchema E;
+    GroupReader<E> board(entries);
+    Decoded<E> e;
+    while (board.next(e)) {
+        screen << std::setw(8) << e.get<E::NAME>()
+               << " | Sagot: " << e.get<E::ANSWER>()
+               << " | " << verdict(e.get<E::VERDICT>())
+               << " | Score: " << e.get<E::SCORE>() << "\n";
     }
-    std::cout << std::string(40, '-') << std::endl;
-    pthread_mutex_unlock(&output_mutex);
+    screen << std::string(40, '-') << "\n";
+}
+
+void displayResult(const Decoded<ResultSchema>& msg) {
+    typedef ResultSchema R;
+    open_round = 0;   // the round is over, answered or not
+    printRoundBoard(msg.get<R::ROUND>(), msg.get<R::CORRECT>(), msg.rest);
+    screen << "Ikaw: Sagot: " << msg.get<R::ANSWER>()
+           << " | " << verdict(msg.get<R::VERDICT>())
+           << " | Score: " << msg.get<R::SCORE>()
+           << " | Ranggo: " << msg.get<R::RANK>() << "/" << msg.get<R::PLAYERS>() << "\n";
+}
+
+void displayWatchResult(const Decoded<WatchResultSchema>& msg) {
+    typedef WatchResultSchema R;
+    printRoundBoard(msg.get<R::ROUND>(), msg.get<R::CORRECT>(), msg.rest);
+    screen << msg.get<R::PLAYERS>() << " manlalaro\n";
 }
 
-void displayFinalResult(const std::vector<std::string>& parts) {
-    pthread_mutex_lock(&output_mutex);
-    std::cout << "\n" << std::string(50, '=') << std::endl;
-    std::cout << "FINAL NA RESULTA - HULAAN SA BAYAN" << std::endl;
-    std::cout << std::string(50, '=') << std::endl;
-    
-    std::cout << std::setw(6) << "RANK" << std::setw(12) << "PANGALAN" 
-              << std::setw(8) << "SCORE" << std::setw(12) << "ACCURACY" << std::endl;
-    std::cout << std::string(50, '-') << std::endl;
-    
-    // Parse final results (rank|name|score|accuracy)
-    for (int i = 1; i < parts.size(); i += 4) {
-        if (i + 3 < parts.size()) {
-            std::string rank = parts[i];
-            std::string name = parts[i + 1];
-            std::string score = parts[i + 2];
-            std::string accuracy = parts[i + 3];
-            
-            std::cout << std::setw(6) << rank 
-                      << std::setw(12) << name
-                      << std::setw(8) << score
-                      << std::setw(10) << accuracy << "%" << std::endl;
+// Back in the game after a reconnect: where it is and how we stand, then
+// the open question if we still owe it an answer
+void displayState(const Decoded<StateSchema>& msg) {
+    typedef StateSchema S;
+    int round = msg.get<S::ROUND>();
+    bool open = msg.get<S::OPEN>() != 0;
+    bool owe_answer = open && msg.get<S::ANSWER>() == '?';
+    open_round = owe_answer ? round : 0;
+    
+    screen << "\n" << std::string(40, '*') << "\n";
+    screen << "NAKABALIK SA LARO - ROUND " << round << "/" << msg.get<S::ROUNDS>() << "\n";
+    screen << std::string(40, '*') << "\n";
+    GroupReader<StateEntrySchema> board(msg.rest);
+    Decoded<StateEntrySchema> e;
+    for (int i = 0; i < msg.get<S::ENTRIES>() && board.next(e); ++i) {
+        screen << std::setw(8) << e.get<StateEntrySchema::NAME>() << " | Score: "
+               << e.get<StateEntrySchema::SCORE>() << "\n";
+    }
+    screen << std::string(40, '-') << "\n";
+    screen << "Ikaw: Score: " << msg.get<S::SCORE>() << " | Ranggo: " << msg.get<S::RANK>() << "/"
+           << msg.get<S::PLAYERS>() << "\n";
+    if (open && !owe_answer) {
+        screen << "Naipadala na ang sagot: " << msg.get<S::ANSWER>() << "\n";
+    }
+    
+    // The open question follows the board
+    Tokenizer rest = GroupReader<StateEntrySchema>(msg.rest).after(msg.get<S::ENTRIES>());
+    Decoded<StateQuestionSchema> question;
+    if (owe_answer && question.parseFrom(rest)) {
+        displayQuestion(round, question.get<StateQuestionSchema::TEXT>(), GroupReader<OptionSchema>(rest));
+    }
+}
+
+// FINAL's standings and winner; `rest` starts at the per-round timings
+void printStandings(int rounds, const Tokenizer& rest) {
+    screen << "\n" << std::string(50, '=') << "\n";
+    screen << "FINAL NA RESULTA - HULAAN SA BAYAN\n";
+    screen << std::string(50, '=') << "\n";
+    
+    screen << std::setw(6) << "RANK" << std::setw(12) << "PANGALAN" 
+           << std::setw(8) << "SCORE" << std::setw(12) << "ACCURACY" << "\n";
+    screen << std::string(50, '-') << "\n";
+    
+    // Final results, best first; they follow the per-round timings
+    typedef FinalEntrySchema E;
+    GroupReader<E> board(GroupReader<RoundTimingSchema>(rest).after(rounds));
+    Decoded<E> e, winner;
+    bool has_winner = false;
+    screen << std::fixed << std::setprecision(1);
+    while (board.next(e)) {
+        if (!has_winner) {
+            winner = e;
+            has_winner = true;
         }
+        screen << std::setw(6) << e.get<E::RANK>()
+               << std::setw(12) << e.get<E::NAME>()
+               << std::setw(8) << e.get<E::SCORE>()
+               << std::setw(10) << e.get<E::ACCURACY>() << "%\n";
     }
     
     // Show winner
-    if (parts.size() >= 6) {
-        std::string winner = parts[2];
-        std::string winner_score = parts[4];
-        std::cout << "\n🏆 PANALO: " << winner << " (" << winner_score << " points)!" << std::endl;
+    if (has_winner) {
+        screen << "\n🏆 PANALO: " << winner.get<E::NAME>() << " (" << winner.get<E::SCORE>() << " points)!\n";
     }
+}
+
+// How fast the room answered each round, in ms
+void printRoundTimings(int rounds, const Tokenizer& rest) {
+    GroupReader<RoundTimingSchema> timings(rest);
+    Decoded<RoundTimingSchema> t;
+    for (int r = 1; r <= rounds && timings.next(t); ++r) {
+        screen << "  Round " << r << ": " << t.get<RoundTimingSchema::ANSWERS>() << " sagot, p50 "
+               << t.get<RoundTimingSchema::P50_MS>() << " ms, p99 " << t.get<RoundTimingSchema::P99_MS>()
+               << " ms\n";
+    }
+}
+
+void displayFinalResult(const Decoded<FinalSchema>& msg) {
+    typedef FinalSchema F;
+    printStandings(msg.get<F::ROUNDS>(), msg.rest);
+    screen << "Ang iyong ranggo: " << msg.get<F::RANK>() << " sa " << msg.get<F::PLAYERS>()
+           << " (" << msg.get<F::SCORE>() << " points, " << msg.get<F::ACCURACY>() << "%)\n";
     
-    std::cout << "\nSalamat sa paglalaro! Disconnecting..." << std::endl;
-    pthread_mutex_unlock(&output_mutex);
+    // How fast the room answered each round, in ms
+    screen << "\nBilis ng pagsagot (ikaw: ";
+    if (msg.get<F::ANSWER_MS>() >= 0) {
+        screen << msg.get<F::ANSWER_MS>();
+    } else {
+        screen << "-";
+    }
+    screen << " ms)\n";
+    printRoundTimings(msg.get<F::ROUNDS>(), msg.rest);
+    
+    screen << "\nSalamat sa paglalaro! Disconnecting...\n";
     
     game_ended = true;
 }
 
-void* receive_messages(void* arg) {
-    char buffer[BUFFER_SIZE];
+void displayWatchFinal(const Decoded<WatchFinalSchema>& msg) {
+    typedef WatchFinalSchema F;
+    printStandings(msg.get<F::ROUNDS>(), msg.rest);
+    screen << msg.get<F::PLAYERS>() << " manlalaro\n";
+    screen << "\nBilis ng pagsagot:\n";
+    printRoundTimings(msg.get<F::ROUNDS>(), msg.rest);
     
-    while (!game_ended) {
-        memset(buffer, 0, BUFFER_SIZE);
-        int bytes_received = recv(client_socket, buffer, BUFFER_SIZE, 0);
-        if (bytes_received <= 0) {
-            safe_print("Disconnected from server.");
-            game_ended = true;
-            break;
+    screen << "\nSalamat sa panonood! Disconnecting...\n";
+    
+    game_ended = true;
+}
+
+void handleMessage(std::string_view message);
+
+// Join the room's group on the interface our TCP connection goes out of.
+// If that fails we simply never say MCAST_OK and everything stays on TCP.
+void joinMulticast(const Decoded<McastOfferSchema>& offer) {
+    sockaddr_in local{};
+    socklen_t len = sizeof(local);
+    getsockname(client_socket, (sockaddr*)&local, &len);
+    
+    MulticastReceiver* receiver = new MulticastReceiver(handleMessage);
+    std::string error;
+    if (!receiver->open(offer, local.sin_addr, error)) {
+        printLine("Multicast unavailable (" + error + "), staying on TCP");
+        delete receiver;
+        return;
+    }
+    mcast = receiver;
+    sendMessage<McastOkSchema>();
+}
+
+// What the terminal makes of each message
+struct Terminal : ClientHandler {
+    void onWelcome(const Decoded<WelcomeSchema>& msg) override {
+        printLine("\n" + std::string(msg.get<WelcomeSchema::TEXT>()));
+    }
+    
+    void onQuestion(const Decoded<QuestionSchema>& msg) override {
+        displayQuestion(msg.get<QuestionSchema::ROUND>(), msg.get<QuestionSchema::TEXT>(),
+                        GroupReader<OptionSchema>(msg.rest));
+    }
+    
+    void onResult(const Decoded<ResultSchema>& msg) override { displayResult(msg); }
+    void onFinal(const Decoded<FinalSchema>& msg) override { displayFinalResult(msg); }
+    void onWatchResult(const Decoded<WatchResultSchema>& msg) override { displayWatchResult(msg); }
+    void onWatchFinal(const Decoded<WatchFinalSchema>& msg) override { displayWatchFinal(msg); }
+    void onState(const Decoded<StateSchema>& msg) override { displayState(msg); }
+    
+    void onWatchFailed(const Decoded<WatchFailedSchema>& msg) override {
+        printLine("Hindi mapanood ang laro: " + std::string(msg.get<WatchFailedSchema::REASON>()));
+        game_ended = true;
+    }
+    
+    void onSession(std::string_view message) override {
+        session = message;
+    }
+    
+    void onResumeFailed(const Decoded<ResumeFailedSchema>& msg) override {
+        printLine("Hindi na makabalik sa laro: " + std::string(msg.get<ResumeFailedSchema::REASON>()));
+        session.clear();
+        game_ended = true;
+    }
+    
+    void onMcastOffer(const Decoded<McastOfferSchema>& offer) override {
+        if (offer.get<McastOfferSchema::SLOT>() < 0) return;
+        if (mcast == nullptr) {
+            joinMulticast(offer);
+        } else {
+            sendMessage<McastOkSchema>();   // resumed; still in the group
         }
+    }
+    
+    void onMcastStart(std::string_view message) override {
+        if (mcast != nullptr) mcast->start(message);
+    }
+    
+    // A datagram the server resent over TCP
+    void onMulticast(std::string_view message) override {
+        int first, last;
+        if (mcast != nullptr && mcast->receive(message, first, last)) requestRepair(first, last);
+    }
+    
+    void onOther(std::string_view message) override {
+        printLine("Server: " + std::string(message));
+    }
+};
+
+void handleMessage(std::string_view message) {
+    static Terminal terminal;
+    dispatchMessage(message, terminal);
+}
+
+// The connection dropped mid-game: dial again and ask for our slot back.
+// The server answers with STATE, or RESUME_FAILED once the game is gone.
+bool reconnect(FrameBuffer& in) {
+    if (session.empty()) return false;
+    printLine("\nNawala ang koneksyon, kumokonekta muli...");
+    flushScreen();   // the attempts below block
+    
+    for (int attempt = 0; attempt < RECONNECT_ATTEMPTS && !game_ended; ++attempt) {
+        if (attempt > 0) usleep(RECONNECT_DELAY_MS * 1000);
         
-        std::string message(buffer);
-        
-        // Parse message
-        std::istringstream iss(message);
-        std::string token;
-        std::vector<std::string> parts;
-        
-        while (std::getline(iss, token, '|')) {
-            parts.push_back(token);
+        close(client_socket);
+        delete local_link;
+        local_link = nullptr;
+        std::string error;
+        bool ok = connectToServer(error);
+        if (ok) {
+            if (mcast != nullptr) mcast->suspend();
+            char buffer[256];
+            MessageWriter w(buffer, sizeof(buffer));
+            ok = writeResume(session, w);
+            if (ok) ok = local_link ? local_link->sendFrame(w.payload()) : sendFrame(client_socket, w.payload());
         }
         
-        if (parts.empty()) continue;
-        
-        std::string message_type = parts[0];
-        
-        if (message_type == "WELCOME") {
-            if (parts.size() > 1) {
-                safe_print("\n" + parts[1]);
-            }
-        }
-        else if (message_type == "QUESTION") {
-            displayQuestion(parts);
-        }
-        else if (message_type == "RESULT") {
-            displayResult(parts);
+        if (ok) {
+            in.clear();   // a partial frame from the old connection is useless
+            return true;
         }
-        else if (message_type == "FINAL") {
-            displayFinalResult(parts);
-        }
-        else {
-            safe_print("Server: " + message);
+    }
+    return false;
+}
+
+enum ServerRead { SERVER_OK, SERVER_GONE, SERVER_GARBLED };
+
+// Whatever the server has sent, handled. The socket blocks, so it gets one
+// read per poll; with -u the ring is emptied, since only finding it empty
+// asks the server to ring the bell again.
+ServerRead readServer(FrameBuffer& in, bool hangup) {
+    while (!game_ended) {
+        ssize_t n = local_link ? local_link->receive(in, hangup) : in.readFrom(client_socket);
+        if (n < 0 && errno == EAGAIN) return SERVER_OK;
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return SERVER_GONE;
+        
+        // One read may carry several messages, or only part of one
+        std::string_view message;
+        FrameBuffer::Status status = FrameBuffer::FRAME_INCOMPLETE;
+        while (!game_ended && (status = in.nextFrame(message)) == FrameBuffer::FRAME_OK) {
+            handleMessage(message);
         }
+        if (status == FrameBuffer::FRAME_ERROR) return SERVER_GARBLED;
+        if (local_link == nullptr) break;
+    }
+    return SERVER_OK;
+}
+
+void handleInput(std::string input) {
+    if (!input.empty() && input.back() == '\r') input.pop_back();
+    if (input.empty()) return;
+    
+    // Convert to uppercase
+    for (char& c : input) {
+        c = std::toupper(c);
+    }
+    
+    if (input == "EXIT" || input == "QUIT") {
+        game_ended = true;
+        return;
     }
     
-    return nullptr;
+    // Check if it's a valid answer
+    if (input.length() == 1 && (input[0] >= 'A' && input[0] <= 'D')) {
+        if (open_round == 0) {
+            printLine("Wala pang tanong na sasagutin.");
+            return;
+        }
+        sendMessage<AnswerSchema>(open_round, input[0]);
+        open_round = 0;   // one answer per QUESTION
+        
+        screen << "Naipadala na ang sagot: " << input << "\n";
+        screen << "Naghihintay sa iba pang mga manlalaro...\n";
+    }
+    else {
+        printLine("Hindi wastong sagot! Piliin lamang ang A, B, C, o D.");
+    }
 }
 
-void* send_answers(void* arg) {
-    std::string input;
-    int current_round = 1;
+// What has been typed and not yet handled. Read with read() rather than
+// std::cin, whose buffer would hide lines typed ahead from poll().
+std::string typed;
+
+// One read from the keyboard; false at end of input
+bool readTyped() {
+    char buffer[256];
+    ssize_t n;
+    while ((n = read(STDIN_FILENO, buffer, sizeof(buffer))) < 0 && errno == EINTR) {}
+    if (n <= 0) return false;
+    typed.append(buffer, n);
+    return true;
+}
+
+// The next whole line out of `typed`, without its newline
+bool nextLine(std::string& line) {
+    size_t end = typed.find('\n');
+    if (end == std::string::npos) return false;
+    line = typed.substr(0, end);
+    typed.erase(0, end + 1);
+    return true;
+}
+
+// Everything after the handshake, on this one thread: a poll() over the
+// server, the room's multicast group and, for a player, the keyboard, until
+// the game is over. Each turn's screens go out in one write.
+void runClient(bool keyboard) {
+    FrameBuffer in;
+    bool hangup = false;   // -u: the server closed the Unix socket
+    std::string line;
+    
+    while (!game_ended && keyboard && nextLine(line)) handleInput(line);
     
     while (!game_ended) {
-        std::getline(std::cin, input);
+        flushScreen();
         
-        if (game_ended) break;
-        
-        if (input.empty()) continue;
-        
-        // Convert to uppercase
-        for (char& c : input) {
-            c = std::toupper(c);
+        pollfd fds[4];
+        int count = 0;
+        if (local_link != nullptr) {
+            fds[count++] = {local_link->bell(), POLLIN, 0};
+            fds[count++] = {client_socket, POLLIN | POLLRDHUP, 0};
+        } else {
+            fds[count++] = {client_socket, POLLIN, 0};
         }
+        int server_fds = count;
+        int mcast_index = mcast != nullptr ? count++ : -1;
+        if (mcast_index >= 0) fds[mcast_index] = {mcast->descriptor(), POLLIN, 0};
+        int keyboard_index = keyboard ? count++ : -1;
+        if (keyboard_index >= 0) fds[keyboard_index] = {STDIN_FILENO, POLLIN, 0};
         
-        if (input == "EXIT" || input == "QUIT") {
-            game_ended = true;
+        if (poll(fds, count, -1) < 0) {
+            if (errno == EINTR) continue;
             break;
         }
         
-        // Check if it's a valid answer
-        if (input.length() == 1 && (input[0] >= 'A' && input[0] <= 'D')) {
-            // Send answer to server
-            std::string answer_msg = "ANSWER|" + std::to_string(current_round) + "|" + input;
-            send(client_socket, answer_msg.c_str(), answer_msg.length(), 0);
-            
-            pthread_mutex_lock(&output_mutex);
-            std::cout << "Naipadala na ang sagot: " << input << std::endl;
-            std::cout << "Naghihintay sa iba pang mga manlalaro..." << std::endl;
-            pthread_mutex_unlock(&output_mutex);
-            
-            current_round++;
+        if (local_link != nullptr && fds[1].revents != 0) hangup = true;   // drain what is left, then stop
+        bool server_ready = hangup;
+        for (int i = 0; i < server_fds; ++i) server_ready |= fds[i].revents != 0;
+        if (server_ready) {
+            ServerRead result = readServer(in, hangup);
+            if (result == SERVER_GONE && !game_ended && reconnect(in)) {
+                hangup = false;
+                continue;
+            }
+            if (result != SERVER_OK && !game_ended) {
+                printLine("Disconnected from server.");
+                game_ended = true;
+            }
         }
-        else {
-            safe_print("Hindi wastong sagot! Piliin lamang ang A, B, C, o D.");
+        
+        // Broadcasts from the room's group; handleMessage sees them in order
+        if (!game_ended && mcast_index >= 0 && fds[mcast_index].revents != 0) {
+            int first, last;
+            if (mcast->readSocket(first, last)) requestRepair(first, last);
+        }
+        
+        if (!game_ended && keyboard_index >= 0 && fds[keyboard_index].revents != 0) {
+            keyboard = readTyped();   // at end of input, play on without a keyboard
+            while (!game_ended && nextLine(line)) handleInput(line);
         }
     }
-    
-    return nullptr;
+    flushScreen();
 }
 
-int main() {
-    struct sockaddr_in server_addr;
+void usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [-s server_ip | -u local_socket_path] [-p port] [-w room_to_watch]\n"
+              << "       " << prog << " -b bots [-s server_ip] [-t threads] [-g games_per_bot]"
+              <<  " [-c accuracy] [-m think_min_ms] [-M think_max_ms] [-q question_bank] [-k churn]" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    LoadConfig load = {"", PORT, 0, 1, DEFAULT_BOT_GAMES, DEFAULT_BOT_ACCURACY,
+                       DEFAULT_THINK_MIN_MS, DEFAULT_THINK_MAX_MS, nullptr, 0};
     
-    // Create socket
-    client_socket = socket(AF_INET, SOCK_STREAM, 0);
-    if (client_socket == -1) {
-        std::cerr << "Socket creation failed." << std::endl;
-        return 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:u:b:t:g:c:m:M:q:k:p:w:h")) != -1) {
+        switch (opt) {
+            case 's': server_ip = optarg; break;
+            case 'u': local_path = optarg; break;
+            case 'b': load.bots = atoi(optarg); break;
+            case 't': load.threads = atoi(optarg); break;
+            case 'g': load.games = atoi(optarg); break;
+            case 'c': load.accuracy = atof(optarg); break;
+            case 'm': load.think_min_ms = atoi(optarg); break;
+            case 'M': load.think_max_ms = atoi(optarg); break;
+            case 'q': load.bank_path = optarg; break;
+            case 'k': load.churn = atof(optarg); break;
+            case 'p': server_port = load.port = atoi(optarg); break;
+            case 'w': watch_room = atoi(optarg); break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
     }
     
-    // Configure server address
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(PORT);
-    inet_pton(AF_INET, SERVER_IP, &server_addr.sin_addr);
+    // Load generator mode: no terminal, just bots
+    if (load.bots > 0) {
+        if (load.threads < 1 || load.games < 1 || load.accuracy < 0 || load.accuracy > 1 ||
+            load.think_min_ms < 0 || load.think_max_ms < load.think_min_ms || load.churn < 0 || load.churn > 1) {
+            usage(argv[0]);
+            return 1;
+        }
+        load.server_ip = server_ip ? server_ip : LOADGEN_SERVER_IP;
+        return runLoadGenerator(load);
+    }
+    if (!server_ip) server_ip = SERVER_IP;
     
-    // Connect to server
-    if (connect(client_socket, (struct sockaddr*)&server_addr, sizeof(server_addr)) == -1) {
-        std::cerr << "Connection failed. Make sure the server is running." << std::endl;
+    std::string error;
+    if (!connectToServer(error)) {
+        std::cerr << "Connection failed (" << error << "). Make sure the server is running." << std::endl;
         return 1;
     }
     
@@ -231,26 +583,34 @@ int main() {
     std::cout << "║              Network Client                  ║" << std::endl;
     std::cout << "╚══════════════════════════════════════════════╝" << std::endl;
     
-    std::cout << "\nNakaconnect sa server! Magbigay ng pangalan: ";
+    // A viewer only listens: no name, no answers
+    if (watch_room >= 0) {
+        sendMessage<WatchSchema>(watch_room);
+        std::cout << "\nNanonood ng laro sa room " << watch_room << "..." << std::endl;
+        runClient(false);
+        close(client_socket);
+        delete local_link;
+        return 0;
+    }
+    
+    std::cout << "\nNakaconnect sa server! Magbigay ng pangalan: " << std::flush;
     std::string name;
-    std::getline(std::cin, name);
+    while (!nextLine(name)) {
+        if (!readTyped()) {
+            name.swap(typed);   // no newline before the end of input
+            break;
+        }
+    }
     
     // Send name to server
-    send(client_socket, name.c_str(), name.length(), 0);
+    sendToServer(name);
     
     std::cout << "Naghihintay sa iba pang mga manlalaro..." << std::endl;
     
-    // Create threads for receiving and sending
-    pthread_t recv_thread, send_thread;
-    
-    pthread_create(&recv_thread, nullptr, receive_messages, nullptr);
-    pthread_create(&send_thread, nullptr, send_answers, nullptr);
-    
-    // Wait for threads to finish
-    pthread_join(recv_thread, nullptr);
-    pthread_join(send_thread, nullptr);
+    runClient(true);
     
     close(client_socket);
+    delete local_link;
     
     return 0;
 }
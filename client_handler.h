@@ -0,0 +1,95 @@
+#ifndef CLIENT_HANDLER_H
+#define CLIENT_HANDLER_H
+
+// The client's side of the protocol, decoding apart from what is done with
+// it: dispatchMessage finds a server message's type, parses it and hands it
+// to the matching callback. client.cpp puts it on the terminal;
+// bench_hot_paths times the decoding with callbacks that only read fields.
+
+#include <string_view>
+#include "protocol.h"
+#include "schema.h"
+
+// Callbacks get the message parsed, its groups (options, board entries)
+// left in msg.rest for them to walk. A message that does not parse is
+// dropped, except the two failures, whose reason may then be empty. The
+// raw ones (SESSION, MCAST_START, MULTICAST) are passed through whole.
+class ClientHandler {
+public:
+    virtual ~ClientHandler() {}
+    virtual void onWelcome(const Decoded<WelcomeSchema>&) {}
+    virtual void onQuestion(const Decoded<QuestionSchema>&) {}
+    virtual void onResult(const Decoded<ResultSchema>&) {}
+    virtual void onFinal(const Decoded<FinalSchema>&) {}
+    virtual void onWatchResult(const Decoded<WatchResultSchema>&) {}
+    virtual void onWatchFinal(const Decoded<WatchFinalSchema>&) {}
+    virtual void onWatchFailed(const Decoded<WatchFailedSchema>&) {}
+    virtual void onSession(std::string_view) {}
+    virtual void onState(const Decoded<StateSchema>&) {}
+    virtual void onResumeFailed(const Decoded<ResumeFailedSchema>&) {}
+    virtual void onMcastOffer(const Decoded<McastOfferSchema>&) {}
+    virtual void onMcastStart(std::string_view) {}
+    virtual void onMulticast(std::string_view) {}
+    virtual void onOther(std::string_view) {}   // a type the client does not know
+};
+
+inline void dispatchMessage(std::string_view message, ClientHandler& handler) {
+    std::string_view message_type = messageType(message);
+    
+    if (message_type == WelcomeSchema::type) {
+        Decoded<WelcomeSchema> msg;
+        if (msg.parse(message)) handler.onWelcome(msg);
+    }
+    else if (message_type == QuestionSchema::type) {
+        Decoded<QuestionSchema> msg;
+        if (msg.parse(message)) handler.onQuestion(msg);
+    }
+    else if (message_type == ResultSchema::type) {
+        Decoded<ResultSchema> msg;
+        if (msg.parse(message)) handler.onResult(msg);
+    }
+    else if (message_type == FinalSchema::type) {
+        Decoded<FinalSchema> msg;
+        if (msg.parse(message)) handler.onFinal(msg);
+    }
+    else if (message_type == WatchResultSchema::type) {
+        Decoded<WatchResultSchema> msg;
+        if (msg.parse(message)) handler.onWatchResult(msg);
+    }
+    else if (message_type == WatchFinalSchema::type) {
+        Decoded<WatchFinalSchema> msg;
+        if (msg.parse(message)) handler.onWatchFinal(msg);
+    }
+    else if (message_type == WatchFailedSchema::type) {
+        Decoded<WatchFailedSchema> msg;
+        msg.parse(message);
+        handler.onWatchFailed(msg);
+    }
+    else if (message_type == SessionSchema::type) {
+        handler.onSession(message);
+    }
+    else if (message_type == StateSchema::type) {
+        Decoded<StateSchema> msg;
+        if (msg.parse(message)) handler.onState(msg);
+    }
+    else if (message_type == ResumeFailedSchema::type) {
+        Decoded<ResumeFailedSchema> msg;
+        msg.parse(message);
+        handler.onResumeFailed(msg);
+    }
+    else if (message_type == McastOfferSchema::type) {
+        Decoded<McastOfferSchema> msg;
+        if (msg.parse(message)) handler.onMcastOffer(msg);
+    }
+    else if (message_type == McastStartSchema::type) {
+        handler.onMcastStart(message);
+    }
+    else if (message_type == MulticastSchema::type) {
+        handler.onMulticast(message);
+    }
+    else {
+        handler.onOther(message);
+    }
+}
+
+#endif
@@ -0,0 +1,1528 @@
+#ifndef GAME_H
+#define GAME_H
+
+// The game engine: rooms (TriviaServer), the workers that tick them and the
+// RoomManager that matches players into rooms and routes the reactor's
+// events to them. server.cpp puts it behind sockets, a journal or a trace
+// replay; bench_hot_paths drives a room directly.
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <atomic>
+#include <sstream>
+#include <iomanip>
+#include <random>
+#include <unordered_map>
+#include <cstring>
+#include <cstdint>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/eventfd.h>
+#include "protocol.h"
+#include "schema.h"
+#include "reactor.h"
+#include "timer_wheel.h"
+#include "question_bank.h"
+#include "leaderboard.h"
+#include "player_table.h"
+#include "mpsc_queue.h"
+#include "histogram.h"
+#include "metrics.h"
+#include "logger.h"
+#include "multicast.h"
+#include "journal.h"
+#include "trace.h"
+#include "spectator.h"
+
+#define MIN_PLAYERS 2
+#define DEFAULT_MAX_PLAYERS 3   // per room
+#define DEFAULT_ANSWER_TIMEOUT_MS 30000
+#define DEFAULT_ROUND_DELAY_MS 3000
+#define DEFAULT_LOBBY_TIMEOUT_MS 60000
+#define REAP_INTERVAL_MS 1000
+#define DEFAULT_ROUNDS 5
+#define LEADERBOARD_TOP_K 10   // players listed in RESULT and FINAL
+#define ROOM_QUEUE_CAPACITY 64  // pending events per room, a power of two
+#define ROOM_DRAIN_BATCH 32
+#define CORRECT_POINTS 10
+#define SPEED_BONUS_MAX 10        // extra points for an instant correct answer
+#define SPEED_BONUS_WINDOW_MS 10000   // bonus window when answers never time out
+#define MCAST_HEARTBEAT_MS 100
+#define MCAST_LINGER_MS 1000      // a finished multicast room waits this long for NACKs
+#define JOURNAL_RESUME_DELAY_MS 5000   // a recovered room waits this long for its players
+
+// Replaying a trace (-P) runs the game on a virtual clock that only moves
+// when the replay says so; otherwise it stays -1 and time is the real thing
+inline long long virtual_now_us = -1;
+
+inline long long nowUs() {
+    if (virtual_now_us >= 0) return virtual_now_us;
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+inline long long nowMs() {
+    return nowUs() / 1000;
+}
+
+// Messages are encoded (schema.h) into scratch space of the thread building
+// them, reactor or game worker, grown to the biggest message yet and then
+// reused. A message every player gets a copy of ends with a shared tail
+// (the leaderboard, say), encoded once into tail_buffer.
+inline thread_local std::string encode_buffer;
+inline thread_local std::string tail_buffer;
+
+// One message as a frame, valid until encode_buffer is next used
+template <class S, class... Args>
+std::string_view encodeMessage(const Args&... values) {
+    return encodeFrame(encode_buffer, [&](MessageWriter& w) { w.message<S>(values...); });
+}
+
+template <class S, class... Args>
+FramePtr messageFrame(const Args&... values) {
+    return shareFrame(encodeMessage<S>(values...));
+}
+
+// Phase timing, in milliseconds. A zero answer or lobby timeout means wait
+// for everyone, as the game originally did.
+struct GameConfig {
+    int answer_timeout_ms;
+    int round_delay_ms;
+    int lobby_timeout_ms;
+    int rounds;             // questions per game
+    int max_players;        // a full lobby starts its game
+};
+
+// Timings a game worker has collected since the last report, in
+// microseconds. Player time is measured from the QUESTION being queued to
+// the ANSWER being read off the socket; the rest is delay the server adds.
+struct LatencyStats {
+    std::vector<LatencyHistogram> answer;   // per round: player answer time
+    LatencyHistogram ingest;    // answer read -> applied by the game worker
+    LatencyHistogram fanout;    // queueing one QUESTION for the whole room
+    LatencyHistogram close;     // last answer read -> RESULT queued
+    uint64_t games;
+    
+    LatencyStats(int rounds) : answer(rounds), games(0) {}
+    
+    void merge(const LatencyStats& other) {
+        for (size_t r = 0; r < answer.size(); ++r) answer[r].merge(other.answer[r]);
+        ingest.merge(other.ingest);
+        fanout.merge(other.fanout);
+        close.merge(other.close);
+        games += other.games;
+    }
+    
+    void reset() {
+        for (auto& h : answer) h.reset();
+        ingest.reset();
+        fanout.reset();
+        close.reset();
+        games = 0;
+    }
+};
+
+// One room's answer times for one round, as sent in FINAL
+struct RoundTimes {
+    int answers;
+    long long p50_us;
+    long long p99_us;
+};
+
+// What the reactor threads tell a room. They never touch the room's state
+// directly: events go through the room's lock-free queue and the worker
+// applies them in batches.
+struct RoomEvent {
+    enum Type : uint8_t { ANSWER, LEAVE, NACK, MCAST_JOIN, RESUME };
+    Type type;
+    char choice;
+    int round;              // 0-based; for a NACK, the first sequence number
+    uint32_t slot;
+    Connection* conn;       // identity check only; the room holds a reference
+    long long recv_us;      // when the reactor read it off the socket
+    int last_seq = 0;       // NACK only
+    uint64_t secret = 0;    // RESUME only
+};
+
+struct GameWorker;
+
+// One game. Rooms no longer block a thread while they play: the owning
+// worker calls tick() when the room signals it (new events, a full lobby)
+// and onTimer() when the phase timer on its wheel runs out (answer
+// deadline, delay between rounds, lobby timeout).
+//
+// With a journal, a room logs a snapshot of itself when the game starts
+// and after every round, and each answer in between; recover() rebuilds
+// one from that, with every player detached until they RESUME.
+//
+// Player state belongs to the worker. The one exception is the lobby:
+// addPlayer runs on a reactor thread, so while the phase is LOBBY the
+// table is guarded by lobby_mutex, and the flip to QUESTION under that
+// mutex hands it over to the worker for good.
+class TriviaServer {
+public:
+    enum Phase { LOBBY, QUESTION, INTERMISSION, FINISHED };
+
+private:
+    int room_id;
+    PlayerTable players;        // a player's slot is also its leaderboard id
+    Leaderboard leaderboard;    // updated as scores change
+    std::vector<QuestionView> questions;   // drawn for this game, views into the bank
+    std::vector<uint32_t> question_ids;    // their bank indices, for the journal
+    std::vector<RoundTimes> round_times;
+    pthread_mutex_t lobby_mutex = PTHREAD_MUTEX_INITIALIZER;
+    MpscQueue<RoomEvent> events;
+    
+    std::atomic<Phase> phase;   // LOBBY -> QUESTION flips under lobby_mutex
+    int round;
+    size_t answered_count;      // answers in for the current round, against players.size()
+    long long last_answer_us;   // when the answer that completed the round landed
+    long long question_us;      // when the current QUESTION was queued
+    long long fanout_us;        // how long queueing it to everyone took
+    long long lobby_locked_us;  // when lobby_mutex was last taken
+    const GameConfig& config;
+    GameWorker* worker;
+    Timer phase_timer;          // lives on the worker's wheel
+    bool hung_up;               // disconnectAll has run
+    
+    // Multicast broadcasts, when the server has a group (nullptr otherwise).
+    // The window holds the last MCAST_WINDOW datagrams by seq % MCAST_WINDOW.
+    MulticastSender* mcast;
+    int mcast_seq;              // next sequence number
+    int mcast_members;          // players getting broadcasts by multicast
+    std::vector<std::string> mcast_window;
+    Timer heartbeat_timer;
+    
+    Journal* journal;           // nullptr: not journaling
+    uint32_t journal_segment;   // segment our last snapshot went to
+    bool recovered;             // rebuilt from the journal, not yet started
+    
+    // Where viewers get the broadcasts, after the players (nullptr: nobody
+    // may watch, e.g. in a replay)
+    std::shared_ptr<SpectatorChannel> spectators;
+    
+    // bench_hot_paths puts the scores back between runs of evaluateAnswers
+    friend struct BenchRoom;
+
+public:
+    // Connections still pointing at this room; it is only freed once the
+    // game is over and every one of them has gone away
+    std::atomic<int> attached;
+    
+    // Set while the room sits in its worker's ready list
+    std::atomic<bool> queued;
+    
+    TriviaServer(int id, const QuestionBank& bank, std::vector<uint32_t> ids, const GameConfig& cfg,
+                 GameWorker* w, MulticastSender* mc, Journal* j, SpectatorHub* hub)
+        : room_id(id), players((int)ids.size()), question_ids(std::move(ids)), round_times(question_ids.size()),
+          events(ROOM_QUEUE_CAPACITY), phase(LOBBY), round(0), answered_count(0),
+          last_answer_us(0), question_us(0), fanout_us(0), lobby_locked_us(0), config(cfg), worker(w),
+          hung_up(false), mcast(mc), mcast_seq(0), mcast_members(0), journal(j), journal_segment(0),
+          recovered(false), spectators(hub != nullptr ? hub->open(id) : nullptr), attached(0), queued(false) {
+        for (uint32_t q : question_ids) questions.push_back(bank.get(q));
+        phase_timer.callback = onTimerFired;
+        phase_timer.arg = this;
+        heartbeat_timer.callback = onHeartbeat;
+        heartbeat_timer.arg = this;
+        if (mcast != nullptr) mcast_window.resize(MCAST_WINDOW);
+    }
+    
+    int id() const { return room_id; }
+    Phase currentPhase() const { return phase; }
+    
+    // Players in the lobby so far
+    size_t waiting() {
+        lockLobby();
+        size_t count = players.size();
+        unlockLobby();
+        return count;
+    }
+    
+    // Queues the frame on the player's connection; never blocks
+    void sendToPlayer(uint32_t slot, const FramePtr& frame) {
+        if (!players.conn[slot]->send(frame)) {
+            LogEvent(LOG_WARN, "evicted").kv("room", room_id).kv("player", players.name(slot))
+                .kv("reason", "too far behind");
+        }
+    }
+    
+    // Multicast players get it from the room's group, everyone else over TCP
+    void broadcastToAll(std::string_view frame) {
+        long long start = nowUs();
+        if (mcast_members > 0) multicast(frame.substr(FRAME_HEADER_SIZE));
+        FramePtr shared = shareFrame(frame); // one copy for everyone
+        for (uint32_t slot = 0; slot < players.capacity(); ++slot) {
+            if (players.used(slot) && !players.multicast[slot]) sendToPlayer(slot, shared);
+        }
+        if (spectators) spectators->publish(shared);
+        metricTime(BROADCAST, nowUs() - start);
+    }
+    
+    // Give `body` the next sequence number and send it to the group. One
+    // too big for a datagram, or one the socket refused, goes to the
+    // multicast players over TCP instead, so their sequence has no hole.
+    void multicast(std::string_view body) {
+        int seq = mcast_seq++;
+        char envelope[64];
+        MessageWriter head(envelope, sizeof(envelope));
+        head.message<MulticastSchema>(room_id, seq);
+        std::string& datagram = mcast_window[seq % MCAST_WINDOW];
+        datagram.assign(head.payload()).append(1, '|').append(body);
+        
+        if (datagram.size() <= MCAST_MAX_DATAGRAM && mcast->send(room_id, datagram)) {
+            metricAdd(MCAST_DATAGRAMS);
+        } else {
+            FramePtr frame = makeFrame(datagram);
+            for (uint32_t slot = 0; slot < players.capacity(); ++slot) {
+                if (players.used(slot) && players.multicast[slot]) sendToPlayer(slot, frame);
+            }
+        }
+        armHeartbeat();
+    }
+    
+    // Worker thread, every MCAST_HEARTBEAT_MS while anyone listens: the last
+    // sequence number sent, so a receiver that lost the end of a burst asks
+    void heartbeat() {
+        if (mcast_members == 0 || mcast_seq == 0) return;
+        char datagram[64];
+        MessageWriter w(datagram, sizeof(datagram));
+        w.message<MulticastSchema>(room_id, mcast_seq - 1).message<HeartbeatSchema>();
+        mcast->send(room_id, w.payload());
+        armHeartbeat();
+    }
+    
+    static void onHeartbeat(Timer* t) {
+        static_cast<TriviaServer*>(t->arg)->heartbeat();
+    }
+    
+    // lobby_mutex, timed for the metrics endpoint
+    void lockLobby() {
+        long long start = nowUs();
+        pthread_mutex_lock(&lobby_mutex);
+        lobby_locked_us = nowUs();
+        metricTime(LOBBY_LOCK_WAIT, lobby_locked_us - start);
+    }
+    
+    void unlockLobby() {
+        long long held = nowUs() - lobby_locked_us;
+        pthread_mutex_unlock(&lobby_mutex);
+        metricTime(LOBBY_LOCK_HOLD, held);
+    }
+    
+    std::string_view encodeQuestion(const QuestionView& question, int round) {
+        return encodeFrame(encode_buffer, [&](MessageWriter& w) {
+            w.message<QuestionSchema>(round + 1, question.text);
+            for (int i = 0; i < question.option_count; ++i) w.group<OptionSchema>(question.options[i]);
+        });
+    }
+    
+    // Defined after GameWorker: queue this room for its worker and wake it,
+    // and (re)arm or cancel the phase timer on the worker's wheel
+    void notifyWorker();
+    void armTimer(int delay_ms);
+    void cancelTimer();
+    void armHeartbeat();
+    void cancelHeartbeat();
+    
+    // Also defined after GameWorker: fold timings into the worker's stats.
+    // recordRound summarizes the round just closed into round_times too.
+    void recordIngest(const long long* delays_us, size_t n);
+    void recordRound(long long close_us);
+    
+    void prepareRound(int r) {
+        round = r;
+        answered_count = 0;
+        
+        // Load this round's answers, counting any that arrived early.
+        // Those were sent before the question, so they are not timed.
+        for (uint32_t slot = 0; slot < players.capacity(); ++slot) {
+            players.answer[slot] = players.answerAt(slot, round);
+            players.answer_us[slot] = NO_ANSWER_TIME;
+            if (players.used(slot) && players.answer[slot] != NO_ANSWER) {
+                answered_count++;
+            }
+        }
+        if (answered_count >= players.size()) {
+            last_answer_us = nowUs();
+        }
+    }
+    
+    // O(1): applyAnswer and applyLeave keep answered_count up to date.
+    // Players who left no longer hold the round up.
+    bool allAnswered() {
+        return answered_count >= players.size();
+    }
+    
+    // Speed bonus window: the answer time when there is one
+    long long bonusWindowUs() const {
+        int ms = config.answer_timeout_ms > 0 ? config.answer_timeout_ms : SPEED_BONUS_WINDOW_MS;
+        return ms * 1000LL;
+    }
+    
+    void evaluateAnswers(int round) {
+        // Free slots hold NO_ANSWER, so they never match. A correct answer
+        // earns up to SPEED_BONUS_MAX more the sooner it came in; untimed
+        // ones (NO_ANSWER_TIME) get no bonus.
+        char correct_answer = questions[round].correct_answer;
+        long long window = bonusWindowUs();
+        uint32_t n = players.capacity();
+        const char* answer = players.answer.data();
+        const long long* answer_us = players.answer_us.data();
+        int* score = players.score.data();
+        int* correct = players.correct.data();
+        for (uint32_t slot = 0; slot < n; ++slot) {
+            int hit = answer[slot] == correct_answer;
+            long long left = std::max(0LL, window - answer_us[slot]);
+            score[slot] += hit * (CORRECT_POINTS + (int)((left * SPEED_BONUS_MAX + window - 1) / window));
+            correct[slot] += hit;
+        }
+        for (uint32_t slot = 0; slot < n; ++slot) {
+            if (answer[slot] == correct_answer) leaderboard.update(slot, score[slot]);
+        }
+    }
+    
+    // RESULT carries the top of the leaderboard, built once, after the
+    // recipient's own rank and result, so its size does not grow with the room
+    void sendRoundResults(int round) {
+        long long start = nowUs();
+        char correct_answer = questions[round].correct_answer;
+        std::vector<Leaderboard::Entry> top;
+        leaderboard.top(LEADERBOARD_TOP_K, top);
+        
+        std::string_view board = encodeFrame(tail_buffer, [&](MessageWriter& w) {
+            for (const auto& entry : top) {
+                char answer = players.answer[entry.id];
+                w.group<ResultEntrySchema>(players.name(entry.id), answer, answer == correct_answer,
+                                           players.score[entry.id]);
+            }
+        }).substr(FRAME_HEADER_SIZE);
+        int total = (int)leaderboard.size();
+        
+        // Multicast players share one MRESULT and pick out their own slot
+        if (mcast_members > 0) {
+            multicast(encodeFrame(encode_buffer, [&](MessageWriter& w) {
+                w.message<McastResultSchema>(round + 1, correct_answer, total, (int)players.capacity());
+                for (uint32_t slot = 0; slot < players.capacity(); ++slot) {
+                    char answer = players.used(slot) ? players.answer[slot] : NO_ANSWER;
+                    w.group<McastResultSlotSchema>(players.used(slot) ? leaderboard.rank(slot) : 0, answer,
+                                                   answer == correct_answer, players.score[slot]);
+                }
+                w.raw(board);
+            }).substr(FRAME_HEADER_SIZE));
+        }
+        
+        for (uint32_t slot = 0; slot < players.capacity(); ++slot) {
+            if (!players.used(slot) || players.multicast[slot]) continue;
+            char answer = players.answer[slot];
+            sendToPlayer(slot, shareFrame(encodeFrame(encode_buffer, [&](MessageWriter& w) {
+                w.message<ResultSchema>(round + 1, correct_answer, leaderboard.rank(slot), total, answer,
+                                        answer == correct_answer, players.score[slot]).raw(board);
+            })));
+        }
+        
+        // Viewers all get the same one: the board without anyone's own result
+        if (spectators) {
+            spectators->publish(shareFrame(encodeFrame(encode_buffer, [&](MessageWriter& w) {
+                w.message<WatchResultSchema>(round + 1, correct_answer, total).raw(board);
+            })));
+        }
+        metricTime(RESULTS_FANOUT, nowUs() - start);
+    }
+    
+    double accuracy(uint32_t slot) {
+        return (double)players.correct[slot] / questions.size() * 100;
+    }
+    
+    // -1 if the player never answered in time
+    int meanAnswerMs(uint32_t slot) {
+        return players.timed_answers[slot] > 0
+            ? (int)(players.total_answer_us[slot] / players.timed_answers[slot] / 1000) : -1;
+    }
+    
+    // Final standings straight off the leaderboard, no copy or sort. Like
+    // RESULT, each player gets the top K plus their own rank, and everyone
+    // gets the room's answer times per round.
+    void sendFinalResults() {
+        long long start = nowUs();
+        std::vector<Leaderboard::Entry> top;
+        leaderboard.top(LEADERBOARD_TOP_K, top);
+        
+        // Per-round timings, then the board
+        std::string_view tail = encodeFrame(tail_buffer, [&](MessageWriter& w) {
+            for (const auto& t : round_times) {
+                w.group<RoundTimingSchema>(t.answers, (int)(t.p50_us / 1000), (int)(t.p99_us / 1000));
+            }
+            for (const auto& entry : top) {
+                w.group<FinalEntrySchema>(entry.rank, players.name(entry.id), players.score[entry.id],
+                                          accuracy(entry.id));
+            }
+        }).substr(FRAME_HEADER_SIZE);
+        int total = (int)leaderboard.size();
+        int rounds = (int)round_times.size();
+        
+        if (mcast_members > 0) {
+            multicast(encodeFrame(encode_buffer, [&](MessageWriter& w) {
+                w.message<McastFinalSchema>(total, (int)players.capacity());
+                for (uint32_t slot = 0; slot < players.capacity(); ++slot) {
+                    if (!players.used(slot)) {
+                        w.group<McastFinalSlotSchema>(0, 0, 0.0, -1);
+                        continue;
+                    }
+                    w.group<McastFinalSlotSchema>(leaderboard.rank(slot), players.score[slot], accuracy(slot),
+                                                  meanAnswerMs(slot));
+                }
+                w.group<RoundCountSchema>(rounds).raw(tail);
+            }).substr(FRAME_HEADER_SIZE));
+        }
+        
+        for (uint32_t slot = 0; slot < players.capacity(); ++slot) {
+            if (!players.used(slot) || players.multicast[slot]) continue;
+            sendToPlayer(slot, shareFrame(encodeFrame(encode_buffer, [&](MessageWriter& w) {
+                w.message<FinalSchema>(leaderboard.rank(slot), total, players.score[slot], accuracy(slot),
+                                       meanAnswerMs(slot), rounds).raw(tail);
+            })));
+        }
+        if (spectators) {
+            spectators->publish(shareFrame(encodeFrame(encode_buffer, [&](MessageWriter& w) {
+                w.message<WatchFinalSchema>(total, rounds).raw(tail);
+            })));
+        }
+        metricTime(RESULTS_FANOUT, nowUs() - start);
+    }
+    
+    // Worker thread. Answers to rounds that have not started yet are kept
+    // and counted when the round opens. A malformed ANSWER can name any
+    // round, negative ones included.
+    void applyAnswer(const RoomEvent& ev) {
+        if (ev.round < 0 || ev.round >= (int)questions.size() || ev.choice < 'A' ||
+            ev.choice >= 'A' + questions[ev.round].option_count) {
+            return; // Invalid answer
+        }
+        if (ev.slot >= players.capacity() || players.conn[ev.slot] != ev.conn) {
+            return; // left since
+        }
+        
+        bool first = players.answerAt(ev.slot, ev.round) == NO_ANSWER;
+        players.setAnswer(ev.slot, ev.round, ev.choice);
+        if (ev.round == round && phase == QUESTION) {
+            players.answer[ev.slot] = ev.choice;
+            players.answer_us[ev.slot] = std::max(0LL, ev.recv_us - question_us);
+        }
+        LogEvent(LOG_INFO, "answered").kv("room", room_id).kv("round", ev.round + 1)
+            .kv("player", players.name(ev.slot)).kv("choice", ev.choice);
+        if (phase != LOBBY) {   // the game's first snapshot has lobby answers
+            JournalRecord record(JOURNAL_ANSWER, room_id);
+            record.u32(ev.slot).i32(ev.round).u8(ev.choice);
+            journalAppend(record);
+        }
+        
+        if (first && ev.round == round && phase == QUESTION && ++answered_count == players.size()) {
+            last_answer_us = ev.recv_us;
+        }
+    }
+    
+    // Worker thread: the connection is gone, drop the reference the room
+    // held on it. A player who leaves the lobby is gone for good; once the
+    // game is on the slot is only detached, keeping its score for a RESUME,
+    // and the rounds stop waiting on it.
+    void applyLeave(const RoomEvent& ev) {
+        if (ev.slot >= players.capacity() || players.conn[ev.slot] != ev.conn) return;
+        
+        bool answered = dropConnection(ev.slot);
+        if (phase == LOBBY) {
+            players.remove(ev.slot);   // not worth holding before the game
+            leaderboard.erase(ev.slot);
+        } else if (phase != FINISHED) {
+            LogEvent(LOG_INFO, "dropped").kv("room", room_id).kv("round", round + 1)
+                .kv("player", players.name(ev.slot));
+        }
+        
+        // Everyone still here may already have answered
+        if (phase == QUESTION && !answered && answered_count >= players.size()) {
+            last_answer_us = nowUs();
+        }
+    }
+    
+    // Detach the slot from its connection and let the connection go.
+    // Returns whether the player had answered the open round.
+    bool dropConnection(uint32_t slot) {
+        Connection* conn = players.conn[slot];
+        bool answered = players.answer[slot] != NO_ANSWER;
+        if (phase == QUESTION && answered) {
+            answered_count--;
+        }
+        if (players.multicast[slot]) mcast_members--;
+        players.detach(slot);
+        conn->release();
+        return answered;
+    }
+    
+    // Worker thread: a player is back on a new connection, which the
+    // manager has attached to this room. If the old connection is still
+    // here (the server has not noticed it die yet) the new one takes over.
+    void applyResume(const RoomEvent& ev) {
+        uint32_t slot = ev.slot;
+        bool known = slot < players.capacity() && players.secret(slot) == ev.secret;
+        if (phase == LOBBY || phase == FINISHED || !known) {
+            ev.conn->send(messageFrame<ResumeFailedSchema>(phase == FINISHED ? "game over" : "no such player"));
+            ev.conn->closeWhenFlushed();
+            ev.conn->release();
+            LogEvent(LOG_INFO, "resume_failed").kv("room", room_id).kv("slot", slot);
+            return;
+        }
+        if (players.used(slot)) {
+            players.conn[slot]->closeWhenFlushed();   // before our reference on it goes
+            dropConnection(slot);
+        }
+        
+        players.attach(slot, ev.conn);
+        if (phase == QUESTION && players.answer[slot] != NO_ANSWER) answered_count++;
+        sendToPlayer(slot, shareFrame(encodeState(slot)));
+        offerMulticast(ev.conn, slot);
+        metricAdd(RESUMES);
+        LogEvent(LOG_INFO, "resumed").kv("room", room_id).kv("round", round + 1).kv("player", players.name(slot))
+            .kv("delay_us", nowUs() - ev.recv_us);
+    }
+    
+    // STATE: the round, the player's own answer and standing, the top of
+    // the leaderboard and, while the round is open, its question
+    std::string_view encodeState(uint32_t slot) {
+        std::vector<Leaderboard::Entry> top;
+        leaderboard.top(LEADERBOARD_TOP_K, top);
+        bool open = phase == QUESTION;
+        
+        return encodeFrame(encode_buffer, [&](MessageWriter& w) {
+            w.message<StateSchema>(round + 1, (int)questions.size(), open ? 1 : 0,
+                                   round >= 0 ? players.answerAt(slot, round) : NO_ANSWER, leaderboard.rank(slot),
+                                   (int)leaderboard.size(), players.score[slot], (int)top.size());
+            for (const auto& entry : top) {
+                w.group<StateEntrySchema>(players.name(entry.id), players.score[entry.id]);
+            }
+            if (open) {
+                const QuestionView& question = questions[round];
+                w.group<StateQuestionSchema>(question.text);
+                for (int i = 0; i < question.option_count; ++i) w.group<OptionSchema>(question.options[i]);
+            }
+        });
+    }
+    
+    // Worker thread: the player has joined the room's group. Broadcasts from
+    // the next sequence number on reach it by multicast only.
+    void applyMcastJoin(const RoomEvent& ev) {
+        if (mcast == nullptr || ev.slot >= players.capacity() || players.conn[ev.slot] != ev.conn ||
+            players.multicast[ev.slot]) {
+            return;
+        }
+        players.multicast[ev.slot] = 1;
+        mcast_members++;
+        sendToPlayer(ev.slot, messageFrame<McastStartSchema>(mcast_seq));
+        LogEvent(LOG_DEBUG, "multicast_joined").kv("room", room_id).kv("player", players.name(ev.slot))
+            .kv("seq", mcast_seq);
+    }
+    
+    // Worker thread: resend what a player missed over its TCP connection, or
+    // tell it LOST for what has already left the window
+    void applyNack(const RoomEvent& ev) {
+        if (ev.slot >= players.capacity() || players.conn[ev.slot] != ev.conn || !players.multicast[ev.slot]) {
+            return;
+        }
+        int last = std::min(ev.last_seq, mcast_seq - 1);
+        int first = std::max(ev.round, last - MCAST_REORDER_MAX);
+        for (int seq = first; seq <= last; ++seq) {
+            if (seq >= mcast_seq - MCAST_WINDOW) {
+                sendToPlayer(ev.slot, makeFrame(mcast_window[seq % MCAST_WINDOW]));
+                metricAdd(MCAST_REPAIRS);
+            } else {
+                sendToPlayer(ev.slot, shareFrame(encodeFrame(encode_buffer, [&](MessageWriter& w) {
+                    w.message<MulticastSchema>(room_id, seq).message<LostSchema>();
+                })));
+            }
+        }
+        LogEvent(LOG_DEBUG, "repaired").kv("room", room_id).kv("player", players.name(ev.slot))
+            .kv("first", first).kv("last", last);
+    }
+    
+    // Worker thread: apply everything the reactors have queued
+    void drainEvents() {
+        bool lobby = phase == LOBBY;   // only the worker moves it on from LOBBY
+        if (lobby) lockLobby();
+        
+        RoomEvent batch[ROOM_DRAIN_BATCH];
+        long long delays[ROOM_DRAIN_BATCH];
+        size_t n;
+        while ((n = events.drain(batch, ROOM_DRAIN_BATCH)) > 0) {
+            long long now = nowUs();
+            size_t answers = 0;
+            for (size_t i = 0; i < n; ++i) {
+                switch (batch[i].type) {
+                    case RoomEvent::ANSWER:
+                        delays[answers++] = now - batch[i].recv_us;
+                        applyAnswer(batch[i]);
+                        break;
+                    case RoomEvent::LEAVE:
+                        applyLeave(batch[i]);
+                        break;
+                    case RoomEvent::NACK:
+                        applyNack(batch[i]);
+                        break;
+                    case RoomEvent::MCAST_JOIN:
+                        applyMcastJoin(batch[i]);
+                        break;
+                    case RoomEvent::RESUME:
+                        applyResume(batch[i]);
+                        break;
+                }
+            }
+            if (answers > 0) recordIngest(delays, answers);
+        }
+        
+        if (lobby) unlockLobby();
+    }
+    
+    // Reactor threads: queue an event and make sure the worker will look
+    void post(const RoomEvent& ev) {
+        if (ev.type != RoomEvent::ANSWER) {
+            // Leaves, resumes and multicast control must get through; the
+            // worker is never waiting on us
+            while (!events.tryPush(ev)) {
+                notifyWorker();
+                sched_yield();
+            }
+        } else if (!events.tryPush(ev)) {
+            metricAdd(ANSWERS_DROPPED);
+            return; // flooded with answers; at most one per round counts anyway
+        }
+        notifyWorker();
+    }
+    
+    // Worker thread, once the game is on. The first record a room writes
+    // to a new journal segment is a snapshot, so older ones can go.
+    void journalAppend(JournalRecord& record) {
+        if (journal == nullptr) return;
+        if (journal_segment != journal->segment()) journalSnapshot();
+        journal->append(record.finish());
+    }
+    
+    // Everything needed to carry on from the last closed round: the
+    // questions, the round times so far and every slot, detached or not
+    void journalSnapshot() {
+        if (journal == nullptr) return;
+        journal_segment = journal->segment();
+        int closed = phase == QUESTION ? round : round + 1;
+        int rounds = (int)questions.size();
+        
+        JournalRecord record(JOURNAL_SNAPSHOT, room_id);
+        record.i32(closed).i32(rounds);
+        for (uint32_t q : question_ids) record.u32(q);
+        for (int r = 0; r < closed; ++r) {
+            record.i32(round_times[r].answers).i64(round_times[r].p50_us).i64(round_times[r].p99_us);
+        }
+        record.u32(players.capacity());
+        for (uint32_t slot = 0; slot < players.capacity(); ++slot) {
+            record.u64(players.secret(slot));
+            if (players.secret(slot) == 0) continue;   // free
+            record.str(players.name(slot)).i32(players.score[slot]).i32(players.correct[slot])
+                .i64(players.total_answer_us[slot]).i32(players.timed_answers[slot]);
+            for (int r = 0; r < rounds; ++r) record.u8(players.answerAt(slot, r));
+        }
+        journal->append(record.finish());
+    }
+    
+    // Rebuild a room from its last snapshot and the answers logged after
+    // it. Every player starts out detached; the room waits
+    // JOURNAL_RESUME_DELAY_MS for them and then opens the next round, where
+    // answers they had already sent count, untimed. nullptr when the
+    // snapshot does not fit this server (bank or rounds changed).
+    static TriviaServer* recover(int id, const ReplayedRoom& saved, const QuestionBank& bank,
+                                 const GameConfig& cfg, GameWorker* w, MulticastSender* mc, Journal* j,
+                                 SpectatorHub* hub) {
+        JournalCursor c(saved.snapshot);
+        int closed = c.i32();
+        int rounds = c.i32();
+        if (!c.ok || rounds != cfg.rounds || closed < 0 || closed >= rounds) return nullptr;
+        std::vector<uint32_t> ids(rounds);
+        for (uint32_t& q : ids) {
+            q = c.u32();
+            if (q >= bank.size()) return nullptr;
+        }
+        
+        TriviaServer* room = new TriviaServer(id, bank, std::move(ids), cfg, w, mc, j, hub);
+        if (!room->restore(c, closed)) {
+            delete room;
+            return nullptr;
+        }
+        for (const std::string& answer : saved.answers) {
+            JournalCursor a(answer);
+            uint32_t slot = a.u32();
+            int r = a.i32();
+            char choice = (char)a.u8();
+            if (a.ok && slot < room->players.capacity() && room->players.secret(slot) != 0 && r >= 0 &&
+                r < rounds) {
+                room->players.setAnswer(slot, r, choice);
+            }
+        }
+        return room;
+    }
+    
+    bool restore(JournalCursor& c, int closed) {
+        for (int r = 0; r < closed; ++r) {
+            round_times[r].answers = c.i32();
+            round_times[r].p50_us = c.i64();
+            round_times[r].p99_us = c.i64();
+        }
+        uint32_t capacity = c.u32();
+        if (!c.ok || capacity > (uint32_t)config.max_players) return false;
+        for (uint32_t slot = 0; slot < capacity; ++slot) {
+            uint64_t secret = c.u64();
+            if (secret == 0) continue;
+            std::string_view name = c.str();
+            players.restore(slot, name, secret);
+            players.score[slot] = c.i32();
+            players.correct[slot] = c.i32();
+            players.total_answer_us[slot] = c.i64();
+            players.timed_answers[slot] = c.i32();
+            for (int r = 0; r < (int)questions.size(); ++r) players.setAnswer(slot, r, (char)c.u8());
+            leaderboard.insert(slot, players.score[slot]);
+        }
+        if (!c.ok) return false;
+        phase = INTERMISSION;   // the next round starts once players are back
+        round = closed - 1;
+        recovered = true;
+        return true;
+    }
+    
+    void startGame() {
+        LogEvent(LOG_INFO, "game_started").kv("room", room_id).kv("players", players.size());
+        journalSnapshot();
+        
+        // Send welcome message
+        broadcastToAll(encodeMessage<WelcomeSchema>("Game starting! Get ready for trivia questions!"));
+        startRound(0);
+    }
+    
+    void startRound(int r) {
+        prepareRound(r);
+        phase = QUESTION;
+        
+        // Send question to all players; answer times count from here
+        question_us = nowUs();
+        broadcastToAll(encodeQuestion(questions[round], round));
+        fanout_us = nowUs() - question_us;
+        LogEvent(LOG_INFO, "round_started").kv("room", room_id).kv("round", round + 1)
+            .kv("fanout_us", fanout_us);
+        
+        if (config.answer_timeout_ms > 0) {
+            armTimer(config.answer_timeout_ms);
+        }
+        if (allAnswered()) notifyWorker();   // nobody here to wait for, or all answered early
+    }
+    
+    // Players who have not answered by now keep '?' and score nothing
+    void closeRound(bool timed_out) {
+        cancelTimer();
+        metricTime(ROUND_WAIT, nowUs() - question_us);
+        
+        evaluateAnswers(round);
+        sendRoundResults(round);
+        
+        long long gap_us = timed_out ? -1 : nowUs() - last_answer_us;
+        recordRound(gap_us);
+        const RoundTimes& times = round_times[round];
+        
+        LogEvent closed(LOG_INFO, "round_closed");
+        closed.kv("room", room_id).kv("round", round + 1).kv("reason", timed_out ? "time_up" : "all_answered");
+        if (!timed_out) closed.kv("close_us", gap_us);
+        closed.kv("answers", times.answers).kv("p50_ms", times.p50_us / 1000).kv("p99_ms", times.p99_us / 1000);
+        
+        if (round + 1 < (int)questions.size()) {
+            phase = INTERMISSION;
+            journalSnapshot();
+            armTimer(config.round_delay_ms);
+        } else {
+            sendFinalResults();
+            if (spectators) spectators->close();   // viewers go once FINAL is out
+            phase = FINISHED;
+            JournalRecord end(JOURNAL_END, room_id);
+            journalAppend(end);
+            LogEvent(LOG_INFO, "game_finished").kv("room", room_id).kv("players", players.size());
+            if (mcast_members > 0) {
+                armTimer(MCAST_LINGER_MS);   // still serving NACKs for FINAL
+            } else {
+                disconnectAll();
+                armTimer(REAP_INTERVAL_MS);
+            }
+        }
+    }
+    
+    // Hang up on every player once their queued output is written, so the
+    // reactors release the connections like the old single-game process did
+    // when it exited
+    void disconnectAll() {
+        hung_up = true;
+        for (uint32_t slot = 0; slot < players.capacity(); ++slot) {
+            if (players.used(slot)) players.conn[slot]->closeWhenFlushed();
+        }
+    }
+    
+    // Start the game once the lobby holds at least `needed` players. The
+    // phase flips under lobby_mutex so nobody can join past that point.
+    bool closeLobby(size_t needed) {
+        lockLobby();
+        bool ready = phase == LOBBY && players.size() >= needed;
+        if (ready) phase = QUESTION;
+        unlockLobby();
+        return ready;
+    }
+    
+    // Called on the worker once it takes the room over. A recovered room
+    // snapshots itself into the new journal segment straight away.
+    void attachToWorker() {
+        if (recovered) {
+            journalSnapshot();
+            armTimer(JOURNAL_RESUME_DELAY_MS);
+        } else if (config.lobby_timeout_ms > 0) {
+            armTimer(config.lobby_timeout_ms);
+        }
+    }
+    
+    // The room signalled its worker: new events or a full lobby. Only the
+    // owning worker thread calls this.
+    void tick() {
+        drainEvents();
+        switch (phase) {
+            case LOBBY:
+                if (closeLobby(config.max_players)) {
+                    cancelTimer();
+                    startGame();
+                }
+                break;
+            case QUESTION:
+                if (allAnswered()) closeRound(false);
+                break;
+            default:
+                break;
+        }
+    }
+    
+    // The phase timer ran out. Returns true when the room is done for good
+    // and may be freed.
+    bool onTimer() {
+        drainEvents();   // answers that made it before the deadline count
+        switch (phase) {
+            case LOBBY:
+                // Lobby timeout: play with whoever showed up, if enough did
+                if (closeLobby(MIN_PLAYERS)) {
+                    startGame();
+                } else {
+                    armTimer(config.lobby_timeout_ms);
+                }
+                break;
+            case QUESTION:
+                closeRound(true);
+                break;
+            case INTERMISSION:
+                startRound(round + 1);
+                break;
+            case FINISHED:
+                if (!hung_up) disconnectAll();
+                // Every connection posted its leave before detaching, and
+                // drainEvents above has applied them all
+                if (attached.load() == 0 && !queued) {
+                    drainEvents();
+                    cancelHeartbeat();
+                    return true;
+                }
+                armTimer(REAP_INTERVAL_MS);
+                break;
+        }
+        return false;
+    }
+    
+    static void onTimerFired(Timer* t);
+    
+    // Returns false once the lobby has filled up or the game has started.
+    // secret is what the player needs to RESUME later; never 0.
+    bool addPlayer(Connection* conn, const std::string& name, uint64_t secret) {
+        lockLobby();
+        if (phase != LOBBY || players.size() >= (size_t)config.max_players) {
+            unlockLobby();
+            return false;
+        }
+        
+        uint32_t slot = players.add(conn, name, secret);
+        leaderboard.insert(slot, 0);
+        conn->retain();   // released by applyLeave
+        
+        bool full = players.size() >= (size_t)config.max_players;
+        size_t count = players.size();
+        unlockLobby();
+        
+        LogEvent(LOG_INFO, "joined").kv("room", room_id).kv("player", name).kv("players", count)
+            .kv("capacity", config.max_players);
+        
+        conn->send(messageFrame<SessionSchema>(room_id, (int)slot, secret));
+        offerMulticast(conn, slot);
+        
+        if (full) notifyWorker();
+        return true;
+    }
+    
+    // Broadcasts stay on TCP until the player says it has joined the
+    // group. Same-host players already get them through shared memory.
+    void offerMulticast(Connection* conn, uint32_t slot) {
+        if (mcast != nullptr && conn->shm == nullptr) {
+            conn->send(messageFrame<McastOfferSchema>(mcast->groupName(room_id), mcast->port(), room_id, (int)slot));
+        }
+    }
+    
+    // Reactor thread: a returning player, already attached to this room by
+    // the manager. The worker checks the secret and hands the slot over.
+    void resumePlayer(Connection* conn, const Decoded<ResumeSchema>& resume) {
+        conn->slot = resume.get<ResumeSchema::SLOT>();
+        conn->retain();   // released by applyLeave, or by applyResume if refused
+        post(RoomEvent{RoomEvent::RESUME, 0, 0, conn->slot, conn, conn->recv_us, 0,
+                       resume.get<ResumeSchema::SECRET>()});
+    }
+    
+    // Reactor thread, from onClose
+    void removePlayer(Connection* conn) {
+        post(RoomEvent{RoomEvent::LEAVE, 0, 0, conn->slot, conn, nowUs()});
+    }
+    
+    void processAnswer(Connection* conn, std::string_view message) {
+        Decoded<AnswerSchema> answer;
+        if (answer.parse(message) && answer.complete()) {
+            post(RoomEvent{RoomEvent::ANSWER, answer.get<AnswerSchema::CHOICE>(),
+                           answer.get<AnswerSchema::ROUND>() - 1, // Convert to 0-based
+                           conn->slot, conn, conn->recv_us});
+        }
+    }
+    
+    void processNack(Connection* conn, std::string_view message) {
+        Decoded<NackSchema> nack;
+        if (mcast == nullptr || !nack.parse(message)) return;
+        int first = nack.get<NackSchema::FIRST>();
+        int last = nack.get<NackSchema::LAST>();
+        if (first >= 0 && first <= last) {
+            post(RoomEvent{RoomEvent::NACK, 0, first, conn->slot, conn, conn->recv_us, last});
+        }
+    }
+    
+    void processMcastJoin(Connection* conn) {
+        if (mcast != nullptr) post(RoomEvent{RoomEvent::MCAST_JOIN, 0, 0, conn->slot, conn, conn->recv_us});
+    }
+};
+
+// Rooms by id, so a returning player can find theirs. The manager lists a
+// room when it opens it; the worker unlists it just before freeing it, and
+// only if nobody attached to it in the meantime.
+struct RoomDirectory {
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    std::unordered_map<int, TriviaServer*> rooms;
+    
+    void list(TriviaServer* room) {
+        pthread_mutex_lock(&mutex);
+        rooms.emplace(room->id(), room);
+        pthread_mutex_unlock(&mutex);
+    }
+    
+    // The room with a reference for the caller, or nullptr
+    TriviaServer* attach(int id) {
+        pthread_mutex_lock(&mutex);
+        auto it = rooms.find(id);
+        TriviaServer* room = it == rooms.end() ? nullptr : it->second;
+        if (room != nullptr) room->attached.fetch_add(1);
+        pthread_mutex_unlock(&mutex);
+        return room;
+    }
+    
+    bool unlist(TriviaServer* room) {
+        pthread_mutex_lock(&mutex);
+        bool idle = room->attached.load() == 0;
+        if (idle) rooms.erase(room->id());
+        pthread_mutex_unlock(&mutex);
+        return idle;
+    }
+};
+
+// A game worker owns a shard of rooms and is the only thread that ticks them.
+// It sleeps on an eventfd until the next timer on its wheel is due: rooms
+// that have something to do right now put themselves on the ready list and
+// write to the eventfd, so a round closes the moment its last answer lands,
+// and every timed phase of every room is a timer on the wheel.
+struct GameWorker {
+    pthread_t thread;
+    int wake_fd;
+    TimerWheel wheel;                   // owned by the worker thread only
+    pthread_mutex_t inbox_mutex = PTHREAD_MUTEX_INITIALIZER;
+    std::vector<TriviaServer*> inbox;   // rooms handed over by the manager
+    std::vector<TriviaServer*> ready;   // rooms that asked to be ticked
+    std::vector<TriviaServer*> arrived, woken;   // runOnce's, swapped with the two above
+    std::atomic<int>* active_rooms;
+    RoomDirectory* directory;
+    
+    // Filled by this worker's rooms, emptied by the report
+    pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+    LatencyStats stats;
+    LatencyHistogram scratch;           // one room's round at a time
+    
+    GameWorker(int rounds)
+        : wake_fd(eventfd(0, EFD_CLOEXEC)), wheel(nowMs()), active_rooms(nullptr), directory(nullptr), stats(rounds) {}
+    
+    void addRoom(TriviaServer* room) {
+        pthread_mutex_lock(&inbox_mutex);
+        inbox.push_back(room);
+        pthread_mutex_unlock(&inbox_mutex);
+    }
+    
+    void wake(TriviaServer* room) {
+        if (room->queued.exchange(true)) return; // already on the list
+        pthread_mutex_lock(&inbox_mutex);
+        ready.push_back(room);
+        pthread_mutex_unlock(&inbox_mutex);
+        
+        if (wake_fd < 0) return;   // driven by a replay, nobody sleeps
+        uint64_t one = 1;
+        write(wake_fd, &one, sizeof(one));
+    }
+    
+    void run() {
+        while (true) {
+            pollfd pfd = {wake_fd, POLLIN, 0};
+            if (poll(&pfd, 1, (int)wheel.msUntilNext()) > 0) {
+                uint64_t count;
+                read(wake_fd, &count, sizeof(count));
+            }
+            runOnce();
+        }
+    }
+    
+    // Take over new rooms, fire due timers, tick rooms that asked for it.
+    // What the rooms send meanwhile is written at the end, each player's
+    // frames in one go, however many rooms or phases they came from.
+    void runOnce() {
+        SendBatch writes;
+        pthread_mutex_lock(&inbox_mutex);
+        arrived.swap(inbox);
+        woken.swap(ready);
+        pthread_mutex_unlock(&inbox_mutex);
+        
+        wheel.advance(nowMs());
+        
+        for (TriviaServer* room : arrived) {
+            room->attachToWorker();
+        }
+        arrived.clear();
+        
+        for (TriviaServer* room : woken) {
+            room->queued = false;
+            room->tick();
+        }
+        woken.clear();
+    }
+    
+    // Replay: no thread of its own; whoever drives it calls runOnce
+    void drive() {
+        close(wake_fd);
+        wake_fd = -1;
+    }
+    
+    static void* threadMain(void* arg) {
+        static_cast<GameWorker*>(arg)->run();
+        return nullptr;
+    }
+};
+
+inline void TriviaServer::notifyWorker() {
+    worker->wake(this);
+}
+
+inline void TriviaServer::armTimer(int delay_ms) {
+    worker->wheel.schedule(&phase_timer, nowMs() + delay_ms);
+}
+
+inline void TriviaServer::cancelTimer() {
+    worker->wheel.cancel(&phase_timer);
+}
+
+inline void TriviaServer::armHeartbeat() {
+    if (!heartbeat_timer.armed()) worker->wheel.schedule(&heartbeat_timer, nowMs() + MCAST_HEARTBEAT_MS);
+}
+
+inline void TriviaServer::cancelHeartbeat() {
+    worker->wheel.cancel(&heartbeat_timer);
+}
+
+inline void TriviaServer::recordIngest(const long long* delays_us, size_t n) {
+    pthread_mutex_lock(&worker->stats_mutex);
+    for (size_t i = 0; i < n; ++i) worker->stats.ingest.record(delays_us[i]);
+    pthread_mutex_unlock(&worker->stats_mutex);
+}
+
+// close_us is -1 when the round timed out instead of filling up
+inline void TriviaServer::recordRound(long long close_us) {
+    LatencyHistogram& times = worker->scratch;
+    times.reset();
+    for (uint32_t slot = 0; slot < players.capacity(); ++slot) {
+        if (players.answer_us[slot] == NO_ANSWER_TIME) continue;   // free slots never have one
+        times.record(players.answer_us[slot]);
+        players.total_answer_us[slot] += players.answer_us[slot];
+        players.timed_answers[slot]++;
+    }
+    round_times[round] = RoundTimes{(int)times.count(), (long long)times.percentile(50),
+                                    (long long)times.percentile(99)};
+    
+    pthread_mutex_lock(&worker->stats_mutex);
+    worker->stats.answer[round].merge(times);
+    worker->stats.fanout.record(fanout_us);
+    if (close_us >= 0) worker->stats.close.record(close_us);
+    if (round == (int)questions.size() - 1) worker->stats.games++;
+    pthread_mutex_unlock(&worker->stats_mutex);
+}
+
+inline void TriviaServer::onTimerFired(Timer* t) {
+    TriviaServer* room = static_cast<TriviaServer*>(t->arg);
+    metricTime(TIMER_LAG, nowUs() - (long long)t->expires * 1000);
+    if (!room->onTimer()) return;
+    if (room->worker->directory->unlist(room)) {
+        room->worker->active_rooms->fetch_sub(1);
+        delete room;
+    } else {
+        room->armTimer(REAP_INTERVAL_MS);   // a RESUME got in; it will be refused
+    }
+}
+
+// Matches joining players into rooms and routes connection events to the
+// room the connection belongs to. Rooms are spread round-robin over a fixed
+// pool of workers, and each room has its own event queue. Every new room
+// draws its own questions from the shared, read-only bank.
+class RoomManager : public ReactorHandler {
+private:
+    QuestionBank bank;
+    std::vector<QuestionBank::Range> eligible;   // questions matching the filters
+    std::mt19937_64 rng;                         // used under rooms_mutex
+    GameConfig config;
+    std::vector<GameWorker*> workers;
+    pthread_mutex_t rooms_mutex = PTHREAD_MUTEX_INITIALIZER;
+    TriviaServer* lobby;   // room currently accepting players; we hold an attached reference
+    int next_room_id;
+    RoomDirectory directory;
+    std::atomic<int> active_rooms;
+    MulticastSender* mcast;   // nullptr: broadcasts over TCP only
+    Journal* journal;         // nullptr: no crash recovery
+    TraceRecorder* recorder;  // nullptr: not recording
+    SpectatorHub* spectators; // nullptr: rooms cannot be watched
+    uint64_t io_reported[4];  // IO_READS .. IO_WAITS at the last report
+
+public:
+    // The seed decides every game's questions and session secrets; a trace
+    // records it so a replay deals the same ones
+    RoomManager(int worker_threads, const GameConfig& cfg, uint64_t seed, MulticastSender* mc, Journal* j,
+                TraceRecorder* rec, SpectatorHub* hub)
+        : rng(seed), config(cfg), lobby(nullptr), next_room_id(1), active_rooms(0), mcast(mc), journal(j),
+          recorder(rec), spectators(hub), io_reported{} {
+        metricGauge("trivia_rooms_active", "Rooms in the lobby or playing", &active_rooms);
+        for (int i = 0; i < worker_threads; ++i) {
+            GameWorker* worker = new GameWorker(cfg.rounds);
+            worker->active_rooms = &active_rooms;
+            worker->directory = &directory;
+            workers.push_back(worker);
+        }
+    }
+    
+    // Map the bank at `path`, or use the built-in Filipino questions when
+    // there is none, and pick the questions games may draw from
+    bool loadQuestions(const char* path, const char* category, int difficulty, std::string& error) {
+        bool ok = path ? bank.open(path, error) : bank.load(buildBank(builtinQuestions()), error);
+        if (!ok) return false;
+        
+        int category_id = -1;
+        if (category) {
+            category_id = bank.findCategory(category);
+            if (category_id < 0) {
+                error = std::string("no category \"") + category + "\" in the question bank";
+                return false;
+            }
+        }
+        eligible = bank.select(category_id, difficulty);
+        
+        uint64_t count = 0;
+        for (const auto& range : eligible) count += range.count;
+        if (count == 0) {
+            error = "no questions match the category and difficulty filters";
+            return false;
+        }
+        std::cout << "Question bank: " << bank.size() << " questions, " << count << " eligible" << std::endl;
+        return true;
+    }
+    
+    uint32_t bankSize() const { return bank.size(); }
+    
+    // Before the workers start: reopen the games the journal says were
+    // still running. One that no longer fits (other rounds setting) is
+    // ended in the journal instead, so its old segments can go.
+    int recover(const JournalReplay& replay) {
+        int restored = 0;
+        for (const auto& entry : replay.rooms) {
+            int id = entry.first;
+            GameWorker* worker = workers[id % workers.size()];
+            TriviaServer* room = TriviaServer::recover(id, entry.second, bank, config, worker, mcast, journal,
+                                                       spectators);
+            next_room_id = std::max(next_room_id, id + 1);
+            if (room == nullptr) {
+                JournalRecord end(JOURNAL_END, id);
+                journal->append(end.finish());
+                LogEvent(LOG_WARN, "recovery_skipped").kv("room", id);
+                continue;
+            }
+            directory.list(room);
+            worker->addRoom(room);
+            active_rooms.fetch_add(1);
+            restored++;
+        }
+        return restored;
+    }
+    
+    static std::vector<Question> builtinQuestions() {
+        return {
+            Question(
+                "Sino ang pambansang bayani ng Pilipinas?",
+                {"A) Andres Bonifacio", "B) Jose Rizal", "C) Lapu-Lapu", "D) Emilio Aguinaldo"},
+                'B', "Pilipinas"
+            ),
+            Question(
+                "Ano ang tawag sa pinakamataas na bundok sa Pilipinas?",
+                {"A) Bundok Banahaw", "B) Bundok Mayon", "C) Bundok Apo", "D) Bundok Makiling"},
+                'C', "Pilipinas"
+            ),
+            Question(
+                "Ilang pulo ang bumubuo sa Pilipinas?",
+                {"A) 7,107", "B) 7,641", "C) 8,000", "D) 6,500"},
+                'B', "Pilipinas"
+            ),
+            Question(
+                "Ano ang pangunahing wika ng Pilipinas?",
+                {"A) Cebuano", "B) Ilocano", "C) Filipino", "D) Hiligaynon"},
+                'C', "Pilipinas"
+            ),
+            Question(
+                "Sino ang unang Pangulo ng Pilipinas?",
+                {"A) Jose Rizal", "B) Emilio Aguinaldo", "C) Manuel Quezon", "D) Andres Bonifacio"},
+                'B', "Pilipinas"
+            )
+        };
+    }
+    
+    void startWorkers() {
+        for (GameWorker* worker : workers) {
+            pthread_create(&worker->thread, nullptr, GameWorker::threadMain, worker);
+        }
+    }
+    
+    void joinWorkers() {
+        for (GameWorker* worker : workers) {
+            pthread_join(worker->thread, nullptr);
+        }
+    }
+    
+    // Replay: run every worker from the calling thread instead of their own
+    void driveWorkers() {
+        for (GameWorker* worker : workers) worker->drive();
+    }
+    
+    void runWorkersOnce() {
+        for (GameWorker* worker : workers) worker->runOnce();
+    }
+    
+    // Until the earliest worker's next timer (or wheel cascade), -1 if none
+    long msUntilNextTimer() const {
+        long next = -1;
+        for (GameWorker* worker : workers) {
+            long ms = worker->wheel.msUntilNext();
+            if (ms >= 0 && (next < 0 || ms < next)) next = ms;
+        }
+        return next;
+    }
+    
+    // Any game not over yet? The room we hold as the lobby only goes away
+    // once the next one opens, so it does not count once it is done or
+    // while nobody has started it
+    bool gamesRunning() const {
+        TriviaServer::Phase phase = lobby != nullptr ? lobby->currentPhase() : TriviaServer::LOBBY;
+        int held = lobby != nullptr && (phase == TriviaServer::LOBBY || phase == TriviaServer::FINISHED) ? 1 : 0;
+        return active_rooms.load() > held;
+    }
+    
+    // Draining (router.h): no game left that will finish by itself. A lobby
+    // too empty to ever start does not count; its players are hung up.
+    bool drained() {
+        pthread_mutex_lock(&rooms_mutex);
+        size_t waiting = lobby != nullptr && lobby->currentPhase() == TriviaServer::LOBBY ? lobby->waiting() : 0;
+        pthread_mutex_unlock(&rooms_mutex);
+        bool startable = waiting >= MIN_PLAYERS && config.lobby_timeout_ms > 0;
+        return !startable && !gamesRunning();
+    }
+    
+    int activeRooms() const { return active_rooms.load(); }
+    
+    // Behind a router, room ids come from our slot's block. Before the
+    // reactors start; recovered games keep theirs.
+    int nextRoomId() const { return next_room_id; }
+    void setFirstRoomId(int id) { next_room_id = std::max(next_room_id, id); }
+    
+    // Every worker's timings since the last call
+    LatencyStats takeStats() {
+        LatencyStats total(config.rounds);
+        for (GameWorker* worker : workers) {
+            pthread_mutex_lock(&worker->stats_mutex);
+            total.merge(worker->stats);
+            worker->stats.reset();
+            pthread_mutex_unlock(&worker->stats_mutex);
+        }
+        return total;
+    }
+    
+    // Collect every worker's timings since the last report and print them:
+    // answer times per round, then the delay the server itself adds
+    void printReport(int interval_s) {
+        LatencyStats total = takeStats();
+        if (total.games == 0 && total.ingest.count() == 0) return; // idle
+        
+        // Formatted aside and written at once, so the table does not get
+        // interleaved with what the log writer thread is printing
+        std::stringstream ss;
+        ss << "\n=== Latency, last " << interval_s << " s: " << total.games << " game(s) finished, "
+           << active_rooms.load() << " room(s) open ===\n";
+        ss << std::setw(22) << "" << std::setw(10) << "count" << std::setw(10) << "p50"
+           << std::setw(10) << "p90" << std::setw(10) << "p99" << std::setw(10) << "p999"
+           << std::setw(10) << "max" << "\n";
+        for (int r = 0; r < config.rounds; ++r) {
+            printRow(ss, "answer round " + std::to_string(r + 1) + " ms", total.answer[r], 1000);
+        }
+        printRow(ss, "ingest us", total.ingest, 1);
+        printRow(ss, "question fan-out us", total.fanout, 1);
+        printRow(ss, "last answer->RESULT us", total.close, 1);
+        
+        // System calls on client sockets, per room per round
+        static const MetricCounter io[4] = {IO_READS, IO_WRITES, IO_URING_ENTERS, IO_WAITS};
+        double calls[4];
+        for (int i = 0; i < 4; ++i) {
+            uint64_t now = metricTotal(io[i]);
+            calls[i] = (double)(now - io_reported[i]) / std::max<uint64_t>(1, total.fanout.count());
+            io_reported[i] = now;
+        }
+        ss << std::fixed << std::setprecision(1) << "I/O system calls per round: "
+           << calls[0] + calls[1] + calls[2] + calls[3] << " (read " << calls[0] << ", write " << calls[1]
+           << ", io_uring_enter " << calls[2] << ", epoll_wait " << calls[3] << ")\n";
+        std::cout << ss.str() << std::flush;
+    }
+    
+    static void printRow(std::ostream& out, const std::string& label, const LatencyHistogram& h, uint64_t unit) {
+        out << std::setw(22) << std::left << label << std::right << std::setw(10) << h.count()
+            << std::setw(10) << h.percentile(50) / unit << std::setw(10) << h.percentile(90) / unit
+            << std::setw(10) << h.percentile(99) / unit << std::setw(10) << h.percentile(99.9) / unit
+            << std::setw(10) << h.max() / unit << "\n";
+    }
+    
+    // Put the player in the open lobby, opening a new room when it is full
+    TriviaServer* assignRoom(Connection* conn, const std::string& name) {
+        pthread_mutex_lock(&rooms_mutex);
+        
+        uint64_t secret = rng() | 1;
+        if (lobby == nullptr || !lobby->addPlayer(conn, name, secret)) {
+            // Until now the old lobby could not be freed, even with its game over
+            if (lobby != nullptr) lobby->attached.fetch_sub(1);
+            int id = next_room_id++;
+            GameWorker* worker = workers[id % workers.size()];
+            std::vector<uint32_t> questions;
+            bank.sampleIds(eligible, config.rounds, rng, questions);
+            lobby = new TriviaServer(id, bank, std::move(questions), config, worker, mcast, journal, spectators);
+            directory.list(lobby);
+            worker->addRoom(lobby);
+            lobby->attached.fetch_add(1);
+            lobby->addPlayer(conn, name, secret);
+            active_rooms.fetch_add(1);
+        }
+        
+        TriviaServer* room = lobby;
+        room->attached.fetch_add(1);
+        
+        pthread_mutex_unlock(&rooms_mutex);
+        return room;
+    }
+    
+    // Hand a returning player's connection to their room, or turn it away
+    TriviaServer* resumeRoom(Connection* conn, const Decoded<ResumeSchema>& resume) {
+        TriviaServer* room = directory.attach(resume.get<ResumeSchema::ROOM>());
+        if (room == nullptr) {
+            conn->send(messageFrame<ResumeFailedSchema>("no such game"));
+            conn->closeWhenFlushed();
+            return nullptr;
+        }
+        room->resumePlayer(conn, resume);
+        return room;
+    }
+    
+    // A viewer: from here on the hub has the connection
+    void watchRoom(Connection* conn, int room) {
+        if (spectators == nullptr || !spectators->subscribe(conn, room)) {
+            conn->send(messageFrame<WatchFailedSchema>(spectators == nullptr ? "spectators off" : "no such game"));
+            conn->closeWhenFlushed();
+        }
+    }
+    
+    // Reactor callbacks: the first message on a connection is the player
+    // name, a RESUME or a WATCH; everything after it is an answer or
+    // multicast control. Viewers have nothing more to say.
+    void onMessage(Connection* conn, std::string_view message) override {
+        if (recorder != nullptr) recorder->message(conn, conn->recv_us, message);
+        if (!conn->named) {
+            conn->named = true;
+            Decoded<ResumeSchema> resume;
+            Decoded<WatchSchema> watch;
+            if (resume.parse(message) && resume.complete() && resume.get<ResumeSchema::SLOT>() >= 0 &&
+                resume.get<ResumeSchema::SECRET>() != 0) {
+                conn->context = resumeRoom(conn, resume);
+            } else if (watch.parse(message) && watch.complete()) {
+                watchRoom(conn, watch.get<WatchSchema::ROOM>());
+            } else {
+                conn->context = assignRoom(conn, textField(clipName(message)));
+            }
+            return;
+        }
+        
+        // Turned away, on its way out, or a viewer
+        if (conn->context == nullptr || conn->context == spectators) return;
+        TriviaServer* room = static_cast<TriviaServer*>(conn->context);
+        std::string_view type = messageType(message);
+        if (type == NackSchema::type) {
+            room->processNack(conn, message);
+        } else if (type == McastOkSchema::type) {
+            room->processMcastJoin(conn);
+        } else {
+            room->processAnswer(conn, message);
+        }
+    }
+    
+    void onClose(Connection* conn) override {
+        if (recorder != nullptr) recorder->hangup(conn, nowUs());
+        if (spectators != nullptr && conn->context == spectators) {
+            spectators->unsubscribe(conn);
+            return;
+        }
+        TriviaServer* room = static_cast<TriviaServer*>(conn->context);
+        if (room != nullptr) {
+            room->removePlayer(conn);
+            room->attached.fetch_sub(1); // the room may be freed after this
+        }
+    }
+};
+
+#endif
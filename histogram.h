@@ -0,0 +1,90 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+// Log-linear latency histogram in the spirit of HdrHistogram. Values are
+// binned by power of two and every power of two is split into 32 linear
+// sub-buckets, so any value from 1 us to hours is kept to within about 3%
+// in a fixed 15 KB, recording is a couple of instructions, and histograms
+// from several threads merge by adding counts.
+
+#include <cstdint>
+#include <cstring>
+
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_SUB (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS (HISTOGRAM_SUB + (64 - HISTOGRAM_SUB_BITS) * HISTOGRAM_SUB)
+
+class LatencyHistogram {
+private:
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t total;
+    uint64_t sum;
+    uint64_t min_value;
+    uint64_t max_value;
+
+    static int bucketOf(uint64_t v) {
+        if (v < HISTOGRAM_SUB) return (int)v;
+        int msb = 63 - __builtin_clzll(v);
+        int shift = msb - HISTOGRAM_SUB_BITS;
+        int sub = (int)(v >> shift) - HISTOGRAM_SUB;
+        return HISTOGRAM_SUB + shift * HISTOGRAM_SUB + sub;
+    }
+
+    // Highest value that lands in bucket b
+    static uint64_t bucketTop(int b) {
+        if (b < HISTOGRAM_SUB) return (uint64_t)b;
+        int shift = (b - HISTOGRAM_SUB) / HISTOGRAM_SUB;
+        uint64_t sub = (uint64_t)((b - HISTOGRAM_SUB) % HISTOGRAM_SUB);
+        return ((HISTOGRAM_SUB + sub + 1) << shift) - 1;
+    }
+
+public:
+    LatencyHistogram() { reset(); }
+
+    void reset() {
+        memset(counts, 0, sizeof(counts));
+        total = 0;
+        sum = 0;
+        min_value = UINT64_MAX;
+        max_value = 0;
+    }
+
+    void record(uint64_t value) {
+        counts[bucketOf(value)]++;
+        total++;
+        sum += value;
+        if (value < min_value) min_value = value;
+        if (value > max_value) max_value = value;
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (int b = 0; b < HISTOGRAM_BUCKETS; ++b) counts[b] += other.counts[b];
+        total += other.total;
+        sum += other.sum;
+        if (other.min_value < min_value) min_value = other.min_value;
+        if (other.max_value > max_value) max_value = other.max_value;
+    }
+
+    uint64_t count() const { return total; }
+    uint64_t min() const { return total ? min_value : 0; }
+    uint64_t max() const { return max_value; }
+    double mean() const { return total ? (double)sum / total : 0; }
+
+    // Value at or below which `percent` of the samples fall
+    uint64_t percentile(double percent) const {
+        if (total == 0) return 0;
+        uint64_t target = (uint64_t)(percent / 100.0 * total + 0.5);
+        if (target < 1) target = 1;
+        uint64_t seen = 0;
+        for (int b = 0; b < HISTOGRAM_BUCKETS; ++b) {
+            seen += counts[b];
+            if (seen >= target) {
+                uint64_t top = bucketTop(b);
+                return top < max_value ? top : max_value;
+            }
+        }
+        return max_value;
+    }
+};
+
+#endif
@@ -0,0 +1,572 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+// Crash-safe game journal. Rooms append what they would need to carry on
+// after a crash: a snapshot of the room when the game starts and after every
+// round (roster, scores, answers so far), each answer as it is applied, and
+// an end marker once FINAL has gone out. After a restart the server replays
+// the journal, rebuilds every unfinished room and lets its players RESUME.
+//
+// Appending copies the record into a shared buffer under a mutex. A
+// committer thread swaps the buffer out, writes it and fdatasyncs, so one
+// sync covers every record that arrived while the previous one ran (group
+// commit): the cost per answer stays a memcpy however slow the disk is, and
+// a crash loses at most the records of the sync in flight.
+//
+// The journal is a directory of numbered segments. Once a segment passes
+// JOURNAL_SEGMENT_BYTES the committer starts the next one; every live room
+// writes a fresh snapshot into it at its next append, and as soon as all of
+// them have (or have ended), the older segments are deleted. A room that
+// goes a whole segment without appending (a lobby nobody joins) would keep
+// them forever, so at the next rollover the committer copies its latest
+// snapshot and the answers after it forward itself: no segment outlives
+// the one after it by more than a rollover. A snapshot is
+// the whole of a room's state, so replay only needs the latest one per room
+// and the answers after it.
+//
+// Segment file: JournalHeader, then records. A record is uint32_t payload
+// length, uint32_t CRC-32 of the payload, then the payload: uint8_t type,
+// int32_t room, fields (little-endian). Replay stops reading a segment at
+// the first record that is short or fails its CRC, i.e. a torn write.
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "metrics.h"
+
+#define JOURNAL_MAGIC "TRIVJL1"
+#define JOURNAL_VERSION 1
+#ifndef JOURNAL_SEGMENT_BYTES
+#define JOURNAL_SEGMENT_BYTES (64LL * 1024 * 1024)
+#endif
+#define JOURNAL_RECORD_HEADER 8
+#define JOURNAL_MAX_RECORD (1 << 20)
+
+enum JournalType : uint8_t {
+    JOURNAL_SNAPSHOT,   // a room's whole state; replaces anything earlier
+    JOURNAL_ANSWER,     // slot, round, choice, answer time
+    JOURNAL_END,        // game over, nothing to recover
+};
+
+struct JournalHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t bank_questions;   // question ids only mean something with the same bank
+};
+
+inline long long journalNowUs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+struct JournalCrcTable {
+    uint32_t entries[256];
+    
+    JournalCrcTable() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            entries[i] = c;
+        }
+    }
+};
+
+inline uint32_t journalCrc(const char* data, size_t len) {
+    static const JournalCrcTable table;
+    uint32_t crc = 0xffffffffu;
+    for (size_t i = 0; i < len; ++i) crc = table.entries[(crc ^ (uint8_t)data[i]) & 0xff] ^ (crc >> 8);
+    return crc ^ 0xffffffffu;
+}
+
+// Builds one record, header included
+class JournalRecord {
+private:
+    std::string bytes;
+
+public:
+    JournalRecord(JournalType type, int room) {
+        bytes.resize(JOURNAL_RECORD_HEADER);
+        u8(type);
+        i32(room);
+    }
+    
+    JournalRecord& u8(uint8_t v) { return raw(&v, sizeof(v)); }
+    JournalRecord& i32(int32_t v) { return raw(&v, sizeof(v)); }
+    JournalRecord& u32(uint32_t v) { return raw(&v, sizeof(v)); }
+    JournalRecord& i64(int64_t v) { return raw(&v, sizeof(v)); }
+    JournalRecord& u64(uint64_t v) { return raw(&v, sizeof(v)); }
+    
+    JournalRecord& str(std::string_view s) {
+        uint16_t len = (uint16_t)std::min<size_t>(s.size(), 0xffff);
+        raw(&len, sizeof(len));
+        bytes.append(s.data(), len);
+        return *this;
+    }
+    
+    JournalRecord& raw(const void* p, size_t n) {
+        bytes.append((const char*)p, n);
+        return *this;
+    }
+    
+    // Fill in the length and CRC; the record is ready to append
+    std::string_view finish() {
+        uint32_t len = (uint32_t)(bytes.size() - JOURNAL_RECORD_HEADER);
+        uint32_t crc = journalCrc(bytes.data() + JOURNAL_RECORD_HEADER, len);
+        memcpy(&bytes[0], &len, sizeof(len));
+        memcpy(&bytes[4], &crc, sizeof(crc));
+        return bytes;
+    }
+};
+
+// Reads a record's fields back; any read past the end clears ok
+class JournalCursor {
+private:
+    std::string_view rest;
+
+public:
+    bool ok;
+    
+    JournalCursor(std::string_view payload) : rest(payload), ok(true) {}
+    
+    uint8_t u8() { return get<uint8_t>(); }
+    int32_t i32() { return get<int32_t>(); }
+    uint32_t u32() { return get<uint32_t>(); }
+    int64_t i64() { return get<int64_t>(); }
+    uint64_t u64() { return get<uint64_t>(); }
+    
+    std::string_view str() {
+        uint16_t len = get<uint16_t>();
+        return bytes(len);
+    }
+    
+    std::string_view bytes(size_t n) {
+        if (!ok || rest.size() < n) {
+            ok = false;
+            return std::string_view();
+        }
+        std::string_view out = rest.substr(0, n);
+        rest.remove_prefix(n);
+        return out;
+    }
+
+private:
+    template <class T>
+    T get() {
+        T v{};
+        std::string_view b = bytes(sizeof(T));
+        if (ok) memcpy(&v, b.data(), sizeof(T));
+        return v;
+    }
+};
+
+inline std::string journalSegmentPath(const std::string& dir, uint32_t segment) {
+    char name[32];
+    snprintf(name, sizeof(name), "/journal-%06u.log", segment);
+    return dir + name;
+}
+
+// Segment numbers present in `dir`, oldest first
+inline std::vector<uint32_t> journalSegments(const std::string& dir) {
+    std::vector<uint32_t> segments;
+    DIR* d = opendir(dir.c_str());
+    if (d == nullptr) return segments;
+    while (dirent* entry = readdir(d)) {
+        unsigned n;
+        char tail;
+        if (sscanf(entry->d_name, "journal-%u.lo%c", &n, &tail) == 2 && tail == 'g') segments.push_back(n);
+    }
+    closedir(d);
+    std::sort(segments.begin(), segments.end());
+    return segments;
+}
+
+// What replay found for one unfinished room: its latest snapshot and the
+// answers logged after it, payloads without the record header
+struct ReplayedRoom {
+    std::string snapshot;
+    std::vector<std::string> answers;
+};
+
+// Reads every segment in order and keeps, per room, what recovery needs
+struct JournalReplay {
+    std::map<int, ReplayedRoom> rooms;
+    std::vector<uint32_t> segments;   // found, oldest first
+    uint64_t records = 0;
+    uint64_t bytes = 0;
+    int torn = 0;                     // segments that ended in a bad record
+    
+    bool run(const std::string& dir, uint32_t bank_questions, std::string& error) {
+        segments = journalSegments(dir);
+        for (uint32_t segment : segments) {
+            std::string path = journalSegmentPath(dir, segment);
+            std::string data;
+            if (!readFile(path, data)) {
+                error = "cannot read " + path + ": " + strerror(errno);
+                return false;
+            }
+            bytes += data.size();
+            
+            JournalHeader header;
+            if (data.size() < sizeof(header)) {
+                torn++;   // died while creating it
+                continue;
+            }
+            memcpy(&header, data.data(), sizeof(header));
+            if (memcmp(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0 || header.version != JOURNAL_VERSION) {
+                error = path + ": not a journal segment";
+                return false;
+            }
+            if (header.bank_questions != bank_questions) {
+                error = path + ": written with a different question bank";
+                return false;
+            }
+            if (!replaySegment(std::string_view(data).substr(sizeof(header)))) torn++;
+        }
+        return true;
+    }
+
+private:
+    static bool readFile(const std::string& path, std::string& out) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) < 0) {
+            close(fd);
+            return false;
+        }
+        out.resize(st.st_size);
+        size_t done = 0;
+        while (done < out.size()) {
+            ssize_t n = read(fd, &out[done], out.size() - done);
+            if (n <= 0) break;
+            done += n;
+        }
+        out.resize(done);
+        close(fd);
+        return true;
+    }
+    
+    // False when the segment ends in a torn record
+    bool replaySegment(std::string_view data) {
+        while (!data.empty()) {
+            uint32_t len, crc;
+            if (data.size() < JOURNAL_RECORD_HEADER) return false;
+            memcpy(&len, data.data(), sizeof(len));
+            memcpy(&crc, data.data() + 4, sizeof(crc));
+            if (len > JOURNAL_MAX_RECORD || data.size() - JOURNAL_RECORD_HEADER < len) return false;
+            std::string_view payload = data.substr(JOURNAL_RECORD_HEADER, len);
+            if (journalCrc(payload.data(), len) != crc) return false;
+            data.remove_prefix(JOURNAL_RECORD_HEADER + len);
+            records++;
+            
+            JournalCursor c(payload);
+            JournalType type = (JournalType)c.u8();
+            int room = c.i32();
+            if (!c.ok) return false;
+            payload.remove_prefix(5);
+            
+            if (type == JOURNAL_SNAPSHOT) {
+                ReplayedRoom& r = rooms[room];
+                r.snapshot.assign(payload);
+                r.answers.clear();
+            } else if (type == JOURNAL_ANSWER) {
+                auto it = rooms.find(room);
+                if (it != rooms.end()) it->second.answers.emplace_back(payload);
+            } else if (type == JOURNAL_END) {
+                rooms.erase(room);
+            }
+        }
+        return true;
+    }
+};
+
+class Journal {
+private:
+    std::string dir;
+    uint32_t bank_questions;
+    int fd;
+    long long segment_bytes;
+    std::atomic<uint32_t> current;   // segment being written
+    uint32_t oldest;                 // oldest segment still on disk
+    
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+    pthread_cond_t synced = PTHREAD_COND_INITIALIZER;
+    std::string pending;             // appended since the last swap
+    uint64_t appended;               // records appended, ever
+    uint64_t durable;                // records on disk, ever
+    bool running;
+    bool failed;                     // a write or sync failed; nothing more is journaled
+    pthread_t thread;
+    
+    // Committer only: rooms that have a snapshot somewhere and have not
+    // ended, each with its latest snapshot and the answers after it as
+    // whole records, and those of them still owing one to the current segment
+    std::unordered_map<int, std::string> live;
+    std::unordered_set<int> carried;
+    std::string batch;
+
+public:
+    uint64_t commits = 0;            // committer only; read after stop()
+    
+    Journal() : bank_questions(0), fd(-1), segment_bytes(0), current(0), oldest(0), appended(0), durable(0),
+                running(false), failed(false) {}
+    
+    ~Journal() {
+        stop();
+        if (fd >= 0) close(fd);
+    }
+    
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+    
+    // Start a new segment after whatever `replay` found in `dir` (created
+    // if missing). The rooms replay kept count as live until they write
+    // their first snapshot here.
+    bool open(const char* path, uint32_t bank, const JournalReplay& replay, std::string& error) {
+        dir = path;
+        bank_questions = bank;
+        if (mkdir(path, 0755) < 0 && errno != EEXIST) {
+            error = std::string("mkdir ") + path + ": " + strerror(errno);
+            return false;
+        }
+        oldest = replay.segments.empty() ? 1 : replay.segments.front();
+        current = replay.segments.empty() ? 1 : replay.segments.back() + 1;
+        for (const auto& room : replay.rooms) {
+            std::string& records = live[room.first];
+            const ReplayedRoom& saved = room.second;
+            records = JournalRecord(JOURNAL_SNAPSHOT, room.first).raw(saved.snapshot.data(), saved.snapshot.size()).finish();
+            for (const std::string& answer : saved.answers)
+                records += JournalRecord(JOURNAL_ANSWER, room.first).raw(answer.data(), answer.size()).finish();
+            carried.insert(room.first);
+        }
+        if (!openSegment(error)) return false;
+        if (carried.empty()) dropOldSegments();
+        return true;
+    }
+    
+    uint32_t segment() const { return current.load(std::memory_order_relaxed); }
+    
+    // Any thread. Returns the record's sequence number for waitDurable.
+    // Once the journal has failed, records are dropped.
+    uint64_t append(std::string_view record) {
+        pthread_mutex_lock(&mutex);
+        if (failed) {
+            uint64_t seq = ++appended;
+            pthread_mutex_unlock(&mutex);
+            return seq;
+        }
+        bool was_empty = pending.empty();
+        pending.append(record);
+        uint64_t seq = ++appended;
+        if (was_empty) pthread_cond_signal(&wake);
+        pthread_mutex_unlock(&mutex);
+        return seq;
+    }
+    
+    // Block until record `seq` is on disk. The server never waits; this is
+    // for callers that must not acknowledge before that, like the bench.
+    // False if it never will be: the journal failed, or was stopped.
+    bool waitDurable(uint64_t seq) {
+        pthread_mutex_lock(&mutex);
+        while (durable < seq && running && !failed) pthread_cond_wait(&synced, &mutex);
+        bool done = durable >= seq;
+        pthread_mutex_unlock(&mutex);
+        return done;
+    }
+    
+    void start() {
+        running = true;
+        pthread_create(&thread, nullptr, threadMain, this);
+    }
+    
+    // Commit whatever is pending and stop the committer
+    void stop() {
+        pthread_mutex_lock(&mutex);
+        bool was_running = running;
+        running = false;
+        pthread_cond_signal(&wake);
+        pthread_mutex_unlock(&mutex);
+        if (was_running) pthread_join(thread, nullptr);
+    }
+
+private:
+    bool openSegment(std::string& error) {
+        std::string path = journalSegmentPath(dir, current);
+        int next = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+        if (next < 0) {
+            error = "cannot create " + path + ": " + strerror(errno);
+            return false;
+        }
+        JournalHeader header{};
+        memcpy(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+        header.version = JOURNAL_VERSION;
+        header.bank_questions = bank_questions;
+        if (write(next, &header, sizeof(header)) != (ssize_t)sizeof(header) || fdatasync(next) < 0) {
+            error = "cannot write " + path + ": " + strerror(errno);
+            close(next);
+            return false;
+        }
+        syncDirectory();
+        if (fd >= 0) close(fd);
+        fd = next;
+        segment_bytes = sizeof(header);
+        return true;
+    }
+    
+    // A new or deleted segment is only durable once the directory is
+    void syncDirectory() {
+        int d = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (d < 0) return;
+        fsync(d);
+        close(d);
+    }
+    
+    void dropOldSegments() {
+        uint32_t now = current;
+        if (oldest >= now) return;
+        for (uint32_t s = oldest; s < now; ++s) unlink(journalSegmentPath(dir, s).c_str());
+        oldest = now;
+        syncDirectory();
+    }
+    
+    // Follow which rooms are live and which have moved to this segment
+    void track(std::string_view data) {
+        while (data.size() >= JOURNAL_RECORD_HEADER + 5) {
+            uint32_t len;
+            memcpy(&len, data.data(), sizeof(len));
+            JournalType type = (JournalType)data[JOURNAL_RECORD_HEADER];
+            int32_t room;
+            memcpy(&room, data.data() + JOURNAL_RECORD_HEADER + 1, sizeof(room));
+            std::string_view record = data.substr(0, JOURNAL_RECORD_HEADER + len);
+            data.remove_prefix(record.size());
+            metricAdd(JOURNAL_RECORDS);
+            
+            if (type == JOURNAL_SNAPSHOT) {
+                live[room].assign(record);
+                carried.erase(room);
+            } else if (type == JOURNAL_ANSWER) {
+                auto it = live.find(room);
+                if (it != live.end()) it->second.append(record);
+            } else if (type == JOURNAL_END) {
+                live.erase(room);
+                carried.erase(room);
+            }
+        }
+    }
+    
+    // False if the batch did not reach the disk. Then nothing of it counts:
+    // not its snapshots (the segments they would replace stay), nor its
+    // bytes toward the segment limit.
+    bool commit() {
+        if (!writeBatch()) return false;
+        metricAdd(JOURNAL_COMMITS);
+        commits++;
+        segment_bytes += batch.size();
+        
+        track(batch);
+        if (segment_bytes >= JOURNAL_SEGMENT_BYTES) {
+            if (!carryForward()) return false;
+            dropOldSegments();
+            std::string error;
+            current++;
+            if (openSegment(error)) {
+                for (const auto& room : live) carried.insert(room.first);   // each owes the new segment a snapshot
+            } else {
+                current--;
+                fprintf(stderr, "journal: %s\n", error.c_str());
+            }
+        }
+        if (carried.empty()) dropOldSegments();
+        return true;
+    }
+    
+    // Write and sync `batch` at the end of the segment
+    bool writeBatch() {
+        size_t done = 0;
+        while (done < batch.size()) {
+            ssize_t n = write(fd, batch.data() + done, batch.size() - done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                if (n == 0) errno = EIO;
+                return commitFailed("write");
+            }
+            done += n;
+        }
+        long long start = journalNowUs();
+        if (fdatasync(fd) < 0) return commitFailed("fdatasync");
+        metricTime(JOURNAL_SYNC, journalNowUs() - start);
+        return true;
+    }
+    
+    // Before the segment is left behind: the rooms that went all of it
+    // without a snapshot get their latest records copied in, so that it
+    // holds every live room and nothing before it is needed any more
+    bool carryForward() {
+        if (carried.empty()) return true;
+        batch.clear();
+        for (int room : carried) batch += live[room];
+        if (!writeBatch()) return false;
+        segment_bytes += batch.size();
+        carried.clear();
+        return true;
+    }
+    
+    // A record after a torn one would never be replayed, so rather than
+    // carry on past it, cut the segment back to its last whole commit and
+    // journal nothing more
+    bool commitFailed(const char* what) {
+        fprintf(stderr, "journal: %s %s: %s; journaling stopped, later answers will not survive a restart\n",
+                what, journalSegmentPath(dir, current).c_str(), strerror(errno));
+        if (ftruncate(fd, segment_bytes) == 0) fdatasync(fd);
+        return false;
+    }
+    
+    void run() {
+        pthread_mutex_lock(&mutex);
+        while (true) {
+            while (pending.empty() && running) pthread_cond_wait(&wake, &mutex);
+            if (pending.empty()) break;   // stopped and drained
+            batch.swap(pending);
+            uint64_t seq = appended;
+            pthread_mutex_unlock(&mutex);
+            
+            bool ok = commit();
+            batch.clear();
+            
+            pthread_mutex_lock(&mutex);
+            if (!ok) {
+                failed = true;
+                pending.clear();
+                break;
+            }
+            durable = seq;
+            pthread_cond_broadcast(&synced);
+        }
+        pthread_cond_broadcast(&synced);
+        pthread_mutex_unlock(&mutex);
+    }
+    
+    static void* threadMain(void* arg) {
+        static_cast<Journal*>(arg)->run();
+        return nullptr;
+    }
+};
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef LEADERBOARD_H
+#define LEADERBOARD_H
+
+// Order-statistic leaderboard over integer scores. Players are bucketed by
+// score and a Fenwick tree keeps the running count of players per bucket,
+// so a score change, rank-of-player and each step of a top-K walk are all
+// O(log S) in the score range, however many players there are. Ties share
+// a rank (1, 2, 2, 4).
+//
+// Players are identified by small dense ids chosen by the caller (a room
+// uses the player's slot). Not thread-safe: the owner serializes access.
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+class Leaderboard {
+private:
+    std::vector<uint32_t> tree;                  // Fenwick tree, 1-based, over buckets
+    std::vector<std::vector<uint32_t>> buckets;  // ids per score, unordered
+    std::vector<int> score_of;                   // -1 when the id is not on the board
+    std::vector<uint32_t> slot_of;               // position of the id in its bucket
+    uint32_t count;
+
+public:
+    Leaderboard() : tree(2, 0), buckets(1), count(0) {}
+
+    uint32_t size() const { return count; }
+
+    bool contains(uint32_t id) const {
+        return id < score_of.size() && score_of[id] >= 0;
+    }
+
+    int score(uint32_t id) const { return contains(id) ? score_of[id] : -1; }
+
+    void insert(uint32_t id, int score) {
+        if (score < 0) score = 0;
+        if (id >= score_of.size()) {
+            score_of.resize(id + 1, -1);
+            slot_of.resize(id + 1, 0);
+        }
+        if (score_of[id] >= 0) {
+            update(id, score);
+            return;
+        }
+        reserveScore(score);
+        place(id, score);
+        count++;
+    }
+
+    void erase(uint32_t id) {
+        if (!contains(id)) return;
+        unplace(id);
+        score_of[id] = -1;
+        count--;
+    }
+
+    void update(uint32_t id, int score) {
+        if (!contains(id)) {
+            insert(id, score);
+            return;
+        }
+        if (score < 0) score = 0;
+        if (score == score_of[id]) return;
+        reserveScore(score);
+        unplace(id);
+        place(id, score);
+    }
+
+    // 1 + the number of players with a strictly higher score, 0 when absent
+    uint32_t rank(uint32_t id) const {
+        if (!contains(id)) return 0;
+        return count - prefix(score_of[id]) + 1;
+    }
+
+    struct Entry {
+        uint32_t id;
+        uint32_t rank;
+        int score;
+    };
+
+    // Up to k players, best score first
+    void top(uint32_t k, std::vector<Entry>& out) const {
+        out.clear();
+        uint32_t below = count;   // players not yet visited, all in lower buckets
+        while (out.size() < k && below > 0) {
+            int bucket = findNth(below);       // highest bucket still to visit
+            uint32_t rank = count - below + 1;
+            for (uint32_t id : buckets[bucket]) {
+                if (out.size() >= k) break;
+                out.push_back(Entry{id, rank, bucket});
+            }
+            below -= (uint32_t)buckets[bucket].size();
+        }
+    }
+
+private:
+    // Players with a score <= s
+    uint32_t prefix(int s) const {
+        uint32_t sum = 0;
+        for (size_t i = (size_t)s + 1; i > 0; i -= i & (~i + 1)) sum += tree[i];
+        return sum;
+    }
+
+    void add(int s, int delta) {
+        for (size_t i = (size_t)s + 1; i < tree.size(); i += i & (~i + 1)) tree[i] += delta;
+    }
+
+    // Lowest bucket b with prefix(b) >= n (binary lifting; n >= 1)
+    int findNth(uint32_t n) const {
+        size_t pos = 0;
+        size_t step = tree.size() - 1;   // capacity, a power of two
+        for (; step > 0; step >>= 1) {
+            if (pos + step < tree.size() && tree[pos + step] < n) {
+                pos += step;
+                n -= tree[pos];
+            }
+        }
+        return (int)pos;   // 1-based index of the bucket before it == 0-based index of it
+    }
+
+    // Grow the bucket range (a power of two) to cover `score`; rebuilding
+    // the tree is O(S) and only happens when the top score doubles
+    void reserveScore(int score) {
+        size_t capacity = tree.size() - 1;
+        if ((size_t)score < capacity) return;
+        while (capacity <= (size_t)score) capacity *= 2;
+        buckets.resize(capacity);
+        tree.assign(capacity + 1, 0);
+        for (size_t b = 0; b < capacity; ++b) {
+            tree[b + 1] += (uint32_t)buckets[b].size();
+            size_t parent = (b + 1) + ((b + 1) & (~(b + 1) + 1));
+            if (parent <= capacity) tree[parent] += tree[b + 1];
+        }
+    }
+
+    void place(uint32_t id, int score) {
+        score_of[id] = score;
+        slot_of[id] = (uint32_t)buckets[score].size();
+        buckets[score].push_back(id);
+        add(score, 1);
+    }
+
+    void unplace(uint32_t id) {
+        int score = score_of[id];
+        std::vector<uint32_t>& bucket = buckets[score];
+        uint32_t last = bucket.back();
+        bucket[slot_of[id]] = last;
+        slot_of[last] = slot_of[id];
+        bucket.pop_back();
+        add(score, -1);
+    }
+};
+
+#endif
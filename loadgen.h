@@ -0,0 +1,548 @@
+#ifndef LOADGEN_H
+#define LOADGEN_H
+
+// Headless load generator: one process plays as thousands of bots. Each
+// thread owns a share of the bots on its own epoll loop, with non-blocking
+// sockets, a FrameBuffer per bot and the same parsers as the interactive
+// client. Answers go out after a scripted think time, scheduled on a
+// per-thread TimerWheel.
+//
+// Given the server's question bank (-q), bots look each question up and
+// answer correctly with the configured probability; without it they pick
+// an option at random.
+//
+// With a churn rate, a bot that gets a QUESTION may instead hang up and
+// come straight back with RESUME, as a player on a flaky link would; the
+// time from hanging up to STATE is the resume latency.
+//
+// Reported: connect rate, messages per second, and QUESTION -> RESULT and
+// ANSWER -> RESULT latency percentiles as seen by the bots, plus resume
+// latency under churn.
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <random>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "protocol.h"
+#include "schema.h"
+#include "timer_wheel.h"
+#include "histogram.h"
+#include "question_bank.h"
+
+#define LOADGEN_MAX_EVENTS 256
+#define LOADGEN_MAX_CONNECTING 512   // in-flight connects per thread
+
+struct LoadConfig {
+    std::string server_ip;
+    int port;
+    int bots;
+    int threads;
+    int games;            // games each bot plays before it leaves
+    double accuracy;      // chance of answering correctly, with a bank
+    int think_min_ms;
+    int think_max_ms;
+    const char* bank_path;
+    double churn;         // chance a bot drops and resumes on each QUESTION
+};
+
+inline long long loadgenNowUs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+// Question text -> correct answer, shared read-only by every thread
+class AnswerKey {
+private:
+    QuestionBank bank;
+    std::unordered_map<std::string_view, char> answers;
+
+public:
+    bool load(const char* path, std::string& error) {
+        if (!bank.open(path, error)) return false;
+        answers.reserve(bank.size());
+        for (uint32_t i = 0; i < bank.size(); ++i) {
+            QuestionView q = bank.get(i);
+            answers.emplace(q.text, q.correct_answer);
+        }
+        return true;
+    }
+
+    bool empty() const { return answers.empty(); }
+
+    // 0 when the question is not in the bank
+    char lookup(std::string_view text) const {
+        auto it = answers.find(text);
+        return it == answers.end() ? 0 : it->second;
+    }
+};
+
+struct LoadThread;
+
+struct Bot {
+    int fd;
+    uint32_t id;
+    int games_left;
+    bool connected;
+    bool want_write;          // EPOLLOUT is armed
+    LoadThread* owner;
+    FrameBuffer in;
+    std::string out;          // bytes the socket would not take yet
+    long long connect_us;
+    long long question_us;    // 0 when no question is open
+    long long answer_us;
+    int round;
+    char answer;
+    Timer answer_timer;
+    std::string session;      // the SESSION message, for RESUME
+    bool resuming;            // this connect is a RESUME, not a new game
+    long long resume_us;      // when the bot hung up to resume
+
+    Bot() : fd(-1), id(0), games_left(0), connected(false), want_write(false), owner(nullptr), connect_us(0),
+            question_us(0), answer_us(0), round(0), answer(0), resuming(false), resume_us(0) {}
+};
+
+struct LoadThread {
+    const LoadConfig* config;
+    const AnswerKey* key;
+    sockaddr_in server;
+    pthread_t thread;
+    int epoll_fd;
+    TimerWheel wheel;
+    std::mt19937_64 rng;
+    std::vector<Bot*> bots;
+    size_t next_start;         // bots[next_start..] have not connected yet
+    int connecting;
+    int live;                  // bots that still have games to play
+
+    // Stats, read by the main thread after join
+    uint64_t connects;
+    uint64_t connect_failures;
+    uint64_t drops;            // connections lost before FINAL
+    uint64_t sent;
+    uint64_t received;
+    uint64_t games_done;
+    uint64_t resumes;
+    uint64_t resume_failures;
+    uint64_t ramp_left;        // bots whose first connect has not finished
+    long long ramp_done_us;    // when the last of them did
+    LatencyHistogram connect_latency;
+    LatencyHistogram question_to_result;
+    LatencyHistogram answer_to_result;
+    LatencyHistogram resume_latency;   // hung up -> STATE
+
+    LoadThread(const LoadConfig* cfg, const AnswerKey* k, uint64_t seed)
+        : config(cfg), key(k), epoll_fd(epoll_create1(EPOLL_CLOEXEC)),
+          wheel(loadgenNowUs() / 1000), rng(seed), next_start(0), connecting(0), live(0),
+          connects(0), connect_failures(0), drops(0), sent(0), received(0), games_done(0),
+          resumes(0), resume_failures(0), ramp_left(0), ramp_done_us(0) {
+        memset(&server, 0, sizeof(server));
+        server.sin_family = AF_INET;
+        server.sin_port = htons(cfg->port);
+        inet_pton(AF_INET, cfg->server_ip.c_str(), &server.sin_addr);
+    }
+
+    void startConnect(Bot* bot) {
+        bot->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (bot->fd < 0) {
+            connect_failures++;
+            rampStep(bot);
+            retire(bot);
+            return;
+        }
+        int one = 1;
+        setsockopt(bot->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        bot->connected = false;
+        bot->want_write = false;
+        bot->connect_us = loadgenNowUs();
+        bot->in.clear();
+        bot->out.clear();
+        bot->question_us = 0;
+        bot->answer_us = 0;
+
+        if (connect(bot->fd, (sockaddr*)&server, sizeof(server)) < 0 && errno != EINPROGRESS) {
+            close(bot->fd);
+            bot->fd = -1;
+            connect_failures++;
+            rampStep(bot);
+            retire(bot);
+            return;
+        }
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+        ev.data.ptr = bot;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, bot->fd, &ev);
+        connecting++;
+    }
+
+    void onConnected(Bot* bot) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(bot->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err != 0) {
+            connect_failures++;
+            rampStep(bot);
+            closeBot(bot);
+            retire(bot);
+            return;
+        }
+
+        long long now = loadgenNowUs();
+        connecting--;
+        bot->connected = true;
+        connects++;
+        rampStep(bot);
+        connect_latency.record(now - bot->connect_us);
+
+        setInterest(bot, false);
+        if (bot->resuming) {
+            char buffer[128];
+            MessageWriter w(buffer, sizeof(buffer));
+            writeResume(bot->session, w);
+            queueFrame(bot, w.payload());
+        } else {
+            queueFrame(bot, "bot" + std::to_string(bot->id));
+        }
+    }
+
+    void setInterest(Bot* bot, bool want_write) {
+        bot->want_write = want_write;
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLRDHUP | (want_write ? EPOLLOUT : 0);
+        ev.data.ptr = bot;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, bot->fd, &ev);
+    }
+
+    void queueFrame(Bot* bot, std::string_view payload) {
+        bool was_empty = bot->out.empty();
+        bot->out += frameMessage(payload);
+        sent++;
+        if (was_empty) flush(bot);
+    }
+
+    template <class S, class... Args>
+    void queueMessage(Bot* bot, const Args&... values) {
+        char buffer[128];
+        MessageWriter w(buffer, sizeof(buffer));
+        w.message<S>(values...);
+        queueFrame(bot, w.payload());
+    }
+
+    void flush(Bot* bot) {
+        while (!bot->out.empty()) {
+            ssize_t n = ::send(bot->fd, bot->out.data(), bot->out.size(), MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN) {
+                    if (!bot->want_write) setInterest(bot, true);
+                    return;
+                }
+                return;   // the read side will see the error
+            }
+            bot->out.erase(0, n);
+        }
+        if (bot->want_write) setInterest(bot, false);
+    }
+
+    void onReadable(Bot* bot) {
+        while (true) {
+            ssize_t n = bot->in.readFrom(bot->fd);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && errno == EAGAIN) return;
+            if (n <= 0) {
+                // The server hangs up after FINAL; anything earlier is a drop
+                drops++;
+                closeBot(bot);
+                retire(bot);
+                return;
+            }
+
+            std::string_view message;
+            FrameBuffer::Status status;
+            while ((status = bot->in.nextFrame(message)) == FrameBuffer::FRAME_OK) {
+                received++;
+                if (!handleMessage(bot, message)) return;   // bot closed
+            }
+            if (status == FrameBuffer::FRAME_ERROR) {
+                drops++;
+                closeBot(bot);
+                retire(bot);
+                return;
+            }
+        }
+    }
+
+    // Returns false once the bot's connection is gone
+    bool handleMessage(Bot* bot, std::string_view message) {
+        std::string_view type = messageType(message);
+        long long now = loadgenNowUs();
+
+        if (type == QuestionSchema::type) {
+            Decoded<QuestionSchema> msg;
+            if (!msg.parse(message)) return true;
+            int options = GroupReader<OptionSchema>(msg.rest).count();
+            if (options == 0) return true;
+            std::uniform_real_distribution<double> coin(0.0, 1.0);
+            if (config->churn > 0 && !bot->session.empty() && coin(rng) < config->churn) {
+                dropAndResume(bot);
+                return false;
+            }
+            scheduleAnswer(bot, msg.get<QuestionSchema::ROUND>(), msg.get<QuestionSchema::TEXT>(), options, now);
+        } else if (type == SessionSchema::type) {
+            bot->session = message;
+        } else if (type == StateSchema::type) {
+            resumes++;
+            resume_latency.record(now - bot->resume_us);
+            bot->resuming = false;
+            // Still owing an answer to an open round: its question follows the board
+            Decoded<StateSchema> msg;
+            Decoded<StateQuestionSchema> question;
+            if (!msg.parse(message) || !msg.get<StateSchema::OPEN>() || msg.get<StateSchema::ANSWER>() != '?') {
+                return true;
+            }
+            Tokenizer rest = GroupReader<StateEntrySchema>(msg.rest).after(msg.get<StateSchema::ENTRIES>());
+            int options = question.parseFrom(rest) ? GroupReader<OptionSchema>(rest).count() : 0;
+            if (options > 0) {
+                scheduleAnswer(bot, msg.get<StateSchema::ROUND>(), question.get<StateQuestionSchema::TEXT>(),
+                               options, now);
+            }
+        } else if (type == ResumeFailedSchema::type) {
+            resume_failures++;
+            nextGame(bot);
+            return false;
+        } else if (type == ResultSchema::type) {
+            if (bot->question_us) question_to_result.record(now - bot->question_us);
+            if (bot->answer_us) answer_to_result.record(now - bot->answer_us);
+            bot->question_us = 0;
+            bot->answer_us = 0;
+        } else if (type == FinalSchema::type) {
+            games_done++;
+            nextGame(bot);
+            return false;
+        }
+        return true;
+    }
+
+    void scheduleAnswer(Bot* bot, int round, std::string_view text, int options, long long now) {
+        bot->question_us = now;
+        bot->answer_us = 0;
+        bot->round = round;
+        bot->answer = pickAnswer(text, options);
+
+        int spread = config->think_max_ms - config->think_min_ms;
+        int think = config->think_min_ms + (spread > 0 ? (int)(rng() % (spread + 1)) : 0);
+        wheel.schedule(&bot->answer_timer, now / 1000 + think);
+    }
+
+    // Churn: hang up mid-game and come straight back for the same slot
+    void dropAndResume(Bot* bot) {
+        closeBot(bot);
+        bot->resuming = true;
+        bot->resume_us = loadgenNowUs();
+        startConnect(bot);
+    }
+
+    // This game is over for the bot: on to the next, or done
+    void nextGame(Bot* bot) {
+        closeBot(bot);
+        bot->session.clear();
+        bot->resuming = false;
+        if (--bot->games_left > 0) {
+            startConnect(bot);
+        } else {
+            retire(bot);
+        }
+    }
+
+    char pickAnswer(std::string_view text, int options) {
+        char correct = key->lookup(text);
+        if (correct == 0) return (char)('A' + rng() % options);
+
+        std::uniform_real_distribution<double> coin(0.0, 1.0);
+        if (options == 1 || coin(rng) < config->accuracy) return correct;
+        char wrong = (char)('A' + rng() % (options - 1));
+        return wrong >= correct ? wrong + 1 : wrong;
+    }
+
+    static void onAnswerTimer(Timer* t) {
+        Bot* bot = static_cast<Bot*>(t->arg);
+        LoadThread* self = bot->owner;
+        if (bot->fd < 0 || bot->question_us == 0) return;
+        bot->answer_us = loadgenNowUs();
+        self->queueMessage<AnswerSchema>(bot, bot->round, bot->answer);
+    }
+
+    // Track the initial ramp, every bot's first connect, for the connect rate
+    void rampStep(Bot* bot) {
+        if (bot->resuming || bot->games_left != config->games) return;
+        if (--ramp_left == 0) ramp_done_us = loadgenNowUs();
+    }
+
+    void closeBot(Bot* bot) {
+        wheel.cancel(&bot->answer_timer);
+        if (bot->fd >= 0) {
+            if (!bot->connected) connecting--;
+            close(bot->fd);   // also drops it from the epoll set
+            bot->fd = -1;
+        }
+        bot->connected = false;
+    }
+
+    void retire(Bot* bot) {
+        if (bot->games_left > 0) bot->games_left = 0;
+        live--;
+    }
+
+    void run() {
+        for (Bot* bot : bots) {
+            bot->owner = this;
+            bot->games_left = config->games;
+            bot->answer_timer.callback = onAnswerTimer;
+            bot->answer_timer.arg = bot;
+        }
+        live = (int)bots.size();
+        ramp_left = bots.size();
+
+        epoll_event events[LOADGEN_MAX_EVENTS];
+        while (live > 0) {
+            while (next_start < bots.size() && connecting < LOADGEN_MAX_CONNECTING) {
+                startConnect(bots[next_start++]);
+            }
+
+            long timeout = wheel.msUntilNext();
+            if (next_start < bots.size() && (timeout < 0 || timeout > 1)) timeout = 1;
+            int n = epoll_wait(epoll_fd, events, LOADGEN_MAX_EVENTS, (int)timeout);
+
+            for (int i = 0; i < n; ++i) {
+                Bot* bot = static_cast<Bot*>(events[i].data.ptr);
+                if (bot->fd < 0) continue;   // closed earlier in this batch
+                if (!bot->connected) {
+                    if (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) onConnected(bot);
+                    continue;
+                }
+                if (events[i].events & EPOLLOUT) flush(bot);
+                if (bot->fd >= 0 && (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP))) {
+                    onReadable(bot);
+                }
+            }
+
+            wheel.advance(loadgenNowUs() / 1000);
+        }
+    }
+
+    static void* threadMain(void* arg) {
+        static_cast<LoadThread*>(arg)->run();
+        return nullptr;
+    }
+};
+
+inline void printLatency(const char* label, const LatencyHistogram& h) {
+    std::cout << std::setw(22) << std::left << label << std::right << std::fixed << std::setprecision(2)
+              << " n=" << h.count()
+              << "  p50=" << h.percentile(50) / 1000.0 << "ms"
+              << "  p99=" << h.percentile(99) / 1000.0 << "ms"
+              << "  p999=" << h.percentile(99.9) / 1000.0 << "ms"
+              << "  max=" << h.max() / 1000.0 << "ms" << std::endl;
+}
+
+inline int runLoadGenerator(const LoadConfig& config) {
+    // Every bot is a socket
+    rlimit rl{};
+    getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+    if ((rlim_t)config.bots + 64 > rl.rlim_cur) {
+        std::cerr << "Warning: open file limit " << rl.rlim_cur << " is below " << config.bots
+                  << " bots; raise it with ulimit -n" << std::endl;
+    }
+
+    AnswerKey key;
+    if (config.bank_path) {
+        std::string error;
+        if (!key.load(config.bank_path, error)) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "Load generator: " << config.bots << " bots on " << config.threads << " thread(s) -> "
+              << config.server_ip << ":" << config.port << ", " << config.games << " game(s) each, think "
+              << config.think_min_ms << "-" << config.think_max_ms << " ms, "
+              << (key.empty() ? std::string("random answers (no bank)")
+                              : std::to_string((int)(config.accuracy * 100)) + "% accuracy");
+    if (config.churn > 0) std::cout << ", " << config.churn * 100 << "% churn per question";
+    std::cout << std::endl;
+
+    std::vector<LoadThread*> threads;
+    std::random_device seed;
+    for (int t = 0; t < config.threads; ++t) {
+        threads.push_back(new LoadThread(&config, &key, ((uint64_t)seed() << 32) | seed()));
+    }
+    std::vector<Bot> bots(config.bots);
+    for (int i = 0; i < config.bots; ++i) {
+        bots[i].id = i + 1;
+        threads[i % config.threads]->bots.push_back(&bots[i]);
+    }
+
+    long long start = loadgenNowUs();
+    for (LoadThread* t : threads) pthread_create(&t->thread, nullptr, LoadThread::threadMain, t);
+    for (LoadThread* t : threads) pthread_join(t->thread, nullptr);
+    long long elapsed = loadgenNowUs() - start;
+
+    uint64_t connects = 0, failures = 0, drops = 0, sent = 0, received = 0, games = 0;
+    uint64_t resumes = 0, resume_failures = 0;
+    long long ramp_done = start;
+    LatencyHistogram connect_latency, question_to_result, answer_to_result, resume_latency;
+    for (LoadThread* t : threads) {
+        connects += t->connects;
+        failures += t->connect_failures;
+        drops += t->drops;
+        sent += t->sent;
+        received += t->received;
+        games += t->games_done;
+        resumes += t->resumes;
+        resume_failures += t->resume_failures;
+        if (t->ramp_done_us > ramp_done) ramp_done = t->ramp_done_us;
+        connect_latency.merge(t->connect_latency);
+        question_to_result.merge(t->question_to_result);
+        answer_to_result.merge(t->answer_to_result);
+        resume_latency.merge(t->resume_latency);
+        delete t;
+    }
+
+    double seconds = elapsed / 1e6;
+    double ramp_seconds = std::max(ramp_done - start, 1LL) / 1e6;
+    std::cout << "\nRan " << std::fixed << std::setprecision(2) << seconds << " s" << std::endl;
+    std::cout << "Connections: " << connects << " ok, " << failures << " failed, " << drops
+              << " dropped before FINAL" << std::endl;
+    std::cout << "Ramp: " << config.bots << " bots connected in " << ramp_seconds * 1000 << " ms ("
+              << std::setprecision(0) << config.bots / ramp_seconds << " connects/s)" << std::endl;
+    std::cout << "Games finished (per bot): " << games << std::endl;
+    std::cout << "Messages: " << sent << " sent, " << received << " received, "
+              << (sent + received) / seconds << " msg/s" << std::endl;
+    printLatency("connect", connect_latency);
+    printLatency("QUESTION -> RESULT", question_to_result);
+    printLatency("ANSWER -> RESULT", answer_to_result);
+    if (config.churn > 0) {
+        std::cout << "Resumes: " << resumes << " ok, " << resume_failures << " refused" << std::endl;
+        printLatency("hang up -> STATE", resume_latency);
+    }
+    return failures == 0 && drops == 0 && resume_failures == 0 ? 0 : 2;
+}
+
+#endif
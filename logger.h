@@ -0,0 +1,308 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+// Asynchronous structured logging. A thread that logs gets its own
+// single-producer ring of fixed-size records; formatting a record is a few
+// memcpys into the ring, and a background writer thread drains every ring,
+// orders what it found by time and hands it to the kernel in one write().
+// Nothing on the logging side takes a lock or makes a syscall.
+//
+// Events are an event name plus key=value fields, printed logfmt-style:
+//
+//   14:03:07.512044 INFO  answered room=12 player=ana choice=B
+//
+//   LogEvent(LOG_INFO, "answered").kv("room", id).kv("player", name).kv("choice", c);
+//
+// The record is committed when the LogEvent goes out of scope. Below the
+// configured level an event costs one load. INFO and DEBUG are rate limited
+// per thread; when a ring is full or over its rate the event is dropped and
+// counted, and the writer reports how many went missing. Warnings and errors
+// are never rate limited.
+
+#include <atomic>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#define CACHE_LINE 64
+#define LOG_RING_SLOTS 1024             // records per thread, a power of two
+#define LOG_TEXT_MAX 232                // event name and fields, per record
+#define LOG_FLUSH_INTERVAL_MS 5
+#define LOG_OUT_BUFFER (256 * 1024)
+#define DEFAULT_LOG_RATE 2000           // INFO/DEBUG lines per second per thread
+
+enum LogLevel : uint8_t { LOG_DEBUG, LOG_INFO, LOG_WARN, LOG_ERROR, LOG_OFF };
+
+struct LogRecord {
+    long long realtime_us;
+    uint16_t length;
+    LogLevel level;
+    char text[LOG_TEXT_MAX];
+};
+
+struct LogRing {
+    LogRecord records[LOG_RING_SLOTS];
+    alignas(CACHE_LINE) std::atomic<uint64_t> tail;   // next record to fill, owner thread
+    alignas(CACHE_LINE) std::atomic<uint64_t> head;   // next record to write, writer thread
+    std::atomic<uint64_t> dropped_full;
+    std::atomic<uint64_t> dropped_rate;
+    bool busy;            // an event is being built; a nested one is dropped
+    long long window;     // rate limit: current second and lines logged in it
+    int window_lines;
+    LogRing* next;
+    
+    LogRing() : tail(0), head(0), dropped_full(0), dropped_rate(0), busy(false), window(0),
+                window_lines(0), next(nullptr) {}
+};
+
+inline std::atomic<LogRing*> log_rings(nullptr);
+inline thread_local LogRing* log_local = nullptr;
+inline std::atomic<int> log_level(LOG_INFO);
+inline std::atomic<int> log_rate(DEFAULT_LOG_RATE);   // 0: unlimited
+inline std::atomic<bool> log_running(false);
+inline int log_fd = 1;
+inline pthread_t log_thread;
+
+inline void logSetLevel(LogLevel level) { log_level.store(level, std::memory_order_relaxed); }
+inline void logSetRate(int lines_per_second) { log_rate.store(lines_per_second, std::memory_order_relaxed); }
+
+// "debug", "info", "warn", "error" or "off"
+inline bool parseLogLevel(const char* name, LogLevel& level) {
+    static const char* names[] = {"debug", "info", "warn", "error", "off"};
+    for (int i = 0; i <= LOG_OFF; ++i) {
+        if (strcmp(name, names[i]) == 0) {
+            level = (LogLevel)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+inline bool logEnabled(LogLevel level) {
+    return level >= log_level.load(std::memory_order_relaxed);
+}
+
+inline LogRing* logRing() {
+    if (log_local == nullptr) {
+        LogRing* ring = new LogRing();
+        ring->next = log_rings.load(std::memory_order_relaxed);
+        while (!log_rings.compare_exchange_weak(ring->next, ring, std::memory_order_release)) {}
+        log_local = ring;
+    }
+    return log_local;
+}
+
+inline long long logRealtimeUs() {
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+class LogEvent {
+private:
+    LogRing* ring;
+    LogRecord* record;   // nullptr when the event is filtered or dropped
+
+public:
+    LogEvent(LogLevel level, std::string_view event) : ring(nullptr), record(nullptr) {
+        if (!logEnabled(level)) return;
+        LogRing* r = logRing();
+        if (r->busy) return;
+        long long now = logRealtimeUs();
+        
+        int rate = log_rate.load(std::memory_order_relaxed);
+        if (level < LOG_WARN && rate > 0) {
+            long long second = now / 1000000;
+            if (second != r->window) {
+                r->window = second;
+                r->window_lines = 0;
+            }
+            if (++r->window_lines > rate) {
+                r->dropped_rate.store(r->dropped_rate.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                return;
+            }
+        }
+        
+        uint64_t tail = r->tail.load(std::memory_order_relaxed);
+        if (tail - r->head.load(std::memory_order_acquire) >= LOG_RING_SLOTS) {
+            r->dropped_full.store(r->dropped_full.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return;
+        }
+        
+        ring = r;
+        ring->busy = true;
+        record = &ring->records[tail & (LOG_RING_SLOTS - 1)];
+        record->realtime_us = now;
+        record->level = level;
+        record->length = 0;
+        append(event);
+    }
+    
+    ~LogEvent() {
+        if (record == nullptr) return;
+        ring->tail.store(ring->tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        ring->busy = false;
+    }
+    
+    LogEvent(const LogEvent&) = delete;
+    LogEvent& operator=(const LogEvent&) = delete;
+    
+    // Values with spaces, quotes or '=' are quoted
+    LogEvent& kv(std::string_view key, std::string_view value) {
+        if (record == nullptr) return *this;
+        append(" ");
+        append(key);
+        append("=");
+        if (value.empty() || value.find_first_of(" \"=") != std::string_view::npos) {
+            append("\"");
+            for (char c : value) {
+                if (c == '"') append("\\");
+                append(std::string_view(&c, 1));
+            }
+            append("\"");
+        } else {
+            append(value);
+        }
+        return *this;
+    }
+    
+    LogEvent& kv(std::string_view key, const char* value) { return kv(key, std::string_view(value)); }
+    
+    LogEvent& kv(std::string_view key, char value) { return kv(key, std::string_view(&value, 1)); }
+    
+    LogEvent& kv(std::string_view key, long long value) {
+        if (record == nullptr) return *this;
+        char digits[24];
+        int n = snprintf(digits, sizeof(digits), "%lld", value);
+        return kv(key, std::string_view(digits, n));
+    }
+    
+    LogEvent& kv(std::string_view key, int value) { return kv(key, (long long)value); }
+    LogEvent& kv(std::string_view key, unsigned value) { return kv(key, (long long)value); }
+    LogEvent& kv(std::string_view key, size_t value) { return kv(key, (long long)value); }
+
+private:
+    // Truncates silently; a record is a log line, not a transport
+    void append(std::string_view text) {
+        size_t room = LOG_TEXT_MAX - record->length;
+        size_t n = text.size() < room ? text.size() : room;
+        memcpy(record->text + record->length, text.data(), n);
+        record->length += (uint16_t)n;
+    }
+};
+
+// Writer thread: one pass drains every ring as far as it was filled when the
+// pass started, merges by timestamp and writes the lot
+struct LogWriter {
+    struct Pending {
+        long long realtime_us;
+        const LogRecord* record;
+    };
+    
+    std::vector<Pending> pending;
+    std::vector<std::pair<LogRing*, uint64_t>> claimed;
+    std::vector<char> out;
+    uint64_t reported_full = 0;
+    uint64_t reported_rate = 0;
+    long long cached_second = -1;
+    char cached_clock[16];
+    
+    size_t flushOnce() {
+        pending.clear();
+        claimed.clear();
+        uint64_t full = 0, rate = 0;
+        for (LogRing* ring = log_rings.load(std::memory_order_acquire); ring != nullptr; ring = ring->next) {
+            uint64_t head = ring->head.load(std::memory_order_relaxed);
+            uint64_t tail = ring->tail.load(std::memory_order_acquire);
+            for (uint64_t i = head; i < tail; ++i) {
+                const LogRecord* r = &ring->records[i & (LOG_RING_SLOTS - 1)];
+                pending.push_back(Pending{r->realtime_us, r});
+            }
+            claimed.push_back({ring, tail});
+            full += ring->dropped_full.load(std::memory_order_relaxed);
+            rate += ring->dropped_rate.load(std::memory_order_relaxed);
+        }
+        
+        std::stable_sort(pending.begin(), pending.end(),
+                         [](const Pending& a, const Pending& b) { return a.realtime_us < b.realtime_us; });
+        
+        out.clear();
+        for (const Pending& p : pending) formatLine(*p.record);
+        if (full != reported_full || rate != reported_rate) {
+            char note[128];
+            int n = snprintf(note, sizeof(note), "log: %llu line(s) dropped (buffer full), %llu rate limited\n",
+                             (unsigned long long)(full - reported_full), (unsigned long long)(rate - reported_rate));
+            out.insert(out.end(), note, note + n);
+            reported_full = full;
+            reported_rate = rate;
+        }
+        
+        // Give the slots back only once their text has been copied out
+        for (auto& c : claimed) c.first->head.store(c.second, std::memory_order_release);
+        
+        size_t written = 0;
+        while (written < out.size()) {
+            ssize_t n = write(log_fd, out.data() + written, out.size() - written);
+            if (n <= 0) break;
+            written += n;
+        }
+        return pending.size();
+    }
+    
+    void formatLine(const LogRecord& r) {
+        static const char* levels[] = {"DEBUG", "INFO ", "WARN ", "ERROR"};
+        long long second = r.realtime_us / 1000000;
+        if (second != cached_second) {
+            time_t t = (time_t)second;
+            tm local;
+            localtime_r(&t, &local);
+            strftime(cached_clock, sizeof(cached_clock), "%H:%M:%S", &local);
+            cached_second = second;
+        }
+        char prefix[40];
+        int n = snprintf(prefix, sizeof(prefix), "%s.%06lld %s ", cached_clock, r.realtime_us % 1000000,
+                         levels[r.level]);
+        out.insert(out.end(), prefix, prefix + n);
+        out.insert(out.end(), r.text, r.text + r.length);
+        out.push_back('\n');
+    }
+    
+    void run() {
+        out.reserve(LOG_OUT_BUFFER);
+        while (log_running.load(std::memory_order_acquire)) {
+            if (flushOnce() == 0) {
+                timespec pause = {0, LOG_FLUSH_INTERVAL_MS * 1000000L};
+                nanosleep(&pause, nullptr);
+            }
+        }
+        while (flushOnce() > 0) {}
+    }
+    
+    static void* threadMain(void* arg) {
+        static_cast<LogWriter*>(arg)->run();
+        return nullptr;
+    }
+};
+
+inline LogWriter log_writer;
+
+// Start the writer thread, logging to `fd`
+inline void logStart(int fd = 1) {
+    log_fd = fd;
+    log_running.store(true, std::memory_order_release);
+    pthread_create(&log_thread, nullptr, LogWriter::threadMain, &log_writer);
+}
+
+// Write out whatever is still queued and stop the writer
+inline void logStop() {
+    if (!log_running.exchange(false)) return;
+    pthread_join(log_thread, nullptr);
+}
+
+#endif
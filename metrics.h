@@ -0,0 +1,322 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+// Server metrics, served in the Prometheus text format. Every thread that
+// records gets its own cache-line aligned block of counters and timing
+// buckets, which only that thread writes (a relaxed load and store, no
+// read-modify-write, no lock). A scrape walks the blocks and adds them up,
+// so the cost of a metric sits on the scraper, never on the answer path.
+//
+// Blocks are created on a thread's first record and live for the rest of the
+// process; the server's threads never exit, so nothing is reclaimed.
+// Counters are totals: per-second rates are left to the scraper (rate()).
+
+#include <atomic>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+
+#define CACHE_LINE 64
+#define METRICS_BUCKETS 24        // le 1 us, 2 us, 4 us ... 2^23 us (8.4 s), then +Inf
+#define METRICS_MAX_GAUGES 8
+#define METRICS_REQUEST_MAX 4096
+
+enum MetricCounter {
+    MESSAGES_IN,
+    MESSAGES_OUT,           // frames queued to a connection
+    BYTES_IN,
+    BYTES_OUT,              // bytes actually written to sockets
+    CONNECTIONS_OPENED,
+    CONNECTIONS_CLOSED,
+    ANSWERS_DROPPED,        // a room's event queue was full
+    EVICTIONS,
+    MCAST_DATAGRAMS,
+    MCAST_REPAIRS,          // datagrams resent over TCP after a NACK
+    RESUMES,                // players back in their slot after a reconnect
+    JOURNAL_RECORDS,
+    JOURNAL_COMMITS,        // fdatasyncs, each covering a batch of records
+    SPECTATOR_FRAMES,       // frames queued to viewers by the fan-out threads
+    IO_READS,               // readv calls on client sockets
+    IO_WRITES,              // sendmsg calls on client sockets
+    IO_URING_ENTERS,        // io_uring_enter calls, each submitting a batch
+    IO_WAITS,               // reactor wakeups (epoll_wait returns)
+    COUNTER_COUNT
+};
+
+enum MetricTiming {
+    LOBBY_LOCK_WAIT,
+    LOBBY_LOCK_HOLD,
+    BROADCAST,              // one frame queued to a whole room
+    RESULTS_FANOUT,         // RESULT or FINAL, formatted per player
+    ROUND_WAIT,             // QUESTION sent -> round closed
+    TIMER_LAG,              // phase timer deadline -> callback
+    JOURNAL_SYNC,           // one group commit's fdatasync
+    TIMING_COUNT
+};
+
+struct alignas(CACHE_LINE) ThreadMetrics {
+    struct Timing {
+        std::atomic<uint64_t> buckets[METRICS_BUCKETS + 1];
+        std::atomic<uint64_t> sum_us;
+    };
+    
+    std::atomic<uint64_t> counters[COUNTER_COUNT];
+    Timing timings[TIMING_COUNT];
+    ThreadMetrics* next;
+    
+    ThreadMetrics() : next(nullptr) {
+        for (auto& c : counters) c.store(0, std::memory_order_relaxed);
+        for (auto& t : timings) {
+            for (auto& b : t.buckets) b.store(0, std::memory_order_relaxed);
+            t.sum_us.store(0, std::memory_order_relaxed);
+        }
+    }
+    
+    // Owner thread only
+    static void bump(std::atomic<uint64_t>& value, uint64_t n) {
+        value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+};
+
+struct MetricGauge {
+    const char* name;
+    const char* help;
+    const std::atomic<int>* value;
+};
+
+// Every block ever created, newest first; pushed with a CAS, never popped
+inline std::atomic<ThreadMetrics*> metrics_blocks(nullptr);
+inline thread_local ThreadMetrics* metrics_local = nullptr;
+inline MetricGauge metrics_gauges[METRICS_MAX_GAUGES];
+inline int metrics_gauge_count = 0;
+
+inline ThreadMetrics* threadMetrics() {
+    if (metrics_local == nullptr) {
+        ThreadMetrics* block = new ThreadMetrics();
+        block->next = metrics_blocks.load(std::memory_order_relaxed);
+        while (!metrics_blocks.compare_exchange_weak(block->next, block, std::memory_order_release)) {}
+        metrics_local = block;
+    }
+    return metrics_local;
+}
+
+inline void metricAdd(MetricCounter c, uint64_t n = 1) {
+    ThreadMetrics::bump(threadMetrics()->counters[c], n);
+}
+
+inline void metricTime(MetricTiming t, long long us) {
+    uint64_t v = us > 0 ? (uint64_t)us : 0;
+    int b = v <= 1 ? 0 : 64 - __builtin_clzll(v - 1);   // smallest 2^b >= v
+    if (b > METRICS_BUCKETS) b = METRICS_BUCKETS;
+    ThreadMetrics::Timing& timing = threadMetrics()->timings[t];
+    ThreadMetrics::bump(timing.buckets[b], 1);
+    ThreadMetrics::bump(timing.sum_us, v);
+}
+
+// Sum of a counter over every thread, e.g. for a summary at exit
+inline uint64_t metricTotal(MetricCounter c) {
+    uint64_t total = 0;
+    for (ThreadMetrics* m = metrics_blocks.load(std::memory_order_acquire); m != nullptr; m = m->next) {
+        total += m->counters[c].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+// Expose a value someone else already keeps, e.g. the number of open rooms.
+// Register before the endpoint starts.
+inline void metricGauge(const char* name, const char* help, const std::atomic<int>* value) {
+    if (metrics_gauge_count < METRICS_MAX_GAUGES) {
+        metrics_gauges[metrics_gauge_count++] = MetricGauge{name, help, value};
+    }
+}
+
+// Sum every thread's block into the text exposition format
+inline std::string renderMetrics() {
+    static const char* counter_names[COUNTER_COUNT][2] = {
+        {"trivia_messages_received_total", "Frames received from clients"},
+        {"trivia_messages_sent_total", "Frames queued to clients"},
+        {"trivia_bytes_received_total", "Bytes read from client sockets"},
+        {"trivia_bytes_sent_total", "Bytes written to client sockets"},
+        {"trivia_connections_opened_total", "Connections accepted"},
+        {"trivia_connections_closed_total", "Connections closed"},
+        {"trivia_answers_dropped_total", "Answers dropped because the room's queue was full"},
+        {"trivia_evictions_total", "Connections dropped for falling too far behind"},
+        {"trivia_multicast_datagrams_total", "Room broadcasts sent as multicast datagrams"},
+        {"trivia_multicast_repairs_total", "Multicast datagrams resent over TCP after a NACK"},
+        {"trivia_resumes_total", "Players who reconnected and got their slot back"},
+        {"trivia_journal_records_total", "Records written to the game journal"},
+        {"trivia_journal_commits_total", "Journal group commits (one fdatasync each)"},
+        {"trivia_spectator_frames_total", "Frames queued to spectators"},
+        {"trivia_io_reads_total", "readv calls on client sockets"},
+        {"trivia_io_writes_total", "sendmsg calls on client sockets"},
+        {"trivia_io_uring_enters_total", "io_uring_enter calls"},
+        {"trivia_io_waits_total", "Reactor wakeups"},
+    };
+    static const char* timing_names[TIMING_COUNT][2] = {
+        {"trivia_lobby_lock_wait_seconds", "Time spent waiting for a room's lobby mutex"},
+        {"trivia_lobby_lock_hold_seconds", "Time a room's lobby mutex was held"},
+        {"trivia_broadcast_seconds", "Time to queue one frame to every player in a room"},
+        {"trivia_results_fanout_seconds", "Time to format and queue RESULT or FINAL for a room"},
+        {"trivia_round_answer_wait_seconds", "Time from QUESTION to the round closing"},
+        {"trivia_timer_lag_seconds", "How late phase timers fired"},
+        {"trivia_journal_sync_seconds", "Time one journal group commit spent in fdatasync"},
+    };
+    
+    uint64_t counters[COUNTER_COUNT] = {};
+    uint64_t buckets[TIMING_COUNT][METRICS_BUCKETS + 1] = {};
+    uint64_t sums[TIMING_COUNT] = {};
+    for (ThreadMetrics* m = metrics_blocks.load(std::memory_order_acquire); m != nullptr; m = m->next) {
+        for (int c = 0; c < COUNTER_COUNT; ++c) counters[c] += m->counters[c].load(std::memory_order_relaxed);
+        for (int t = 0; t < TIMING_COUNT; ++t) {
+            for (int b = 0; b <= METRICS_BUCKETS; ++b) {
+                buckets[t][b] += m->timings[t].buckets[b].load(std::memory_order_relaxed);
+            }
+            sums[t] += m->timings[t].sum_us.load(std::memory_order_relaxed);
+        }
+    }
+    
+    std::string out;
+    char line[256];
+    for (int c = 0; c < COUNTER_COUNT; ++c) {
+        snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", counter_names[c][0],
+                 counter_names[c][1], counter_names[c][0], counter_names[c][0], (unsigned long long)counters[c]);
+        out += line;
+    }
+    
+    // A close can be summed without the open it belongs to; clamp rather than wrap
+    uint64_t opened = counters[CONNECTIONS_OPENED], closed = counters[CONNECTIONS_CLOSED];
+    snprintf(line, sizeof(line), "# HELP trivia_connections_active Open client connections\n"
+             "# TYPE trivia_connections_active gauge\ntrivia_connections_active %llu\n",
+             (unsigned long long)(opened > closed ? opened - closed : 0));
+    out += line;
+    for (int g = 0; g < metrics_gauge_count; ++g) {
+        const MetricGauge& gauge = metrics_gauges[g];
+        snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s gauge\n%s %d\n", gauge.name, gauge.help,
+                 gauge.name, gauge.name, gauge.value->load(std::memory_order_relaxed));
+        out += line;
+    }
+    
+    for (int t = 0; t < TIMING_COUNT; ++t) {
+        const char* name = timing_names[t][0];
+        snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s histogram\n", name, timing_names[t][1], name);
+        out += line;
+        uint64_t cumulative = 0;
+        for (int b = 0; b < METRICS_BUCKETS; ++b) {
+            cumulative += buckets[t][b];
+            snprintf(line, sizeof(line), "%s_bucket{le=\"%g\"} %llu\n", name, (double)(1ULL << b) / 1e6,
+                     (unsigned long long)cumulative);
+            out += line;
+        }
+        cumulative += buckets[t][METRICS_BUCKETS];
+        snprintf(line, sizeof(line), "%s_bucket{le=\"+Inf\"} %llu\n%s_sum %g\n%s_count %llu\n", name,
+                 (unsigned long long)cumulative, name, sums[t] / 1e6, name, (unsigned long long)cumulative);
+        out += line;
+    }
+    return out;
+}
+
+// Minimal HTTP/1.0 server for GET /metrics on the loopback interface. One
+// blocking thread, one request per connection: scrapes are rare and small.
+class MetricsServer {
+private:
+    int listen_fd;
+
+public:
+    MetricsServer() : listen_fd(-1) {}
+    
+    ~MetricsServer() {
+        if (listen_fd >= 0) close(listen_fd);
+    }
+    
+    bool listenOn(int port) {
+        listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listen_fd < 0) {
+            perror("socket");
+            return false;
+        }
+        
+        int opt = 1;
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+        
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(port);
+        
+        if (bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+            perror("bind (metrics)");
+            return false;
+        }
+        if (listen(listen_fd, 16) < 0) {
+            perror("listen (metrics)");
+            return false;
+        }
+        return true;
+    }
+    
+    void run() {
+        while (true) {
+            int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                perror("accept4 (metrics)");
+                return;
+            }
+            serve(fd);
+            close(fd);
+        }
+    }
+    
+    static void* threadMain(void* arg) {
+        static_cast<MetricsServer*>(arg)->run();
+        return nullptr;
+    }
+
+private:
+    void serve(int fd) {
+        // A scraper that stalls must not wedge the endpoint
+        timeval timeout = {1, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        
+        char request[METRICS_REQUEST_MAX];
+        size_t got = 0;
+        while (got < sizeof(request) - 1) {
+            ssize_t n = recv(fd, request + got, sizeof(request) - 1 - got, 0);
+            if (n <= 0) break;
+            got += n;
+            request[got] = '\0';
+            if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n")) break;
+        }
+        request[got] = '\0';
+        
+        std::string body, status;
+        if (strncmp(request, "GET /metrics ", 13) == 0 || strncmp(request, "GET / ", 6) == 0) {
+            status = "200 OK";
+            body = renderMetrics();
+        } else {
+            status = "404 Not Found";
+            body = "try GET /metrics\n";
+        }
+        
+        std::string response = "HTTP/1.0 " + status + "\r\n"
+                               "Content-Type: text/plain; version=0.0.4\r\n"
+                               "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                               "Connection: close\r\n\r\n" + body;
+        size_t sent = 0;
+        while (sent < response.size()) {
+            ssize_t n = send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) return;
+            sent += n;
+        }
+    }
+};
+
+#endif
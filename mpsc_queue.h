@@ -0,0 +1,87 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+// Bounded lock-free multi-producer, single-consumer queue (D. Vyukov's
+// bounded queue with the consumer side simplified to one thread). Each cell
+// carries a sequence number that says whose turn it is, so producers only
+// contend on one CAS of the tail and the consumer never touches a shared
+// index at all. Capacity is fixed and a power of two; a full queue makes
+// tryPush fail rather than block.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#define CACHE_LINE 64
+
+template <class T>
+class MpscQueue {
+private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        T value;
+    };
+    
+    Cell* cells;
+    size_t mask;
+    alignas(CACHE_LINE) std::atomic<size_t> tail;   // next slot to claim, producers
+    alignas(CACHE_LINE) size_t head;                // next slot to read, consumer only
+
+public:
+    MpscQueue(size_t capacity) : mask(capacity - 1), tail(0), head(0) {
+        cells = new Cell[capacity];
+        for (size_t i = 0; i < capacity; ++i) {
+            cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+    
+    ~MpscQueue() { delete[] cells; }
+    
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+    
+    // Any thread. False when the queue is full.
+    bool tryPush(const T& value) {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &cells[pos & mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = value;
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+    
+    // Consumer thread only
+    bool tryPop(T& value) {
+        Cell* cell = &cells[head & mask];
+        if (cell->seq.load(std::memory_order_acquire) != head + 1) return false;
+        value = cell->value;
+        cell->seq.store(head + mask + 1, std::memory_order_release);
+        head++;
+        return true;
+    }
+    
+    // Consumer thread only: pop up to `max` values, returning how many
+    size_t drain(T* out, size_t max) {
+        size_t n = 0;
+        while (n < max && tryPop(out[n])) n++;
+        return n;
+    }
+    
+    // Consumer thread only
+    bool empty() const {
+        return cells[head & mask].seq.load(std::memory_order_acquire) != head + 1;
+    }
+};
+
+#endif
@@ -0,0 +1,290 @@
+#ifndef MULTICAST_H
+#define MULTICAST_H
+
+// Optional UDP multicast for the messages every player in a room gets
+// (WELCOME, QUESTION, RESULT, FINAL). The room sends one datagram to its
+// group instead of one TCP frame per player, so a broadcast costs the server
+// the same whatever the room size; ANSWER and everything else stays on TCP.
+//
+// Datagrams carry a per-room sequence number (schema.h, "M|room|seq|...").
+// A receiver delivers them in order, buffers what arrives early and asks for
+// the gaps with a NACK over its TCP connection; the room keeps its last
+// MCAST_WINDOW datagrams and resends them as TCP frames. Heartbeats carry
+// the last sequence number sent, so losing the tail of a burst is noticed too.
+//
+// Rooms share MCAST_GROUPS groups (base address + room % MCAST_GROUPS);
+// receivers drop datagrams for rooms other than their own.
+
+#include <string>
+#include <string_view>
+#include <map>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include "schema.h"
+
+#define MCAST_GROUPS 16
+#define MCAST_MAX_DATAGRAM 1400     // fits an Ethernet MTU; larger goes over TCP
+#define MCAST_WINDOW 64             // datagrams a room keeps for repair
+#define MCAST_REORDER_MAX 256       // early datagrams a receiver buffers
+#define MCAST_RECV_BUFFER 65536
+
+// "239.255.42.1:9200"
+inline bool parseGroup(const char* text, in_addr& group, int& port) {
+    const char* colon = strrchr(text, ':');
+    if (colon == nullptr) return false;
+    std::string host(text, colon - text);
+    port = atoi(colon + 1);
+    return inet_pton(AF_INET, host.c_str(), &group) == 1 && IN_MULTICAST(ntohl(group.s_addr)) &&
+           port > 0 && port <= 65535;
+}
+
+// Server side: one socket shared by every game worker. sendto on a datagram
+// socket is atomic, so workers need no lock around it.
+class MulticastSender {
+private:
+    int fd;
+    in_addr base;
+    int group_port;
+
+public:
+    MulticastSender() : fd(-1), base{}, group_port(0) {}
+    
+    ~MulticastSender() {
+        if (fd >= 0) close(fd);
+    }
+    
+    // group_spec is "address:port"; iface picks the outgoing interface by
+    // its address (127.0.0.1 for a loopback test), nullptr lets routing decide
+    bool open(const char* group_spec, const char* iface, std::string& error) {
+        if (!parseGroup(group_spec, base, group_port)) {
+            error = std::string("bad multicast group \"") + group_spec + "\", expected address:port";
+            return false;
+        }
+        fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            error = std::string("socket (multicast): ") + strerror(errno);
+            return false;
+        }
+        
+        // One hop: the game is for the local segment
+        unsigned char ttl = 1, loop = 1;
+        setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+        setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+        if (iface != nullptr) {
+            in_addr addr;
+            if (inet_pton(AF_INET, iface, &addr) != 1 ||
+                setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &addr, sizeof(addr)) < 0) {
+                error = std::string("bad multicast interface \"") + iface + "\"";
+                return false;
+            }
+        }
+        return true;
+    }
+    
+    in_addr groupFor(int room) const {
+        in_addr group;
+        group.s_addr = htonl(ntohl(base.s_addr) + room % MCAST_GROUPS);
+        return group;
+    }
+    
+    std::string groupName(int room) const {
+        char text[INET_ADDRSTRLEN];
+        in_addr group = groupFor(room);
+        inet_ntop(AF_INET, &group, text, sizeof(text));
+        return text;
+    }
+    
+    int port() const { return group_port; }
+    
+    // Best effort, like the datagram itself; receivers repair what is lost
+    bool send(int room, std::string_view datagram) {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr = groupFor(room);
+        addr.sin_port = htons(group_port);
+        return sendto(fd, datagram.data(), datagram.size(), 0, (sockaddr*)&addr, sizeof(addr)) ==
+               (ssize_t)datagram.size();
+    }
+};
+
+// Client side: joins the room's group and puts datagrams and TCP repairs
+// back in sequence. Messages come out through `deliver`, in order and
+// already personalized into the RESULT/FINAL this player would have got over
+// TCP. deliver runs under the receiver's lock, so the socket thread and the
+// TCP thread never hand over messages out of order.
+class MulticastReceiver {
+public:
+    typedef void (*Deliver)(std::string_view message);
+
+private:
+    int fd;
+    int room;
+    int slot;
+    Deliver deliver;
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    bool started;           // MSTART seen: sequence numbers count from here
+    int next_seq;           // next one to deliver
+    int highest_seq;        // highest known to exist, from data or heartbeats
+    int nacked_up_to;       // gaps up to here were already asked for
+    std::map<int, std::string> pending;   // arrived ahead of next_seq
+    std::string personal;   // encode buffer for personalize
+
+public:
+    MulticastReceiver(Deliver d)
+        : fd(-1), room(-1), slot(-1), deliver(d), started(false), next_seq(0), highest_seq(-1),
+          nacked_up_to(-1) {}
+    
+    ~MulticastReceiver() {
+        if (fd >= 0) close(fd);
+    }
+    
+    MulticastReceiver(const MulticastReceiver&) = delete;
+    MulticastReceiver& operator=(const MulticastReceiver&) = delete;
+    
+    // Join the offered group on the interface `local` (the address of our
+    // TCP connection, so the game's network carries the traffic)
+    bool open(const Decoded<McastOfferSchema>& offer, in_addr local, std::string& error) {
+        in_addr group;
+        std::string name(offer.get<McastOfferSchema::GROUP>());
+        if (inet_pton(AF_INET, name.c_str(), &group) != 1) {
+            error = "bad multicast group " + name;
+            return false;
+        }
+        fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            error = std::string("socket (multicast): ") + strerror(errno);
+            return false;
+        }
+        
+        // Several players on one host all bind the group's port
+        int opt = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+        int buffer = 1 << 20;
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer));
+        
+        // Bound to the group address, so other groups on the port stay out
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr = group;
+        addr.sin_port = htons(offer.get<McastOfferSchema::PORT>());
+        if (bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+            error = std::string("bind (multicast): ") + strerror(errno);
+            return false;
+        }
+        
+        ip_mreq membership{};
+        membership.imr_multiaddr = group;
+        membership.imr_interface = local;
+        if (setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) < 0) {
+            error = std::string("joining ") + name + ": " + strerror(errno);
+            return false;
+        }
+        room = offer.get<McastOfferSchema::ROOM>();
+        slot = offer.get<McastOfferSchema::SLOT>();
+        return true;
+    }
+    
+    int descriptor() const { return fd; }
+    
+    // MSTART|seq from the server: everything before seq came over TCP
+    void start(std::string_view message) {
+        Decoded<McastStartSchema> msg;
+        if (!msg.parse(message)) return;
+        int seq = msg.get<McastStartSchema::SEQ>();
+        
+        pthread_mutex_lock(&mutex);
+        started = true;
+        next_seq = seq;
+        nacked_up_to = seq - 1;
+        pending.erase(pending.begin(), pending.lower_bound(seq));
+        deliverReady();
+        pthread_mutex_unlock(&mutex);
+    }
+    
+    // Our TCP connection is being replaced. Until the new one is set up
+    // the server sends broadcasts over it, so hold datagrams back until
+    // the next MSTART says where multicast picks up again.
+    void suspend() {
+        pthread_mutex_lock(&mutex);
+        started = false;
+        pthread_mutex_unlock(&mutex);
+    }
+    
+    // A datagram, or an "M|..." repair frame from the TCP connection.
+    // Returns true with the range to NACK when a gap has just shown up.
+    bool receive(std::string_view message, int& nack_first, int& nack_last) {
+        Decoded<MulticastSchema> msg;
+        if (!msg.parse(message) || msg.get<MulticastSchema::ROOM>() != room) return false;
+        int seq = msg.get<MulticastSchema::SEQ>();
+        std::string_view body = msg.rest.remaining();
+        if (seq < 0 || body.empty()) return false;
+        
+        pthread_mutex_lock(&mutex);
+        if (messageType(body) == HeartbeatSchema::type) {
+            highest_seq = std::max(highest_seq, seq);
+        } else if ((!started || seq >= next_seq) && pending.size() < MCAST_REORDER_MAX) {
+            highest_seq = std::max(highest_seq, seq);
+            pending.emplace(seq, std::string(body));
+        }
+        if (started) deliverReady();
+        bool gap = started && findGap(nack_first, nack_last);
+        pthread_mutex_unlock(&mutex);
+        return gap;
+    }
+    
+    // Read whatever the socket holds; same contract as receive()
+    bool readSocket(int& nack_first, int& nack_last) {
+        static thread_local char buffer[MCAST_RECV_BUFFER];
+        bool gap = false;
+        while (true) {
+            ssize_t n = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+            if (n < 0) break;
+            int first, last;
+            if (receive(std::string_view(buffer, n), first, last)) {
+                if (!gap) nack_first = first;
+                nack_last = last;
+                gap = true;
+            }
+        }
+        return gap;
+    }
+
+private:
+    void deliverReady() {
+        auto it = pending.begin();
+        while (it != pending.end() && it->first <= next_seq) {
+            if (it->first == next_seq) {
+                std::string_view message;
+                if (personalize(it->second, slot, personal, message)) deliver(message);
+                next_seq++;
+            }
+            it = pending.erase(it);
+        }
+    }
+    
+    // Sequence numbers between next_seq and the highest one known that
+    // have not arrived and have not been asked for yet. A repair comes back
+    // over TCP, so each gap is asked for once.
+    bool findGap(int& first, int& last) {
+        int from = std::max(next_seq, nacked_up_to + 1);
+        first = -1;
+        for (int seq = from; seq <= highest_seq; ++seq) {
+            if (pending.count(seq)) continue;
+            if (first < 0) first = seq;
+            last = seq;
+        }
+        if (first < 0) return false;
+        nacked_up_to = highest_seq;
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,169 @@
+#ifndef PLAYER_TABLE_H
+#define PLAYER_TABLE_H
+
+// A room's players as a slot table. Every player gets a stable slot for the
+// whole game; the connection remembers it (Connection::slot), so finding a
+// player is an index, not a scan, and leaving just frees the slot.
+//
+// The fields touched every round (connection, score, correct count, current
+// answer and its timing) are kept as structure-of-arrays columns, so scoring a round is a
+// tight loop over a few contiguous arrays. Names and the per-round answer
+// history are cold and live in side arenas: names back to back in one
+// string, history as one char per (slot, round).
+//
+// A player whose connection drops mid-game is detached rather than removed:
+// the slot keeps its score and answers but no longer counts as present,
+// until a RESUME with the slot's secret attaches a new connection.
+//
+// Not thread-safe: the room serializes access.
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <climits>
+#include "reactor.h"
+
+#define NO_ANSWER '?'
+#define NO_ANSWER_TIME LLONG_MAX   // no answer, or one sent before the question
+
+class PlayerTable {
+public:
+    // Hot columns, indexed by slot. A free slot has conn == nullptr.
+    std::vector<Connection*> conn;
+    std::vector<int> score;
+    std::vector<int> correct;       // rounds answered correctly
+    std::vector<char> answer;       // answer to the current round
+    std::vector<long long> answer_us;   // QUESTION sent -> that answer received
+    std::vector<long long> total_answer_us;   // over all timed answers
+    std::vector<int> timed_answers;
+    std::vector<uint8_t> multicast;     // gets room broadcasts by multicast
+
+private:
+    std::vector<uint32_t> name_offset;
+    std::vector<uint32_t> name_length;
+    std::string names;              // arena; a reused slot appends its new name
+    std::vector<char> history;      // rounds chars per slot
+    std::vector<uint64_t> secrets;  // for RESUME; 0 once the slot is free
+    std::vector<uint32_t> free_slots;
+    int rounds;
+    size_t active;
+
+public:
+    PlayerTable(int rounds) : rounds(rounds), active(0) {}
+    
+    // Number of slots, free ones included; loops run over [0, capacity())
+    uint32_t capacity() const { return (uint32_t)conn.size(); }
+    // Players present; detached ones do not count
+    size_t size() const { return active; }
+    bool used(uint32_t slot) const { return conn[slot] != nullptr; }
+    bool detached(uint32_t slot) const { return conn[slot] == nullptr && secrets[slot] != 0; }
+    uint64_t secret(uint32_t slot) const { return secrets[slot]; }
+    
+    uint32_t add(Connection* c, std::string_view name, uint64_t secret) {
+        uint32_t slot;
+        if (!free_slots.empty()) {
+            slot = free_slots.back();
+            free_slots.pop_back();
+        } else {
+            slot = grow();
+        }
+        
+        reset(slot, name, secret);
+        conn[slot] = c;
+        c->slot = slot;
+        active++;
+        return slot;
+    }
+    
+    // Recovery: recreate `slot` as a detached player with no score yet;
+    // the caller fills in the columns and history from the journal
+    void restore(uint32_t slot, std::string_view name, uint64_t secret) {
+        while (capacity() <= slot) free_slots.push_back(grow());
+        free_slots.erase(std::remove(free_slots.begin(), free_slots.end(), slot), free_slots.end());
+        reset(slot, name, secret);
+    }
+    
+    // Frees the slot, present or detached. Clears the answers too, so a
+    // free slot never scores.
+    void remove(uint32_t slot) {
+        if (secrets[slot] == 0) return;
+        if (used(slot)) active--;
+        conn[slot] = nullptr;
+        answer[slot] = NO_ANSWER;
+        answer_us[slot] = NO_ANSWER_TIME;
+        multicast[slot] = 0;
+        secrets[slot] = 0;
+        std::fill(history.begin() + (size_t)slot * rounds, history.begin() + (size_t)(slot + 1) * rounds, NO_ANSWER);
+        free_slots.push_back(slot);
+    }
+    
+    // The connection is gone but the slot stays the player's
+    void detach(uint32_t slot) {
+        if (!used(slot)) return;
+        conn[slot] = nullptr;
+        multicast[slot] = 0;
+        active--;
+    }
+    
+    // The caller has already pointed c->slot here
+    void attach(uint32_t slot, Connection* c) {
+        conn[slot] = c;
+        active++;
+    }
+    
+    // The slot `c` holds in this table, or -1
+    int find(const Connection* c) const {
+        uint32_t slot = c->slot;
+        return slot < capacity() && conn[slot] == c ? (int)slot : -1;
+    }
+    
+    std::string_view name(uint32_t slot) const {
+        return std::string_view(names).substr(name_offset[slot], name_length[slot]);
+    }
+    
+    // Answers for any round, including ones that arrive early
+    char answerAt(uint32_t slot, int round) const {
+        return history[(size_t)slot * rounds + round];
+    }
+    
+    void setAnswer(uint32_t slot, int round, char choice) {
+        history[(size_t)slot * rounds + round] = choice;
+    }
+
+private:
+    uint32_t grow() {
+        conn.push_back(nullptr);
+        score.push_back(0);
+        correct.push_back(0);
+        answer.push_back(NO_ANSWER);
+        answer_us.push_back(NO_ANSWER_TIME);
+        total_answer_us.push_back(0);
+        timed_answers.push_back(0);
+        multicast.push_back(0);
+        name_offset.push_back(0);
+        name_length.push_back(0);
+        secrets.push_back(0);
+        history.resize(history.size() + rounds, NO_ANSWER);
+        return capacity() - 1;
+    }
+    
+    void reset(uint32_t slot, std::string_view name, uint64_t secret) {
+        conn[slot] = nullptr;
+        score[slot] = 0;
+        correct[slot] = 0;
+        answer[slot] = NO_ANSWER;
+        answer_us[slot] = NO_ANSWER_TIME;
+        total_answer_us[slot] = 0;
+        timed_answers[slot] = 0;
+        multicast[slot] = 0;
+        name_offset[slot] = (uint32_t)names.size();
+        name_length[slot] = (uint32_t)name.size();
+        names.append(name);
+        secrets[slot] = secret;
+        std::fill(history.begin() + (size_t)slot * rounds, history.begin() + (size_t)(slot + 1) * rounds, NO_ANSWER);
+    }
+};
+
+#endif
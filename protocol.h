@@ -0,0 +1,273 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+// Wire protocol shared by server.cpp and client.cpp.
+//
+// Every message travels as a frame: a 4-byte big-endian payload length
+// followed by the payload, which is the pipe-delimited text the game has
+// always used ("QUESTION|1|...", "ANSWER|1|B"). Framing keeps messages
+// intact when TCP coalesces or splits them, and lifts the old 1024-byte
+// limit. The first frame a client sends is its player name, or a RESUME
+// when it is coming back to a game it dropped out of.
+//
+// Parsing is zero-copy: frames are handed out as std::string_view into the
+// connection's ring buffer and the decoders only slice those views. The
+// messages themselves are declared in schema.h.
+
+#include <string>
+#include <string_view>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <charconv>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+
+#define FRAME_HEADER_SIZE 4
+#define MAX_FRAME_SIZE (1 << 20)
+// The first frame on a connection (a name, a RESUME or a WATCH) is far
+// less; a peer that has not sent it yet may not announce a bigger one
+#define FIRST_FRAME_MAX 1024
+#define MAX_NAME_BYTES 32   // longer player names are cut short at join
+#define FRAME_BUFFER_INITIAL 4096
+
+inline void putFrameHeader(char* out, uint32_t len) {
+    out[0] = (char)(len >> 24);
+    out[1] = (char)(len >> 16);
+    out[2] = (char)(len >> 8);
+    out[3] = (char)len;
+}
+
+inline uint32_t getFrameHeader(const char* in) {
+    return ((uint32_t)(unsigned char)in[0] << 24) | ((uint32_t)(unsigned char)in[1] << 16) |
+           ((uint32_t)(unsigned char)in[2] << 8) | (uint32_t)(unsigned char)in[3];
+}
+
+// Header + payload, ready to hand to send()
+inline std::string frameMessage(std::string_view payload) {
+    std::string frame(FRAME_HEADER_SIZE + payload.size(), '\0');
+    putFrameHeader(&frame[0], (uint32_t)payload.size());
+    memcpy(&frame[FRAME_HEADER_SIZE], payload.data(), payload.size());
+    return frame;
+}
+
+// Blocking send of one frame, finishing short writes. Used by the client.
+inline bool sendFrame(int fd, std::string_view payload) {
+    char header[FRAME_HEADER_SIZE];
+    putFrameHeader(header, (uint32_t)payload.size());
+    
+    iovec iov[2];
+    iov[0].iov_base = header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = (void*)payload.data();
+    iov[1].iov_len = payload.size();
+    
+    int first = 0;
+    while (first < 2) {
+        msghdr msg{};
+        msg.msg_iov = iov + first;
+        msg.msg_iovlen = 2 - first;
+        ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        while (first < 2 && (size_t)n >= iov[first].iov_len) {
+            n -= iov[first].iov_len;
+            first++;
+        }
+        if (first < 2) {
+            iov[first].iov_base = (char*)iov[first].iov_base + n;
+            iov[first].iov_len -= n;
+        }
+    }
+    return true;
+}
+
+// Per-connection receive ring. Bytes are read straight into the free part
+// of the ring (readv over the two spans when it wraps), and complete frames
+// are returned as views into it. A frame that happens to wrap the end of
+// the ring is the only case that gets copied, into a scratch buffer that is
+// reused across frames. A returned view is valid until the next read.
+class FrameBuffer {
+private:
+    char* data;
+    size_t capacity;   // power of two
+    size_t head;       // read position, only ever grows
+    size_t tail;       // write position, only ever grows
+    char* scratch;
+    size_t scratch_size;
+
+public:
+    enum Status { FRAME_OK, FRAME_INCOMPLETE, FRAME_ERROR };
+    
+    FrameBuffer()
+        : data((char*)malloc(FRAME_BUFFER_INITIAL)), capacity(FRAME_BUFFER_INITIAL),
+          head(0), tail(0), scratch(nullptr), scratch_size(0) {}
+    
+    ~FrameBuffer() {
+        free(data);
+        free(scratch);
+    }
+    
+    FrameBuffer(const FrameBuffer&) = delete;
+    FrameBuffer& operator=(const FrameBuffer&) = delete;
+    
+    size_t size() const { return tail - head; }
+    
+    // Drop any buffered bytes, keeping the allocation
+    void clear() {
+        head = 0;
+        tail = 0;
+    }
+    
+    // One read() worth of bytes from fd. Same return convention as read().
+    // `drained`, if given, is set when the read came back short of the free
+    // space: the socket had nothing more, so there is no need to ask again
+    // for EAGAIN.
+    ssize_t readFrom(int fd, bool* drained = nullptr) {
+        if (size() == capacity) grow(capacity * 2);
+        
+        size_t mask = capacity - 1;
+        size_t start = tail & mask;
+        size_t free_bytes = capacity - size();
+        
+        iovec iov[2];
+        int iovcnt = 1;
+        iov[0].iov_base = data + start;
+        iov[0].iov_len = std::min(free_bytes, capacity - start);
+        if (iov[0].iov_len < free_bytes) {
+            iov[1].iov_base = data;
+            iov[1].iov_len = free_bytes - iov[0].iov_len;
+            iovcnt = 2;
+        }
+        
+        ssize_t n = readv(fd, iov, iovcnt);
+        if (n > 0) tail += n;
+        if (drained) *drained = n > 0 && (size_t)n < free_bytes;
+        return n;
+    }
+    
+    // Copy bytes in from somewhere other than a socket
+    void append(const char* bytes, size_t len) {
+        while (capacity - size() < len) grow(capacity * 2);
+        size_t mask = capacity - 1;
+        for (size_t i = 0; i < len; ) {
+            size_t start = (tail + i) & mask;
+            size_t chunk = std::min(len - i, capacity - start);
+            memcpy(data + start, bytes + i, chunk);
+            i += chunk;
+        }
+        tail += len;
+    }
+    
+    // A frame announcing more than `limit` bytes is an error, before any
+    // room is made for it
+    Status nextFrame(std::string_view& payload, uint32_t limit = MAX_FRAME_SIZE) {
+        if (size() < FRAME_HEADER_SIZE) return FRAME_INCOMPLETE;
+        
+        char header[FRAME_HEADER_SIZE];
+        copyOut(head, header, FRAME_HEADER_SIZE);
+        uint32_t len = getFrameHeader(header);
+        if (len > limit) return FRAME_ERROR;
+        
+        size_t total = FRAME_HEADER_SIZE + (size_t)len;
+        if (size() < total) {
+            // Make sure the rest of a big frame will fit when it arrives
+            while (capacity < total) grow(capacity * 2);
+            return FRAME_INCOMPLETE;
+        }
+        
+        size_t mask = capacity - 1;
+        size_t start = (head + FRAME_HEADER_SIZE) & mask;
+        if (start + len <= capacity) {
+            payload = std::string_view(data + start, len);
+        } else {
+            if (scratch_size < len) {
+                scratch = (char*)realloc(scratch, len);
+                scratch_size = len;
+            }
+            copyOut(head + FRAME_HEADER_SIZE, scratch, len);
+            payload = std::string_view(scratch, len);
+        }
+        head += total;
+        return FRAME_OK;
+    }
+
+private:
+    void copyOut(size_t pos, char* out, size_t len) const {
+        size_t mask = capacity - 1;
+        for (size_t i = 0; i < len; ) {
+            size_t start = (pos + i) & mask;
+            size_t chunk = std::min(len - i, capacity - start);
+            memcpy(out + i, data + start, chunk);
+            i += chunk;
+        }
+    }
+    
+    void grow(size_t new_capacity) {
+        char* bigger = (char*)malloc(new_capacity);
+        size_t used = size();
+        copyOut(head, bigger, used);
+        free(data);
+        data = bigger;
+        capacity = new_capacity;
+        head = 0;
+        tail = used;
+    }
+};
+
+// Splits a message on '|' without copying
+class Tokenizer {
+private:
+    std::string_view rest;
+    bool done;
+
+public:
+    Tokenizer() : done(true) {}
+    Tokenizer(std::string_view message) : rest(message), done(false) {}
+    
+    bool next(std::string_view& token) {
+        if (done) return false;
+        size_t bar = rest.find('|');
+        if (bar == std::string_view::npos) {
+            token = rest;
+            done = true;
+        } else {
+            token = rest.substr(0, bar);
+            rest.remove_prefix(bar + 1);
+        }
+        return true;
+    }
+    
+    // Everything not yet tokenized, bars included
+    std::string_view remaining() const {
+        return done ? std::string_view() : rest;
+    }
+    
+    bool skip(int tokens) {
+        std::string_view token;
+        for (int i = 0; i < tokens; ++i) {
+            if (!next(token)) return false;
+        }
+        return true;
+    }
+};
+
+// A player name cut to MAX_NAME_BYTES, not in the middle of a UTF-8
+// character
+inline std::string_view clipName(std::string_view name) {
+    if (name.size() <= MAX_NAME_BYTES) return name;
+    size_t end = MAX_NAME_BYTES;
+    while (end > 0 && ((unsigned char)name[end] & 0xC0) == 0x80) end--;
+    return name.substr(0, end);
+}
+
+inline std::string_view messageType(std::string_view message) {
+    return message.substr(0, message.find('|'));
+}
+
+#endif
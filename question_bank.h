@@ -0,0 +1,358 @@
+#ifndef QUESTION_BANK_H
+#define QUESTION_BANK_H
+
+// Question bank: a compact, read-only file that the server mmaps at startup.
+// Opening it costs a few syscalls whatever its size, every server process
+// on the host shares the same page-cache pages, and any question can be
+// fetched in O(1) through the offset index.
+//
+// Layout (little-endian):
+//   BankHeader
+//   uint64_t index[question_count]         file offset of each record
+//   BankGroup groups[group_count]          contiguous index ranges per
+//                                          (category, difficulty)
+//   category names                         uint16_t length + bytes, each
+//   records                                see below
+//
+// A record is: uint8_t correct answer, uint8_t option count, uint16_t text
+// length, uint16_t option lengths[option count], then the text and option
+// bytes back to back. Records are sorted by category and difficulty, which
+// is what lets a group be a plain index range.
+//
+// bankconv.cpp builds these files from CSV or JSON.
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <map>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifndef MAX_OPTIONS
+#define MAX_OPTIONS 8
+#endif
+
+#define BANK_MAGIC "TRIVQB1"
+#define BANK_VERSION 1
+
+struct Question {
+    std::string text;
+    std::vector<std::string> options;
+    char correct_answer;
+    std::string category;
+    int difficulty;
+
+    Question(const std::string& q, const std::vector<std::string>& opts, char ans,
+             const std::string& cat = "general", int diff = 1)
+        : text(q), options(opts), correct_answer(ans), category(cat), difficulty(diff) {}
+};
+
+struct BankHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t question_count;
+    uint32_t group_count;
+    uint32_t category_count;
+    uint64_t index_offset;
+    uint64_t groups_offset;
+    uint64_t categories_offset;
+    uint64_t file_size;
+};
+
+struct BankGroup {
+    uint16_t category;
+    uint8_t difficulty;
+    uint8_t reserved;
+    uint32_t first;   // index of the first question in the group
+    uint32_t count;
+};
+
+// A question as stored in the bank. The views point into the mapping and
+// stay valid for the life of the QuestionBank.
+struct QuestionView {
+    std::string_view text;
+    std::string_view options[MAX_OPTIONS];
+    int option_count;
+    char correct_answer;
+};
+
+// Serialize questions into the bank format
+inline std::string buildBank(const std::vector<Question>& questions) {
+    // Category ids follow sorted category names
+    std::map<std::string, uint16_t> category_ids;
+    for (const auto& q : questions) category_ids[q.category] = 0;
+    uint16_t next_id = 0;
+    for (auto& entry : category_ids) entry.second = next_id++;
+
+    std::vector<uint32_t> order(questions.size());
+    for (uint32_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        uint16_t ca = category_ids[questions[a].category], cb = category_ids[questions[b].category];
+        if (ca != cb) return ca < cb;
+        return questions[a].difficulty < questions[b].difficulty;
+    });
+
+    std::vector<BankGroup> groups;
+    for (uint32_t i = 0; i < order.size(); ++i) {
+        const Question& q = questions[order[i]];
+        uint16_t category = category_ids[q.category];
+        uint8_t difficulty = (uint8_t)q.difficulty;
+        if (groups.empty() || groups.back().category != category || groups.back().difficulty != difficulty) {
+            groups.push_back(BankGroup{category, difficulty, 0, i, 0});
+        }
+        groups.back().count++;
+    }
+
+    std::string names;
+    for (const auto& entry : category_ids) {
+        uint16_t len = (uint16_t)std::min<size_t>(entry.first.size(), 0xffff);
+        names.append((const char*)&len, sizeof(len));
+        names.append(entry.first, 0, len);
+    }
+
+    BankHeader header{};
+    memcpy(header.magic, BANK_MAGIC, sizeof(BANK_MAGIC));
+    header.version = BANK_VERSION;
+    header.question_count = (uint32_t)questions.size();
+    header.group_count = (uint32_t)groups.size();
+    header.category_count = (uint32_t)category_ids.size();
+    header.index_offset = sizeof(BankHeader);
+    header.groups_offset = header.index_offset + sizeof(uint64_t) * questions.size();
+    header.categories_offset = header.groups_offset + sizeof(BankGroup) * groups.size();
+    uint64_t records_offset = header.categories_offset + names.size();
+
+    std::vector<uint64_t> index(questions.size());
+    std::string records;
+    for (uint32_t i = 0; i < order.size(); ++i) {
+        const Question& q = questions[order[i]];
+        index[i] = records_offset + records.size();
+
+        uint8_t option_count = (uint8_t)std::min<size_t>(q.options.size(), MAX_OPTIONS);
+        uint16_t text_len = (uint16_t)std::min<size_t>(q.text.size(), 0xffff);
+        records.push_back(q.correct_answer);
+        records.push_back((char)option_count);
+        records.append((const char*)&text_len, sizeof(text_len));
+        for (int o = 0; o < option_count; ++o) {
+            uint16_t len = (uint16_t)std::min<size_t>(q.options[o].size(), 0xffff);
+            records.append((const char*)&len, sizeof(len));
+        }
+        records.append(q.text, 0, text_len);
+        for (int o = 0; o < option_count; ++o) {
+            records.append(q.options[o], 0, 0xffff);
+        }
+    }
+    header.file_size = records_offset + records.size();
+
+    std::string out;
+    out.reserve(header.file_size);
+    out.append((const char*)&header, sizeof(header));
+    out.append((const char*)index.data(), sizeof(uint64_t) * index.size());
+    out.append((const char*)groups.data(), sizeof(BankGroup) * groups.size());
+    out.append(names);
+    out.append(records);
+    return out;
+}
+
+class QuestionBank {
+public:
+    // A run of question indices to draw from
+    struct Range {
+        uint32_t first;
+        uint32_t count;
+    };
+
+private:
+    const char* base;
+    size_t length;
+    bool mapped;          // false when base points at `owned`
+    std::string owned;
+    const BankHeader* header;
+    const uint64_t* index;
+    const BankGroup* groups;
+    std::vector<std::string_view> category_names;
+
+public:
+    QuestionBank() : base(nullptr), length(0), mapped(false), header(nullptr), index(nullptr), groups(nullptr) {}
+
+    ~QuestionBank() {
+        if (mapped) munmap((void*)base, length);
+    }
+
+    QuestionBank(const QuestionBank&) = delete;
+    QuestionBank& operator=(const QuestionBank&) = delete;
+
+    // Map a bank file read-only. Only the header and section bounds are
+    // checked here so startup stays O(1) in the number of questions.
+    bool open(const char* path, std::string& error) {
+        int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            error = std::string("cannot open ") + path + ": " + strerror(errno);
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(BankHeader)) {
+            close(fd);
+            error = std::string(path) + ": not a question bank";
+            return false;
+        }
+        void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) {
+            error = std::string("mmap ") + path + ": " + strerror(errno);
+            return false;
+        }
+        madvise(p, st.st_size, MADV_RANDOM);   // draws jump all over the file
+
+        base = (const char*)p;
+        length = st.st_size;
+        mapped = true;
+        return parse(error);
+    }
+
+    // Use an in-memory bank, e.g. one made by buildBank
+    bool load(std::string bytes, std::string& error) {
+        owned = std::move(bytes);
+        base = owned.data();
+        length = owned.size();
+        mapped = false;
+        return parse(error);
+    }
+
+    uint32_t size() const { return header ? header->question_count : 0; }
+
+    QuestionView get(uint32_t i) const {
+        QuestionView q{};
+        if (i >= size() || index[i] + 4 > length) return q;
+        const char* p = base + index[i];
+        const char* end = base + length;
+
+        q.correct_answer = p[0];
+        q.option_count = std::min<int>((uint8_t)p[1], MAX_OPTIONS);
+        uint16_t text_len;
+        memcpy(&text_len, p + 2, sizeof(text_len));
+        p += 4;
+
+        uint16_t option_lens[MAX_OPTIONS];
+        if (p + 2 * q.option_count > end) return QuestionView{};
+        memcpy(option_lens, p, 2 * q.option_count);
+        p += 2 * q.option_count;
+
+        if (p + text_len > end) return QuestionView{};
+        q.text = std::string_view(p, text_len);
+        p += text_len;
+        for (int o = 0; o < q.option_count; ++o) {
+            if (p + option_lens[o] > end) return QuestionView{};
+            q.options[o] = std::string_view(p, option_lens[o]);
+            p += option_lens[o];
+        }
+        return q;
+    }
+
+    // -1 when there is no such category
+    int findCategory(std::string_view name) const {
+        for (size_t i = 0; i < category_names.size(); ++i) {
+            if (category_names[i] == name) return (int)i;
+        }
+        return -1;
+    }
+
+    // Index ranges matching a category and difficulty (-1 means any)
+    std::vector<Range> select(int category, int difficulty) const {
+        std::vector<Range> ranges;
+        for (uint32_t g = 0; g < header->group_count; ++g) {
+            if (category >= 0 && groups[g].category != category) continue;
+            if (difficulty >= 0 && groups[g].difficulty != difficulty) continue;
+            if (!ranges.empty() && ranges.back().first + ranges.back().count == groups[g].first) {
+                ranges.back().count += groups[g].count;
+            } else {
+                ranges.push_back(Range{groups[g].first, groups[g].count});
+            }
+        }
+        return ranges;
+    }
+
+    // Draw `k` distinct questions from `ranges` (Floyd's algorithm: k random
+    // numbers, no shuffle of the whole bank, no repeats within a game)
+    template <class Rng>
+    void sample(const std::vector<Range>& ranges, int k, Rng& rng, std::vector<QuestionView>& out) const {
+        std::vector<uint32_t> ids;
+        sampleIds(ranges, k, rng, ids);
+        out.clear();
+        for (uint32_t id : ids) out.push_back(get(id));
+    }
+
+    // The same draw as question indices, which stay valid across restarts
+    template <class Rng>
+    void sampleIds(const std::vector<Range>& ranges, int k, Rng& rng, std::vector<uint32_t>& out) const {
+        uint64_t total = 0;
+        for (const auto& r : ranges) total += r.count;
+        if ((uint64_t)k > total) k = (int)total;
+
+        std::vector<uint64_t> picked;
+        picked.reserve(k);
+        for (uint64_t j = total - k; j < total; ++j) {
+            uint64_t t = rng() % (j + 1);
+            if (std::find(picked.begin(), picked.end(), t) != picked.end()) t = j;
+            picked.push_back(t);
+        }
+
+        // Floyd's picks come out biased towards order; shuffle them
+        for (int i = k - 1; i > 0; --i) {
+            std::swap(picked[i], picked[rng() % (i + 1)]);
+        }
+
+        out.clear();
+        for (uint64_t n : picked) {
+            for (const auto& r : ranges) {
+                if (n < r.count) {
+                    out.push_back(r.first + (uint32_t)n);
+                    break;
+                }
+                n -= r.count;
+            }
+        }
+    }
+
+private:
+    bool parse(std::string& error) {
+        header = (const BankHeader*)base;
+        if (length < sizeof(BankHeader) || memcmp(header->magic, BANK_MAGIC, sizeof(BANK_MAGIC)) != 0 ||
+            header->version != BANK_VERSION) {
+            error = "not a question bank (bad magic or version)";
+            header = nullptr;
+            return false;
+        }
+        if (header->file_size != length ||
+            header->index_offset + sizeof(uint64_t) * (uint64_t)header->question_count > length ||
+            header->groups_offset + sizeof(BankGroup) * (uint64_t)header->group_count > length ||
+            header->categories_offset > length) {
+            error = "question bank is truncated";
+            header = nullptr;
+            return false;
+        }
+
+        index = (const uint64_t*)(base + header->index_offset);
+        groups = (const BankGroup*)(base + header->groups_offset);
+
+        const char* p = base + header->categories_offset;
+        const char* end = base + length;
+        for (uint32_t c = 0; c < header->category_count; ++c) {
+            uint16_t len;
+            if (p + sizeof(len) > end) break;
+            memcpy(&len, p, sizeof(len));
+            p += sizeof(len);
+            if (p + len > end) break;
+            category_names.push_back(std::string_view(p, len));
+            p += len;
+        }
+        return true;
+    }
+};
+
+#endif
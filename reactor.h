@@ -0,0 +1,925 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/uio.h>
+#include <pthread.h>
+#include <time.h>
+#include "protocol.h"
+#include "metrics.h"
+#include "shm_ring.h"
+#include "uring.h"
+
+#define REACTOR_MAX_EVENTS 256
+#define CONNECTION_EVENTS (EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET)
+// Once a multishot receive is posted, input and hangups come from the ring
+#define URING_CONNECTION_EVENTS (EPOLLOUT | EPOLLET)
+// Set in the data.ptr of a shared memory client's doorbell, which is
+// registered alongside its socket, so the two events tell themselves apart
+#define BELL_TAG ((uintptr_t)1)
+
+// Outbound backpressure, in queued bytes per connection. Above the high
+// watermark we stop reading from the peer until its queue drains below the
+// low watermark; past the eviction limit it is disconnected.
+#define OUT_LOW_WATERMARK (16 * 1024)
+#define OUT_HIGH_WATERMARK (64 * 1024)
+#define OUT_EVICT_LIMIT (1024 * 1024)
+#define OUT_MAX_IOV 64
+
+// io_uring receives: buffers per reactor the kernel fills and we copy out of
+#define URING_RECV_BUFFERS 1024
+#define URING_RECV_BUFFER_SIZE 2048
+#define URING_BUFFER_GROUP 0
+#define URING_COMPLETIONS 4096   // a burst of input from every connection at once
+
+// How connections talk to the kernel (-O):
+//   direct  read each ready socket until EAGAIN, write each frame as it is
+//           queued: a system call per message each way, as it always was
+//   batch   read each ready socket once per wakeup (a short read means it
+//           is empty), and hold the writes of a pass (a reactor wakeup, a
+//           worker's round of rooms) until its end, so each connection
+//           gets everything it was sent in that pass in one writev
+//   uring   batch, with reads posted once as multishot receives into a
+//           ring of provided buffers, and a pass's writes submitted to the
+//           kernel all at once
+enum IoBackend { IO_DIRECT, IO_BATCH, IO_URING };
+
+inline IoBackend io_backend = IO_BATCH;
+
+inline bool parseIoBackend(const char* name, IoBackend& backend) {
+    static const char* names[] = {"direct", "batch", "uring"};
+    for (int i = 0; i < 3; ++i) {
+        if (strcmp(name, names[i]) == 0) {
+            backend = (IoBackend)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// A complete frame (header + payload), serialized once and shared by every
+// connection it is queued on
+typedef std::shared_ptr<const std::string> FramePtr;
+
+inline FramePtr makeFrame(std::string_view payload) {
+    return std::make_shared<const std::string>(frameMessage(payload));
+}
+
+// One already encoded with its header in front (schema.h)
+inline FramePtr shareFrame(std::string_view frame) {
+    return std::make_shared<const std::string>(frame);
+}
+
+struct Connection;
+
+// Queue `conn` on this thread's SendBatch, if a pass is open. Below.
+inline bool deferSend(Connection* conn);
+
+inline long long reactorNowUs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+struct Connection {
+    int fd;          // for a same-host client, the Unix socket: only its hangup matters
+    int epoll_fd;    // the reactor that owns this connection
+    ShmEndpoint* shm;   // same-host client: frames go through shared memory
+    bool named;      // first message (the player name) already received
+    void* context;   // owned by the handler, e.g. the room the player is in
+    uint32_t slot;   // also the handler's, e.g. the player's slot in that room
+    FrameBuffer in;  // bytes received but not yet dispatched as frames
+    long long recv_us;   // monotonic time the frames being dispatched were read
+    std::atomic<bool> reading_paused;
+    std::atomic<bool> recv_armed;   // a multishot receive is posted
+    
+    // Outbound queue. Any thread may send(); the owning reactor flushes the
+    // rest when the socket turns writable again.
+    pthread_mutex_t out_mutex = PTHREAD_MUTEX_INITIALIZER;
+    std::deque<FramePtr> out_queue;
+    size_t out_offset;   // bytes of the front frame already written
+    size_t out_bytes;    // bytes queued and not yet written
+    bool evicted;
+    bool close_when_flushed;
+    bool closed;         // the reactor has let go; later sends are dropped
+    bool sending;        // an io_uring write of the queue's front is in flight
+    
+    // The reactor holds one reference; a handler that keeps the connection
+    // past onClose (e.g. until a game thread catches up) takes its own
+    std::atomic<int> refs;
+    
+    Connection(int s, int ep)
+        : fd(s), epoll_fd(ep), shm(nullptr), named(false), context(nullptr), slot(0), recv_us(0), reading_paused(false),
+          recv_armed(false), out_offset(0), out_bytes(0), evicted(false), close_when_flushed(false), closed(false),
+          sending(false), refs(1) {}
+    
+    void retain() { refs.fetch_add(1, std::memory_order_relaxed); }
+    
+    // The last reference closes the socket, so nobody still holding the
+    // connection can write to a recycled fd
+    void release() {
+        if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            close(fd);
+            delete shm;
+            delete this;
+        }
+    }
+    
+    // Queue a frame without blocking. The first frame on an empty queue is
+    // written straight away, or at the end of the thread's SendBatch;
+    // anything behind it waits for EPOLLOUT. Returns false when the peer has
+    // fallen too far behind and was evicted.
+    bool send(const FramePtr& frame) {
+        pthread_mutex_lock(&out_mutex);
+        if (closed) {
+            pthread_mutex_unlock(&out_mutex);
+            return true;   // the handler has been told through onClose
+        }
+        if (evicted) {
+            pthread_mutex_unlock(&out_mutex);
+            return false;
+        }
+        
+        out_queue.push_back(frame);
+        out_bytes += frame->size();
+        metricAdd(MESSAGES_OUT);
+        if (out_queue.size() == 1 && !deferSend(this)) flushLocked();
+        
+        if (out_bytes > OUT_EVICT_LIMIT) {
+            evicted = true;
+            metricAdd(EVICTIONS);
+            out_queue.clear();
+            out_bytes = 0;
+            shutdown(fd, SHUT_RDWR);   // the reactor sees the hangup and closes
+            pthread_mutex_unlock(&out_mutex);
+            return false;
+        }
+        if (out_bytes > OUT_HIGH_WATERMARK) reading_paused = true;
+        
+        pthread_mutex_unlock(&out_mutex);
+        return true;
+    }
+    
+    // Called by the owning reactor on EPOLLOUT
+    void flush() {
+        pthread_mutex_lock(&out_mutex);
+        flushLocked();
+        pthread_mutex_unlock(&out_mutex);
+    }
+    
+    // Hang up once everything queued so far has been written
+    void closeWhenFlushed() {
+        pthread_mutex_lock(&out_mutex);
+        close_when_flushed = true;
+        if (out_queue.empty()) shutdown(fd, SHUT_RDWR);
+        pthread_mutex_unlock(&out_mutex);
+    }
+
+private:
+    friend class SendBatch;
+    
+    void flushLocked() {
+        if (closed || sending) return;
+        if (fd < 0) {
+            // Replay: no socket behind it, so everything counts as written
+            metricAdd(BYTES_OUT, out_bytes);
+            out_queue.clear();
+            out_bytes = 0;
+            out_offset = 0;
+            return;
+        }
+        while (!out_queue.empty()) {
+            iovec iov[OUT_MAX_IOV];
+            int count = queuedIov(iov);
+            msghdr msg{};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = count;
+            ssize_t n;
+            if (shm) {
+                n = shm->send(iov, count);
+            } else {
+                n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+                metricAdd(IO_WRITES);
+            }
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                broken();
+                return;
+            }
+            wrote(n);
+        }
+        flushedLocked();
+    }
+    
+    // The front of the queue as iovecs, up to OUT_MAX_IOV frames
+    int queuedIov(iovec* iov) const {
+        int count = 0;
+        size_t offset = out_offset;
+        for (auto it = out_queue.begin(); it != out_queue.end() && count < OUT_MAX_IOV; ++it) {
+            iov[count].iov_base = (void*)((*it)->data() + offset);
+            iov[count].iov_len = (*it)->size() - offset;
+            offset = 0;
+            count++;
+        }
+        return count;
+    }
+    
+    // n bytes off the front of the queue went out
+    void wrote(size_t n) {
+        out_bytes -= n;
+        metricAdd(BYTES_OUT, n);
+        size_t left = n;
+        while (left > 0) {
+            size_t remaining = out_queue.front()->size() - out_offset;
+            if (left >= remaining) {
+                left -= remaining;
+                out_queue.pop_front();
+                out_offset = 0;
+            } else {
+                out_offset += left;
+                left = 0;
+            }
+        }
+    }
+    
+    // Broken connection: the reactor will see it on the read side. A ring
+    // the peer corrupted raises no event of its own, so hang up on it.
+    void broken() {
+        out_queue.clear();
+        out_bytes = 0;
+        out_offset = 0;
+        if (shm) shutdown(fd, SHUT_RDWR);
+    }
+    
+    // After a write: let reading resume, or hang up, if it is time
+    void flushedLocked() {
+        if (reading_paused && out_bytes <= OUT_LOW_WATERMARK) {
+            // Re-arming an edge-triggered fd reports input that arrived
+            // while reading was paused
+            reading_paused = false;
+            epoll_event ev{};
+            ev.events = recv_armed ? URING_CONNECTION_EVENTS : CONNECTION_EVENTS;
+            ev.data.ptr = this;
+            epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+        }
+        
+        if (close_when_flushed && out_queue.empty()) shutdown(fd, SHUT_RDWR);
+    }
+};
+
+// The writes of one pass (a reactor wakeup, a worker's round of rooms, a
+// spectator batch), held until it ends. A connection whose queue goes from
+// empty to one frame is put here instead of written to, and whatever else
+// it is sent during the pass joins the queue; at the end each connection
+// gets one writev for all of it. With io_uring, all of those writes go to
+// the kernel in one submission. Only the outermost batch on a thread
+// counts, and with -O direct there are none.
+class SendBatch {
+private:
+    // One connection's write while the kernel has it
+    struct UringWrite {
+        Connection* conn;
+        msghdr msg;
+        iovec iov[OUT_MAX_IOV];
+        std::vector<FramePtr> pinned;   // a close may empty the queue meanwhile
+    };
+    
+    bool outermost;
+    std::vector<Connection*> conns;
+    
+    static inline thread_local SendBatch* current = nullptr;
+
+public:
+    SendBatch() : outermost(io_backend != IO_DIRECT && current == nullptr) {
+        if (outermost) current = this;
+    }
+    
+    ~SendBatch() {
+        if (!outermost) return;
+        current = nullptr;
+        if (io_backend != IO_URING || !submitAll()) {
+            for (Connection* conn : conns) {
+                conn->flush();
+                conn->release();
+            }
+        }
+        conns.clear();
+    }
+    
+    SendBatch(const SendBatch&) = delete;
+    SendBatch& operator=(const SendBatch&) = delete;
+    
+    // Under the connection's out_mutex. False when there is no batch to
+    // join, or nothing to gain (no socket), and the caller writes now.
+    static bool defer(Connection* conn) {
+        if (current == nullptr || conn->fd < 0) return false;
+        conn->retain();
+        current->conns.push_back(conn);
+        return true;
+    }
+
+private:
+    // This thread's ring for writes, made on first use; nullptr if io_uring
+    // is not to be had
+    static IoUring* sendRing() {
+        static thread_local IoUring* ring = [] {
+            IoUring* made = new IoUring();
+            std::string error;
+            if (made->init(URING_ENTRIES, error)) return made;
+            fprintf(stderr, "%s; writing without it\n", error.c_str());
+            delete made;
+            return (IoUring*)nullptr;
+        }();
+        return ring;
+    }
+    
+    // A SENDMSG per connection, as many as the ring holds per submission,
+    // each submission also waiting for its completions. MSG_DONTWAIT makes
+    // a full socket come back as EAGAIN instead of parking in the kernel,
+    // so they are all in when io_uring_enter returns.
+    bool submitAll() {
+        IoUring* ring = sendRing();
+        if (ring == nullptr) return false;
+        static thread_local std::vector<UringWrite> writes(ring->capacity());
+        
+        size_t next = 0;
+        while (next < conns.size()) {
+            unsigned count = 0;
+            for (; next < conns.size() && count < ring->capacity(); ++next) {
+                Connection* conn = conns[next];
+                UringWrite& w = writes[count];
+                pthread_mutex_lock(&conn->out_mutex);
+                bool ready = !conn->shm && !conn->closed && !conn->evicted && !conn->sending &&
+                             !conn->out_queue.empty();
+                if (conn->shm) conn->flushLocked();   // a memory copy, nothing to submit
+                if (ready) {
+                    int iovs = conn->queuedIov(w.iov);
+                    w.pinned.assign(conn->out_queue.begin(), conn->out_queue.begin() + iovs);
+                    w.msg = msghdr{};
+                    w.msg.msg_iov = w.iov;
+                    w.msg.msg_iovlen = iovs;
+                    conn->sending = true;
+                }
+                pthread_mutex_unlock(&conn->out_mutex);
+                if (!ready) {
+                    conn->release();
+                    continue;
+                }
+                
+                w.conn = conn;
+                io_uring_sqe* sqe = ring->prepare();
+                sqe->opcode = IORING_OP_SENDMSG;
+                sqe->fd = conn->fd;
+                sqe->addr = (uint64_t)(uintptr_t)&w.msg;
+                sqe->len = 1;
+                sqe->msg_flags = MSG_NOSIGNAL | MSG_DONTWAIT;
+                sqe->user_data = count;
+                count++;
+            }
+            
+            unsigned reaped = 0;
+            while (reaped < count) {
+                int n = ring->submit(count - reaped);
+                if (n < 0 && n != -EAGAIN && n != -EBUSY) {
+                    fprintf(stderr, "io_uring_enter: %s\n", strerror(-n));
+                    abort();   // writes in flight we can no longer account for
+                }
+                for (io_uring_cqe* cqe; (cqe = ring->peek()) != nullptr; ring->advance()) {
+                    finish(writes[cqe->user_data], cqe->res);
+                    reaped++;
+                }
+            }
+        }
+        return true;
+    }
+    
+    static void finish(UringWrite& w, int res) {
+        Connection* conn = w.conn;
+        pthread_mutex_lock(&conn->out_mutex);
+        conn->sending = false;
+        if (!conn->closed && !conn->evicted) {
+            if (res >= 0 || res == -EAGAIN || res == -EINTR) {
+                if (res > 0) conn->wrote(res);
+                // The rest, if it did not all fit; an EPOLLOUT that came
+                // while the write was out was ignored, so try once more
+                conn->flushLocked();
+            } else {
+                conn->broken();
+            }
+        }
+        pthread_mutex_unlock(&conn->out_mutex);
+        w.pinned.clear();
+        conn->release();
+    }
+};
+
+inline bool deferSend(Connection* conn) {
+    return SendBatch::defer(conn);
+}
+
+// Callbacks the reactor drives. They run on the reactor thread that owns the
+// connection, so they must not block.
+class ReactorHandler {
+public:
+    virtual ~ReactorHandler() {}
+    // message is a view into the connection's receive buffer and is only
+    // valid for the duration of the call; conn->recv_us says when it arrived
+    virtual void onMessage(Connection* conn, std::string_view message) = 0;
+    virtual void onClose(Connection* conn) = 0;
+};
+
+// Edge-triggered epoll event loop over non-blocking sockets. Every reactor
+// binds its own SO_REUSEPORT listening socket, so with N reactors the kernel
+// spreads accepts across N threads and a connection stays on the thread that
+// accepted it for its whole life. One of them may also take same-host
+// clients on a Unix socket and talk to them through shared memory.
+//
+// With -O uring a reactor also has an io_uring, registered in its epoll set
+// like a socket. Each connection gets one multishot receive on its first
+// event; from then on its input arrives as completions, many per wakeup,
+// copied out of the ring's provided buffers, and epoll only watches it for
+// room to write.
+class Reactor {
+private:
+    int epoll_fd;
+    int listen_fd;
+    int local_fd;      // Unix listener for same-host clients, or -1
+    std::string local_path;
+    ReactorHandler* handler;
+    IoUring* ring;     // -O uring only
+    IoBufferRing* buffers;
+
+public:
+    Reactor(ReactorHandler* h)
+        : epoll_fd(-1), listen_fd(-1), local_fd(-1), handler(h), ring(nullptr), buffers(nullptr) {}
+    
+    ~Reactor() {
+        delete buffers;
+        delete ring;
+        if (listen_fd >= 0) close(listen_fd);
+        if (local_fd >= 0) {
+            close(local_fd);
+            unlink(local_path.c_str());
+        }
+        if (epoll_fd >= 0) close(epoll_fd);
+    }
+    
+    // Just the epoll instance (and the ring), for a reactor that only
+    // serves connections handed to it (adopt); listenOn calls it
+    bool init() {
+        epoll_fd = epoll_create1(0);
+        if (epoll_fd < 0) {
+            perror("epoll_create1");
+            return false;
+        }
+        if (io_backend != IO_URING) return true;
+        
+        std::string error;
+        ring = new IoUring();
+        buffers = new IoBufferRing();
+        if (!ring->init(URING_ENTRIES, error, URING_COMPLETIONS) ||
+            !buffers->init(*ring, URING_BUFFER_GROUP, URING_RECV_BUFFERS, URING_RECV_BUFFER_SIZE, error)) {
+            fprintf(stderr, "%s\n", error.c_str());
+            return false;
+        }
+        // data.ptr == ring marks it; level-triggered, readable while
+        // completions are waiting
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.ptr = ring;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ring->fd(), &ev) < 0) {
+            perror("epoll_ctl (io_uring)");
+            return false;
+        }
+        return true;
+    }
+    
+    bool listenOn(int port) {
+        listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (listen_fd < 0) {
+            perror("socket");
+            return false;
+        }
+        
+        int opt = 1;
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
+        
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = INADDR_ANY;
+        addr.sin_port = htons(port);
+        
+        if (bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+            perror("bind");
+            return false;
+        }
+        
+        if (listen(listen_fd, SOMAXCONN) < 0) {
+            perror("listen");
+            return false;
+        }
+        
+        if (!init()) return false;
+        
+        // data.ptr == nullptr marks the listening socket
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.ptr = nullptr;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) < 0) {
+            perror("epoll_ctl");
+            return false;
+        }
+        return true;
+    }
+    
+    // Also accept same-host clients on a Unix socket at `path`. After
+    // listenOn; a stale socket file from an earlier run is replaced.
+    bool listenLocal(const char* path) {
+        sockaddr_un addr{};
+        if (strlen(path) >= sizeof(addr.sun_path)) {
+            fprintf(stderr, "local socket path too long: %s\n", path);
+            return false;
+        }
+        local_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (local_fd < 0) {
+            perror("socket (local)");
+            return false;
+        }
+        
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, path);
+        unlink(path);
+        if (bind(local_fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+            perror("bind (local)");
+            return false;
+        }
+        local_path = path;
+        if (listen(local_fd, SOMAXCONN) < 0) {
+            perror("listen (local)");
+            return false;
+        }
+        
+        // data.ptr == &local_fd marks the Unix listener
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.ptr = &local_fd;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, local_fd, &ev) < 0) {
+            perror("epoll_ctl");
+            return false;
+        }
+        return true;
+    }
+    
+    // Take on a socket as if it had been accepted here: one we connected
+    // ourselves (a relay's upstream, say) or one another process accepted
+    // (router.h). Its frames may be dispatched before adopt returns, so a
+    // caller that sets the connection's context first calls it on this
+    // reactor's thread, from a handler callback; one that leaves the
+    // connection to the handler, like an accepted one, may call it from
+    // any thread.
+    Connection* adopt(int fd) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        int opt = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+        
+        Connection* conn = new Connection(fd, epoll_fd);
+        epoll_event ev{};
+        ev.events = CONNECTION_EVENTS;
+        ev.data.ptr = conn;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            perror("epoll_ctl");
+            conn->release();
+            return nullptr;
+        }
+        metricAdd(CONNECTIONS_OPENED);
+        return conn;
+    }
+    
+    void run() {
+        epoll_event events[REACTOR_MAX_EVENTS];
+        
+        while (true) {
+            int n = epoll_wait(epoll_fd, events, REACTOR_MAX_EVENTS, -1);
+            metricAdd(IO_WAITS);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                perror("epoll_wait");
+                return;
+            }
+            
+            // Replies the handler sends go out once per connection, after
+            // every event of this wakeup has been dealt with. Each connection
+            // is held until then: a shared memory client has two events, and
+            // the first may close it.
+            SendBatch batch;
+            Connection* held[REACTOR_MAX_EVENTS];
+            int holding = 0;
+            for (int i = 0; i < n; ++i) {
+                Connection* conn = eventConnection(events[i]);
+                if (conn != nullptr) {
+                    conn->retain();
+                    held[holding++] = conn;
+                }
+            }
+            for (int i = 0; i < n; ++i) {
+                if (events[i].data.ptr == nullptr) {
+                    acceptAll();
+                    continue;
+                }
+                if (events[i].data.ptr == ring) {
+                    continue;   // reaped below, after the sockets
+                }
+                if (events[i].data.ptr == &local_fd) {
+                    acceptLocal();
+                    continue;
+                }
+                
+                Connection* conn = eventConnection(events[i]);
+                uint32_t ev = events[i].events;
+                if (conn->closed) continue;
+                if (conn->shm != nullptr) {
+                    // The doorbell means input, or room for output; the
+                    // Unix socket only ever reports the client leaving
+                    if ((uintptr_t)events[i].data.ptr & BELL_TAG) {
+                        conn->flush();
+                        readAll(conn, false);
+                    } else {
+                        readAll(conn, true);
+                    }
+                    continue;
+                }
+                if (ring != nullptr) {
+                    uringEvent(conn, ev);
+                    continue;
+                }
+                if (ev & EPOLLOUT) {
+                    conn->flush();
+                }
+                if (ev & (EPOLLERR | EPOLLHUP)) {
+                    readAll(conn, true); // drain what is left, then close
+                } else if (ev & EPOLLRDHUP) {
+                    readAll(conn, false);   // on to the end of the stream
+                } else if (ev & EPOLLIN) {
+                    readAll(conn, false, io_backend != IO_DIRECT);
+                }
+            }
+            if (ring != nullptr) reapRing();
+            for (int i = 0; i < holding; ++i) held[i]->release();
+        }
+    }
+    
+    static void* threadMain(void* arg) {
+        static_cast<Reactor*>(arg)->run();
+        return nullptr;
+    }
+
+private:
+    // The connection an event is for, or nullptr for the listeners and
+    // the ring
+    Connection* eventConnection(const epoll_event& event) const {
+        void* ptr = event.data.ptr;
+        if (ptr == nullptr || ptr == ring || ptr == &local_fd) return nullptr;
+        return (Connection*)((uintptr_t)ptr & ~BELL_TAG);
+    }
+    
+    // Edge-triggered: keep accepting until the backlog is empty
+    void acceptAll() {
+        while (true) {
+            int client_socket = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (client_socket < 0) {
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept4");
+                return;
+            }
+            
+            int opt = 1;
+            setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+            
+            Connection* conn = new Connection(client_socket, epoll_fd);
+            epoll_event ev{};
+            ev.events = CONNECTION_EVENTS;
+            ev.data.ptr = conn;
+            if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_socket, &ev) < 0) {
+                perror("epoll_ctl");
+                close(client_socket);
+                delete conn;
+                continue;
+            }
+            metricAdd(CONNECTIONS_OPENED);
+        }
+    }
+    
+    // Same as acceptAll, plus the shared memory handshake. The connection is
+    // registered twice: its doorbell for traffic (tagged BELL_TAG), its
+    // socket for hangups.
+    void acceptLocal() {
+        while (true) {
+            int client_socket = accept4(local_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (client_socket < 0) {
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept4 (local)");
+                return;
+            }
+            
+            ShmEndpoint* shm = shmAccept(client_socket);
+            if (shm == nullptr) {
+                perror("shared memory handshake");
+                close(client_socket);
+                continue;
+            }
+            
+            Connection* conn = new Connection(client_socket, epoll_fd);
+            conn->shm = shm;
+            epoll_event ev{};
+            ev.events = EPOLLRDHUP | EPOLLET;
+            ev.data.ptr = conn;
+            epoll_event bell{};
+            bell.events = EPOLLIN | EPOLLET;
+            bell.data.ptr = (void*)((uintptr_t)conn | BELL_TAG);
+            if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_socket, &ev) < 0 ||
+                epoll_ctl(epoll_fd, EPOLL_CTL_ADD, shm->bell(), &bell) < 0) {
+                perror("epoll_ctl");
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client_socket, nullptr);
+                conn->release();
+                continue;
+            }
+            metricAdd(CONNECTIONS_OPENED);
+        }
+    }
+    
+    // Edge-triggered: drain the socket (or the client's ring) until it
+    // reports EAGAIN, handing every complete frame to the handler as soon
+    // as it is in the buffer. With `once`, a read that comes back short of
+    // the buffer counts as the socket being empty, which saves the read
+    // that would only say EAGAIN; new input raises a new edge anyway.
+    // A peer with too much unsent output is not read until it catches up.
+    void readAll(Connection* conn, bool hangup, bool once = false) {
+        while (true) {
+            if (conn->closed) return;
+            if (conn->reading_paused && !hangup) return;
+            
+            bool drained = false;
+            ssize_t n;
+            if (conn->shm) {
+                n = conn->shm->receive(conn->in, hangup);
+            } else {
+                n = conn->in.readFrom(conn->fd, &drained);
+                metricAdd(IO_READS);
+            }
+            if (n > 0) {
+                // Stamped before parsing, so queueing behind other frames
+                // and connections counts as server delay, not player time
+                conn->recv_us = reactorNowUs();
+                metricAdd(BYTES_IN, n);
+                if (!dispatchFrames(conn)) {
+                    closeConnection(conn);
+                    return;
+                }
+                if (once && drained) return;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+            
+            closeConnection(conn);
+            return;
+        }
+    }
+    
+    // False when the peer sent a frame we refuse to parse. Until the handler
+    // has its first message, frames are held to FIRST_FRAME_MAX, so a peer
+    // nobody knows yet cannot make us buffer a megabyte.
+    bool dispatchFrames(Connection* conn) {
+        std::string_view message;
+        while (true) {
+            switch (conn->in.nextFrame(message, conn->named ? MAX_FRAME_SIZE : FIRST_FRAME_MAX)) {
+                case FrameBuffer::FRAME_OK:
+                    metricAdd(MESSAGES_IN);
+                    handler->onMessage(conn, message);
+                    break;
+                case FrameBuffer::FRAME_INCOMPLETE:
+                    return true;
+                case FrameBuffer::FRAME_ERROR:
+                    return false;
+            }
+        }
+    }
+    
+    // An event on a connection of an io_uring reactor. The first one posts
+    // its receive; after that only room to write, or input held back while
+    // the peer was paused, is left to see to here.
+    void uringEvent(Connection* conn, uint32_t ev) {
+        if (!conn->recv_armed) {
+            armReceive(conn);
+            epoll_event mod{};
+            mod.events = URING_CONNECTION_EVENTS;
+            mod.data.ptr = conn;
+            epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &mod);
+        }
+        if (ev & EPOLLOUT) conn->flush();
+        if (!conn->reading_paused && conn->in.size() > 0 && !dispatchFrames(conn)) closeConnection(conn);
+    }
+    
+    // A multishot receive for `conn`, which holds a reference on it until
+    // its last completion
+    void armReceive(Connection* conn) {
+        io_uring_sqe* sqe = nextSqe();
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = conn->fd;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = URING_BUFFER_GROUP;
+        sqe->user_data = (uint64_t)(uintptr_t)conn;
+        conn->retain();
+        conn->recv_armed = true;
+    }
+    
+    io_uring_sqe* nextSqe() {
+        io_uring_sqe* sqe = ring->prepare();
+        if (sqe != nullptr) return sqe;
+        ring->submit();
+        return ring->prepare();
+    }
+    
+    // Every completion in, the receives' buffers given back, and whatever
+    // that prepared (receives to post again, cancels) submitted, along with
+    // any completions that overflowed the ring, until there is nothing
+    // left: one io_uring_enter for the lot, usually
+    void reapRing() {
+        while (true) {
+            for (io_uring_cqe* cqe; (cqe = ring->peek()) != nullptr; ring->advance()) {
+                Connection* conn = (Connection*)(uintptr_t)cqe->user_data;
+                if (conn != nullptr) received(conn, cqe->res, cqe->flags);
+            }
+            buffers->publish();
+            if (ring->pending() == 0 && !ring->overflowed()) return;
+            ring->submit();
+        }
+    }
+    
+    void received(Connection* conn, int res, uint32_t flags) {
+        bool last = !(flags & IORING_CQE_F_MORE);
+        if (last) conn->recv_armed = false;
+        if (res > 0) {
+            uint16_t id = flags >> IORING_CQE_BUFFER_SHIFT;
+            conn->in.append(buffers->data(id), res);
+            buffers->recycle(id);
+        }
+        
+        if (!conn->closed) {
+            if (res > 0) {
+                conn->recv_us = reactorNowUs();
+                metricAdd(BYTES_IN, res);
+                // A paused peer's input waits in its buffer (uringEvent
+                // picks it up on resume), up to a limit
+                if (conn->reading_paused ? conn->in.size() > OUT_EVICT_LIMIT : !dispatchFrames(conn)) {
+                    closeConnection(conn);
+                }
+            } else if (res == -ENOBUFS) {
+                // Every buffer was taken; the ones reaped so far are back
+            } else {
+                closeConnection(conn);   // the end of the stream, or an error
+            }
+            if (last && !conn->closed) armReceive(conn);
+        }
+        if (last) conn->release();
+    }
+    
+    void closeConnection(Connection* conn) {
+        if (conn->recv_armed) {
+            io_uring_sqe* sqe = nextSqe();
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = (uint64_t)(uintptr_t)conn;
+            sqe->user_data = 0;
+        }
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, nullptr);
+        if (conn->shm) epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->shm->bell(), nullptr);
+        metricAdd(CONNECTIONS_CLOSED);
+        pthread_mutex_lock(&conn->out_mutex);
+        conn->closed = true;
+        conn->out_queue.clear();
+        conn->out_bytes = 0;
+        pthread_mutex_unlock(&conn->out_mutex);
+        
+        handler->onClose(conn);
+        conn->release();
+    }
+};
+
+#endif
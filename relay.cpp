@@ -0,0 +1,225 @@
+// Spectator relay. Viewers connect here instead of to the game server; for
+// every room somebody watches, the relay holds one upstream WATCH
+// connection to the server (or to another relay) and fans what comes down
+// it out to its own viewers through a SpectatorHub (spectator.h). The
+// server sends each frame once per relay, not once per viewer, and relays
+// chain, so the audience can grow a tier at a time.
+//
+// Viewers speak the same protocol as with the server: WATCH|room, then the
+// room's broadcasts, then a hangup when the game is over. The upstream
+// stays up until then.
+//
+//   g++ -O2 -std=c++17 relay.cpp -o relay -pthread
+//   ./relay -s 127.0.0.1 -p 8080 -l 8081
+//   ./client -s 127.0.0.1 -p 8081 -w 3
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <cstdlib>
+#include <csignal>
+#include <unistd.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include "protocol.h"
+#include "schema.h"
+#include "reactor.h"
+#include "spectator.h"
+
+#define DEFAULT_UPSTREAM_IP "127.0.0.1"
+#define DEFAULT_UPSTREAM_PORT 8080
+#define DEFAULT_RELAY_PORT 8081
+#define DEFAULT_REACTOR_THREADS 1
+
+// One room's feed from upstream; the upstream connection's context
+struct Upstream {
+    int room;
+    std::shared_ptr<SpectatorChannel> channel;
+};
+
+class Relay {
+private:
+    SpectatorHub& hub;
+    sockaddr_in upstream_addr;
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    std::unordered_map<int, Connection*> upstreams;   // by room
+
+public:
+    Relay(SpectatorHub& h, const sockaddr_in& addr) : hub(h), upstream_addr(addr) {}
+    
+    bool isViewer(const Connection* conn) const { return conn->context == &hub; }
+    
+    // Reactor thread: a viewer asked for `room`. The first one dials
+    // upstream, on the viewer's own reactor.
+    void watch(Connection* conn, int room, Reactor* reactor) {
+        pthread_mutex_lock(&mutex);
+        bool ok = upstreams.count(room) > 0 || dial(room, reactor);
+        pthread_mutex_unlock(&mutex);
+        
+        if (!ok || !hub.subscribe(conn, room)) {
+            conn->send(refusal(ok ? "no such game" : "upstream unreachable"));
+            conn->closeWhenFlushed();
+        }
+    }
+    
+    // Everything upstream sends is published as it came; the end of the
+    // game, or a refusal, closes the room for the viewers
+    void fromUpstream(Connection* conn, std::string_view message) {
+        Upstream* up = static_cast<Upstream*>(conn->context);
+        up->channel->publish(makeFrame(message));
+        std::string_view type = messageType(message);
+        if (type == WatchFinalSchema::type || type == WatchFailedSchema::type) {
+            up->channel->close();
+            conn->closeWhenFlushed();
+        }
+    }
+    
+    void viewerClosed(Connection* conn) {
+        hub.unsubscribe(conn);
+    }
+    
+    void upstreamClosed(Connection* conn) {
+        Upstream* up = static_cast<Upstream*>(conn->context);
+        pthread_mutex_lock(&mutex);
+        auto it = upstreams.find(up->room);
+        if (it != upstreams.end() && it->second == conn) upstreams.erase(it);
+        pthread_mutex_unlock(&mutex);
+        up->channel->close();
+        delete up;
+    }
+
+private:
+    static FramePtr refusal(const char* reason) {
+        char buffer[128];
+        MessageWriter w(buffer, sizeof(buffer));
+        w.message<WatchFailedSchema>(reason);
+        return shareFrame(w.frame());
+    }
+    
+    // Under mutex. A blocking connect, once per room, then the upstream
+    // is an ordinary connection of `reactor`.
+    bool dial(int room, Reactor* reactor) {
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) return false;
+        char buffer[64];
+        MessageWriter w(buffer, sizeof(buffer));
+        w.message<WatchSchema>(room);
+        if (connect(fd, (sockaddr*)&upstream_addr, sizeof(upstream_addr)) < 0 || !sendFrame(fd, w.payload())) {
+            close(fd);
+            return false;
+        }
+        
+        // Open before any frame can arrive, so nothing is published into
+        // a room that does not exist yet
+        std::shared_ptr<SpectatorChannel> channel = hub.open(room);
+        Connection* conn = reactor->adopt(fd);
+        if (conn == nullptr) {
+            channel->close();
+            return false;
+        }
+        conn->named = true;
+        conn->context = new Upstream{room, channel};
+        upstreams[room] = conn;
+        return true;
+    }
+};
+
+// One per reactor, so a viewer's upstream lands on the viewer's thread
+class RelayHandler : public ReactorHandler {
+private:
+    Relay& relay;
+
+public:
+    Reactor* reactor;
+    
+    RelayHandler(Relay& r) : relay(r), reactor(nullptr) {}
+    
+    void onMessage(Connection* conn, std::string_view message) override {
+        if (!conn->named) {
+            conn->named = true;
+            Decoded<WatchSchema> watch;
+            if (watch.parse(message) && watch.complete()) {
+                relay.watch(conn, watch.get<WatchSchema::ROOM>(), reactor);
+            } else {
+                conn->closeWhenFlushed();   // only viewers here
+            }
+            return;
+        }
+        if (conn->context != nullptr && !relay.isViewer(conn)) relay.fromUpstream(conn, message);
+    }
+    
+    void onClose(Connection* conn) override {
+        if (relay.isViewer(conn)) {
+            relay.viewerClosed(conn);
+        } else if (conn->context != nullptr) {
+            relay.upstreamClosed(conn);
+        }
+    }
+};
+
+void usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [-s upstream_ip] [-p upstream_port] [-l listen_port]"
+              << " [-t reactor_threads] [-V spectator_threads]" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    const char* upstream_ip = DEFAULT_UPSTREAM_IP;
+    int upstream_port = DEFAULT_UPSTREAM_PORT;
+    int listen_port = DEFAULT_RELAY_PORT;
+    int reactor_threads = DEFAULT_REACTOR_THREADS;
+    int spectator_threads = DEFAULT_SPECTATOR_SHARDS;
+    
+    int opt;
+    while ((opt = getopt(argc, argv, "s:p:l:t:V:h")) != -1) {
+        switch (opt) {
+            case 's': upstream_ip = optarg; break;
+            case 'p': upstream_port = atoi(optarg); break;
+            case 'l': listen_port = atoi(optarg); break;
+            case 't': reactor_threads = atoi(optarg); break;
+            case 'V': spectator_threads = atoi(optarg); break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    
+    sockaddr_in upstream{};
+    upstream.sin_family = AF_INET;
+    upstream.sin_port = htons(upstream_port);
+    if (inet_pton(AF_INET, upstream_ip, &upstream.sin_addr) != 1 || upstream_port < 1 || upstream_port > 65535 ||
+        listen_port < 1 || listen_port > 65535 || reactor_threads < 1 || spectator_threads < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    
+    signal(SIGPIPE, SIG_IGN);
+    
+    SpectatorHub hub(spectator_threads);
+    hub.start();
+    Relay relay(hub, upstream);
+    
+    std::vector<Reactor*> reactors;
+    for (int i = 0; i < reactor_threads; ++i) {
+        RelayHandler* handler = new RelayHandler(relay);
+        handler->reactor = new Reactor(handler);
+        if (!handler->reactor->listenOn(listen_port)) {
+            return 1;
+        }
+        reactors.push_back(handler->reactor);
+    }
+    
+    std::cout << "Spectator relay on port " << listen_port << " for " << upstream_ip << ":" << upstream_port
+              << " (" << reactor_threads << " reactor thread(s), " << spectator_threads << " fan-out thread(s))"
+              << std::endl;
+    
+    for (size_t i = 1; i < reactors.size(); ++i) {
+        pthread_t tid;
+        pthread_create(&tid, nullptr, Reactor::threadMain, reactors[i]);
+        pthread_detach(tid);
+    }
+    reactors[0]->run();
+    return 0;
+}
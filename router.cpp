@@ -0,0 +1,459 @@
+// Front-door router: one port, any number of game-server processes behind
+// it (router.h). Clients connect here exactly as they would to the server;
+// game servers started with -B register on the router's Unix socket and
+// are passed their clients' sockets from then on.
+//
+// One thread. A new client's first frame is peeked at (MSG_PEEK), never
+// read, so the server gets it as if the client had just sent it. A RESUME
+// or WATCH goes to the server whose slot its room lies in; a name goes to
+// the server filling a room, then to the least loaded one. Sockets bound
+// for the same server in one wakeup travel in one packet.
+//
+//   g++ -O2 -std=c++17 router.cpp -o router -pthread
+//   ./router -l 8080 -B /tmp/hulaan-router.sock
+//   ./server -B /tmp/hulaan-router.sock -m 0
+//   ./server -B /tmp/hulaan-router.sock -m 0
+//   kill -TERM <pid of the first server>   (it finishes its games and exits)
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <cstdlib>
+#include <csignal>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <time.h>
+#include "protocol.h"
+#include "schema.h"
+#include "router.h"
+
+#define PORT 8080
+#define ROUTER_PENDING_TIMEOUT_MS 5000  // for a client to send its first frame
+#define ROUTER_TICK_MS 500
+
+static long long nowMs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+// What an epoll event points at, besides the two listeners
+struct Peer {
+    int fd;
+    bool backend;
+    
+    Peer(int f, bool b) : fd(f), backend(b) {}
+};
+
+// Accepted, first frame not in yet. fd is -1 once it has been passed on or
+// dropped; the object itself goes when it reaches the front of the queue.
+struct Client : Peer {
+    long long accepted_ms;
+    
+    Client(int f, long long now) : Peer(f, false), accepted_ms(now) {}
+};
+
+struct Backend : Peer {
+    int slot;                 // -1 until it has said BACKEND
+    int room_size;
+    int connections;          // as of its last LOAD
+    int handed;               // new players passed since then
+    bool draining;
+    bool drain_ack;           // owes it a DRAIN once the queue is out
+    std::vector<int> queued;  // sockets waiting for room on the control socket
+    
+    Backend(int f) : Peer(f, true), slot(-1), room_size(1), connections(0), handed(0), draining(false),
+                     drain_ack(false) {}
+    
+    int load() const { return connections + handed; }
+};
+
+class Router {
+private:
+    int epoll_fd;
+    int listen_fd;
+    int control_fd;
+    std::string control_path;
+    std::vector<Backend*> slots;       // by slot
+    std::deque<Client*> pending;       // in accept order
+    std::vector<Backend*> to_flush;    // got sockets this wakeup
+    std::vector<Peer*> retired;        // freed after the wakeup that dropped them
+    Backend* filling;                  // taking new players until its room is full
+    int filling_left;
+
+public:
+    Router() : epoll_fd(-1), listen_fd(-1), control_fd(-1), slots(ROUTER_MAX_BACKENDS, nullptr),
+               filling(nullptr), filling_left(0) {}
+    
+    ~Router() {
+        if (control_fd >= 0) {
+            close(control_fd);
+            unlink(control_path.c_str());
+        }
+    }
+    
+    bool listen(int port, const char* path) {
+        epoll_fd = epoll_create1(0);
+        listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (epoll_fd < 0 || listen_fd < 0) {
+            perror("socket");
+            return false;
+        }
+        int opt = 1;
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = INADDR_ANY;
+        addr.sin_port = htons(port);
+        if (bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) < 0 || ::listen(listen_fd, SOMAXCONN) < 0) {
+            perror("bind");
+            return false;
+        }
+        
+        sockaddr_un local{};
+        if (strlen(path) >= sizeof(local.sun_path)) {
+            std::cerr << "router socket path too long: " << path << std::endl;
+            return false;
+        }
+        local.sun_family = AF_UNIX;
+        strcpy(local.sun_path, path);
+        control_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        unlink(path);
+        if (control_fd < 0 || bind(control_fd, (sockaddr*)&local, sizeof(local)) < 0 ||
+            ::listen(control_fd, SOMAXCONN) < 0) {
+            perror("bind (router socket)");
+            return false;
+        }
+        control_path = path;
+        
+        // data.ptr == nullptr marks the TCP listener, &control_fd the Unix one
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.ptr = nullptr;
+        epoll_event control{};
+        control.events = EPOLLIN | EPOLLET;
+        control.data.ptr = &control_fd;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) < 0 ||
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, control_fd, &control) < 0) {
+            perror("epoll_ctl");
+            return false;
+        }
+        return true;
+    }
+    
+    void run() {
+        epoll_event events[REACTOR_MAX_EVENTS];
+        while (true) {
+            int n = epoll_wait(epoll_fd, events, REACTOR_MAX_EVENTS, ROUTER_TICK_MS);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                perror("epoll_wait");
+                return;
+            }
+            for (int i = 0; i < n; ++i) {
+                if (events[i].data.ptr == nullptr) {
+                    acceptClients();
+                    continue;
+                }
+                if (events[i].data.ptr == &control_fd) {
+                    acceptBackends();
+                    continue;
+                }
+                Peer* peer = static_cast<Peer*>(events[i].data.ptr);
+                if (peer->fd < 0) continue;   // dropped earlier in this wakeup
+                if (peer->backend) {
+                    Backend* b = static_cast<Backend*>(peer);
+                    if (events[i].events & EPOLLOUT) flush(b);
+                    if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) readControl(b);
+                } else {
+                    route(static_cast<Client*>(peer));
+                }
+            }
+            
+            // One packet per server for everything this wakeup sent its way
+            for (Backend* b : to_flush) {
+                if (b->fd >= 0) flush(b);
+            }
+            to_flush.clear();
+            expire();
+            for (Peer* peer : retired) delete peer;
+            retired.clear();
+        }
+    }
+
+private:
+    void acceptClients() {
+        while (true) {
+            int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept4");
+                return;
+            }
+            Client* client = new Client(fd, nowMs());
+            epoll_event ev{};
+            ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+            ev.data.ptr = client;
+            if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+                perror("epoll_ctl");
+                close(fd);
+                delete client;
+                continue;
+            }
+            pending.push_back(client);
+        }
+    }
+    
+    void acceptBackends() {
+        while (true) {
+            int fd = accept4(control_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept4 (router socket)");
+                return;
+            }
+            Backend* b = new Backend(fd);
+            epoll_event ev{};
+            ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+            ev.data.ptr = b;
+            if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+                perror("epoll_ctl");
+                close(fd);
+                delete b;
+            }
+        }
+    }
+    
+    // The client's first frame, if it is all there yet, without taking it
+    // off the socket
+    void route(Client* client) {
+        char buffer[FRAME_HEADER_SIZE + FIRST_FRAME_MAX];
+        ssize_t n = recv(client->fd, buffer, sizeof(buffer), MSG_PEEK);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return;
+        if (n <= 0) {
+            drop(client);
+            return;
+        }
+        if (n < FRAME_HEADER_SIZE) return;
+        uint32_t len = getFrameHeader(buffer);
+        if (len > FIRST_FRAME_MAX) {
+            drop(client);
+            return;
+        }
+        if ((size_t)n < FRAME_HEADER_SIZE + len) return;
+        std::string_view first(buffer + FRAME_HEADER_SIZE, len);
+        
+        // A returning player or a viewer belongs to the room's server; the
+        // tests are the server's own (RoomManager::onMessage)
+        Decoded<ResumeSchema> resume;
+        Decoded<WatchSchema> watch;
+        bool resuming = resume.parse(first) && resume.complete() && resume.get<ResumeSchema::SLOT>() >= 0 &&
+                        resume.get<ResumeSchema::SECRET>() != 0;
+        bool watching = !resuming && watch.parse(first) && watch.complete();
+        if (resuming || watching) {
+            int room = resuming ? resume.get<ResumeSchema::ROOM>() : watch.get<WatchSchema::ROOM>();
+            int slot = room > 0 ? (room - 1) / ROUTER_ROOM_BLOCK : -1;
+            Backend* b = slot >= 0 && slot < ROUTER_MAX_BACKENDS ? slots[slot] : nullptr;
+            if (b == nullptr) {
+                refuse(client, watching, FRAME_HEADER_SIZE + len);
+                return;
+            }
+            handOver(client, b);
+            return;
+        }
+        
+        Backend* b = pickBackend();
+        if (b == nullptr) {
+            drop(client);   // nobody to play on
+            return;
+        }
+        b->handed++;
+        handOver(client, b);
+    }
+    
+    // New players fill one server's lobby a room at a time, then go to the
+    // least loaded server that is not draining
+    Backend* pickBackend() {
+        if (filling != nullptr && filling_left > 0) {
+            filling_left--;
+            return filling;
+        }
+        filling = nullptr;
+        for (Backend* b : slots) {
+            if (b != nullptr && !b->draining && (filling == nullptr || b->load() < filling->load())) filling = b;
+        }
+        if (filling != nullptr) filling_left = filling->room_size - 1;
+        return filling;
+    }
+    
+    void handOver(Client* client, Backend* b) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client->fd, nullptr);   // the server's copy stays registered here otherwise
+        b->queued.push_back(client->fd);
+        client->fd = -1;
+        if (b->queued.size() == 1) to_flush.push_back(b);
+    }
+    
+    // The room is not here (anymore): say so the way the server would,
+    // having read the frame, so the hangup is not a reset that loses it
+    void refuse(Client* client, bool watching, size_t frame_size) {
+        char buffer[FRAME_HEADER_SIZE + FIRST_FRAME_MAX];
+        recv(client->fd, buffer, frame_size, 0);
+        MessageWriter w(buffer, sizeof(buffer));
+        if (watching) {
+            w.message<WatchFailedSchema>("no such game");
+        } else {
+            w.message<ResumeFailedSchema>("no such game");
+        }
+        std::string_view frame = w.frame();
+        send(client->fd, frame.data(), frame.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+        shutdown(client->fd, SHUT_WR);
+        drop(client);
+    }
+    
+    void drop(Client* client) {
+        close(client->fd);   // also takes it out of epoll: nobody else has it
+        client->fd = -1;
+    }
+    
+    // Clients that never sent a first frame in time; and the ones already
+    // gone, off the front of the queue
+    void expire() {
+        long long deadline = nowMs() - ROUTER_PENDING_TIMEOUT_MS;
+        while (!pending.empty() && (pending.front()->fd < 0 || pending.front()->accepted_ms < deadline)) {
+            Client* client = pending.front();
+            pending.pop_front();
+            if (client->fd >= 0) drop(client);
+            retired.push_back(client);
+        }
+    }
+    
+    // Queued sockets, ROUTER_MAX_FDS to a packet, until the socket is full
+    // (EPOLLOUT brings us back); then the DRAIN answer, if one is owed
+    void flush(Backend* b) {
+        char buffer[ROUTER_PACKET_MAX];
+        size_t sent = 0;
+        while (sent < b->queued.size()) {
+            int count = (int)std::min<size_t>(b->queued.size() - sent, ROUTER_MAX_FDS);
+            MessageWriter w(buffer, sizeof(buffer));
+            w.message<ConnSchema>(count);
+            if (!sendFds(b->fd, w.payload(), &b->queued[sent], count)) break;
+            for (int i = 0; i < count; ++i) close(b->queued[sent + i]);   // the server has its own now
+            sent += count;
+        }
+        b->queued.erase(b->queued.begin(), b->queued.begin() + sent);
+        if (b->queued.empty() && b->drain_ack) {
+            MessageWriter w(buffer, sizeof(buffer));
+            w.message<DrainSchema>();
+            if (sendFds(b->fd, w.payload(), nullptr, 0)) b->drain_ack = false;
+        }
+    }
+    
+    void readControl(Backend* b) {
+        char buffer[ROUTER_PACKET_MAX];
+        while (true) {
+            ssize_t n = recv(b->fd, buffer, sizeof(buffer), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+            if (n <= 0) {
+                removeBackend(b);
+                return;
+            }
+            std::string_view packet(buffer, n);
+            Decoded<BackendSchema> hello;
+            Decoded<LoadSchema> load;
+            if (b->slot < 0) {
+                if (!hello.parse(packet) || !registerBackend(b, hello.get<BackendSchema::SLOT>(),
+                                                             hello.get<BackendSchema::ROOM_SIZE>())) {
+                    removeBackend(b);
+                    return;
+                }
+            } else if (load.parse(packet)) {
+                b->connections = load.get<LoadSchema::CONNECTIONS>();
+                b->handed = 0;
+            } else if (messageType(packet) == DrainSchema::type && !b->draining) {
+                b->draining = true;
+                b->drain_ack = true;
+                if (filling == b) filling = nullptr;
+                std::cout << "Server in slot " << b->slot << " is draining" << std::endl;
+                flush(b);
+            }
+        }
+    }
+    
+    // The slot it asked for, or the first free one
+    bool registerBackend(Backend* b, int wanted, int room_size) {
+        int slot = wanted;
+        if (wanted < 0) {
+            slot = (int)(std::find(slots.begin(), slots.end(), nullptr) - slots.begin());
+        }
+        if (slot >= ROUTER_MAX_BACKENDS || slots[slot] != nullptr || room_size < 1) {
+            std::cerr << "Refused a server asking for slot " << wanted << std::endl;
+            return false;
+        }
+        char buffer[ROUTER_PACKET_MAX];
+        MessageWriter w(buffer, sizeof(buffer));
+        w.message<SlotSchema>(slot);
+        if (!sendFds(b->fd, w.payload(), nullptr, 0)) return false;
+        b->slot = slot;
+        b->room_size = room_size;
+        slots[slot] = b;
+        std::cout << "Server in slot " << slot << " (rooms " << slot * ROUTER_ROOM_BLOCK + 1 << "-"
+                  << (slot + 1) * ROUTER_ROOM_BLOCK << ")" << std::endl;
+        return true;
+    }
+    
+    // It hung up or was refused. Sockets still queued for it are dropped;
+    // their clients connect again.
+    void removeBackend(Backend* b) {
+        if (b->slot >= 0) {
+            slots[b->slot] = nullptr;
+            std::cout << "Server in slot " << b->slot << " left" << std::endl;
+        }
+        if (filling == b) filling = nullptr;
+        for (int fd : b->queued) close(fd);
+        b->queued.clear();
+        close(b->fd);
+        b->fd = -1;
+        retired.push_back(b);
+    }
+};
+
+void usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [-l listen_port] [-B router_socket_path]" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    int listen_port = PORT;
+    const char* router_path = DEFAULT_ROUTER_SOCKET;
+    
+    int opt;
+    while ((opt = getopt(argc, argv, "l:B:h")) != -1) {
+        switch (opt) {
+            case 'l': listen_port = atoi(optarg); break;
+            case 'B': router_path = optarg; break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (listen_port < 1 || listen_port > 65535) {
+        usage(argv[0]);
+        return 1;
+    }
+    
+    signal(SIGPIPE, SIG_IGN);
+    
+    Router router;
+    if (!router.listen(listen_port, router_path)) {
+        return 1;
+    }
+    std::cout << "Router on port " << listen_port << ", game servers register at " << router_path << std::endl;
+    router.run();
+    return 0;
+}
@@ -0,0 +1,195 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+// Several game-server processes behind one port. The router (router.cpp)
+// accepts every client, peeks at its first frame without reading it, picks
+// a game server and passes the socket itself to that server over a Unix
+// socket as SCM_RIGHTS, so the client talks to the game server directly
+// from then on and the router never copies a byte of the game. The first
+// frame is still in the socket when the server gets it; to the server the
+// client just connected.
+//
+// A server that registers is given a slot, and every room id it hands out
+// lies in its slot's block of ROUTER_ROOM_BLOCK ids. That is how a RESUME or
+// a WATCH, which name a room, find their server again. New players fill one
+// server's lobby a room at a time and then move to the least loaded one. A
+// draining server gets no new players but keeps its resumes and viewers
+// until its last game is over, so a new process can take over the port's
+// new games while the old one finishes.
+//
+// The control messages are in schema.h.
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <atomic>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <pthread.h>
+#include "schema.h"
+#include "reactor.h"
+#include "logger.h"
+
+#define DEFAULT_ROUTER_SOCKET "/tmp/hulaan-router.sock"
+#define ROUTER_ROOM_BLOCK (1 << 20)   // room ids per slot
+#define ROUTER_MAX_BACKENDS 64
+#define ROUTER_MAX_FDS 64             // sockets per CONN packet
+#define ROUTER_LOAD_MS 1000
+#define ROUTER_PACKET_MAX 256
+
+// One packet, with `count` descriptors attached. False if it was not sent
+// whole; the descriptors are still ours either way.
+inline bool sendFds(int sock, std::string_view packet, const int* fds, int count) {
+    char control[CMSG_SPACE(sizeof(int) * ROUTER_MAX_FDS)] = {};
+    iovec iov = {(void*)packet.data(), packet.size()};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (count > 0) {
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * count);
+    }
+    return sendmsg(sock, &msg, MSG_NOSIGNAL | MSG_DONTWAIT) == (ssize_t)packet.size();
+}
+
+// One packet into `buffer`, and whatever descriptors came with it appended
+// to `fds`. Returns recvmsg's result: 0 when the other side hung up.
+inline ssize_t receiveFds(int sock, char* buffer, size_t size, std::vector<int>& fds) {
+    char control[CMSG_SPACE(sizeof(int) * ROUTER_MAX_FDS)];
+    iovec iov = {buffer, size};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    if (n < 0) return n;
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+        size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        const int* data = (const int*)CMSG_DATA(cmsg);
+        fds.insert(fds.end(), data, data + count);
+    }
+    return n;
+}
+
+// A game server's end: register with the router, then take the sockets it
+// passes on a thread of its own and give them to the reactors in turn, as
+// if they had been accepted there.
+class RouterLink {
+private:
+    int sock;
+    int assigned;   // our slot, -1 until the router says
+    std::vector<Reactor*> reactors;
+    size_t next_reactor;
+    pthread_t thread;
+
+public:
+    // The router has answered our DRAIN: every new player it sent us is here
+    std::atomic<bool> drained;
+    // The router has gone away, so no more players come from it either
+    std::atomic<bool> lost;
+    
+    RouterLink() : sock(-1), assigned(-1), next_reactor(0), drained(false), lost(false) {}
+    
+    ~RouterLink() {
+        if (sock >= 0) close(sock);
+    }
+    
+    // Register at `path`, asking for slot `wanted` (-1: any), and wait for
+    // the router's answer
+    bool connectTo(const char* path, int wanted, int room_size, std::string& error) {
+        sockaddr_un addr{};
+        if (strlen(path) >= sizeof(addr.sun_path)) {
+            error = std::string("router socket path too long: ") + path;
+            return false;
+        }
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, path);
+        sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        if (sock < 0 || connect(sock, (sockaddr*)&addr, sizeof(addr)) < 0) {
+            error = std::string("connect ") + path + ": " + strerror(errno);
+            return false;
+        }
+        
+        char buffer[ROUTER_PACKET_MAX];
+        MessageWriter w(buffer, sizeof(buffer));
+        w.message<BackendSchema>(wanted, room_size);
+        std::string_view hello = w.payload();
+        if (send(sock, hello.data(), hello.size(), MSG_NOSIGNAL) != (ssize_t)hello.size()) {
+            error = std::string("router: ") + strerror(errno);
+            return false;
+        }
+        ssize_t n = recv(sock, buffer, sizeof(buffer), 0);
+        Decoded<SlotSchema> slot;
+        if (n <= 0 || !slot.parse(std::string_view(buffer, n)) || slot.get<SlotSchema::SLOT>() < 0) {
+            error = wanted >= 0 ? "the router refused us slot " + std::to_string(wanted) + " (taken?)"
+                                : std::string("the router refused us (full?)");
+            return false;
+        }
+        assigned = slot.get<SlotSchema::SLOT>();
+        return true;
+    }
+    
+    int slot() const { return assigned; }
+    
+    // The first room id this server may hand out
+    int firstRoomId() const { return assigned * ROUTER_ROOM_BLOCK + 1; }
+    
+    void start(const std::vector<Reactor*>& targets) {
+        reactors = targets;
+        pthread_create(&thread, nullptr, threadMain, this);
+        pthread_detach(thread);
+    }
+    
+    // Any thread; a packet each, so they never interleave with another
+    void reportLoad(int connections, int rooms) {
+        char buffer[ROUTER_PACKET_MAX];
+        MessageWriter w(buffer, sizeof(buffer));
+        w.message<LoadSchema>(connections, rooms);
+        send(sock, w.payload().data(), w.payload().size(), MSG_NOSIGNAL);
+    }
+    
+    void drain() {
+        char buffer[ROUTER_PACKET_MAX];
+        MessageWriter w(buffer, sizeof(buffer));
+        w.message<DrainSchema>();
+        send(sock, w.payload().data(), w.payload().size(), MSG_NOSIGNAL);
+    }
+
+private:
+    // Until the router goes away. The games already here carry on without
+    // it; only new clients stop coming.
+    void run() {
+        char buffer[ROUTER_PACKET_MAX];
+        std::vector<int> fds;
+        while (true) {
+            fds.clear();
+            ssize_t n = receiveFds(sock, buffer, sizeof(buffer), fds);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                LogEvent(LOG_WARN, "router_lost");
+                lost = true;
+                return;
+            }
+            // A connection adopt() could not register is closed by it
+            for (int fd : fds) reactors[next_reactor++ % reactors.size()]->adopt(fd);
+            if (messageType(std::string_view(buffer, n)) == DrainSchema::type) drained = true;
+        }
+    }
+    
+    static void* threadMain(void* arg) {
+        static_cast<RouterLink*>(arg)->run();
+        return nullptr;
+    }
+};
+
+#endif
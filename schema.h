@@ -0,0 +1,590 @@
+#ifndef SCHEMA_H
+#define SCHEMA_H
+
+// The game's messages, each declared once: a type name and a table of typed
+// fields, plus the repeated groups some of them end with. The server and the
+// clients encode and decode through the same declarations, so a field can no
+// longer move on one side and not the other.
+//
+// Encoding (MessageWriter) goes straight into a buffer the caller owns, with
+// numbers written by std::to_chars and room left in front for the frame
+// header, so a finished message is already a frame. Decoding (Decoded<S>)
+// slices the message like the old hand-written parsers did and converts
+// every field up front; fields are read with get<S::FIELD>(), so asking for a
+// field the message does not have, or as the wrong type, does not compile.
+// Neither side allocates.
+//
+// Framing, Tokenizer and the first frame a client sends (its name, or a
+// RESUME) are in protocol.h.
+
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include "protocol.h"
+
+#define ENCODE_BUFFER_INITIAL 4096
+#define TOKEN_DIGITS 16
+
+enum FieldKind {
+    FIELD_INT,       // decimal integer
+    FIELD_CHAR,      // one character, e.g. an answer letter or '?'
+    FIELD_TEXT,      // anything without a '|'
+    FIELD_PERCENT,   // one decimal place: 66.7
+    FIELD_MS,        // milliseconds, or "-" for none (-1 here)
+    FIELD_VERDICT,   // TAMA (true) or MALI
+    FIELD_TOKEN,     // TOKEN_DIGITS hex digits
+};
+
+// What each kind reads and writes as
+template <FieldKind K> struct FieldType;
+template <> struct FieldType<FIELD_INT> { typedef int type; };
+template <> struct FieldType<FIELD_CHAR> { typedef char type; };
+template <> struct FieldType<FIELD_TEXT> { typedef std::string_view type; };
+template <> struct FieldType<FIELD_PERCENT> { typedef double type; };
+template <> struct FieldType<FIELD_MS> { typedef int type; };
+template <> struct FieldType<FIELD_VERDICT> { typedef bool type; };
+template <> struct FieldType<FIELD_TOKEN> { typedef uint64_t type; };
+
+// A field table. Every message and group below derives from one and names
+// the positions with an enum; a message also has a type.
+template <FieldKind... Kinds>
+struct Fields {
+    static constexpr int count = sizeof...(Kinds);
+    typedef std::tuple<typename FieldType<Kinds>::type...> Values;
+};
+
+// One field as text at `out`. nullptr if it does not fit before `end`.
+template <FieldKind K>
+inline char* encodeField(char* out, char* end, typename FieldType<K>::type value) {
+    if constexpr (K == FIELD_INT) {
+        auto result = std::to_chars(out, end, value);
+        return result.ec == std::errc() ? result.ptr : nullptr;
+    } else if constexpr (K == FIELD_CHAR) {
+        if (out == end) return nullptr;
+        *out = value;
+        return out + 1;
+    } else if constexpr (K == FIELD_TEXT) {
+        if ((size_t)(end - out) < value.size()) return nullptr;
+        memcpy(out, value.data(), value.size());
+        return out + value.size();
+    } else if constexpr (K == FIELD_PERCENT) {
+        auto result = std::to_chars(out, end, value, std::chars_format::fixed, 1);
+        return result.ec == std::errc() ? result.ptr : nullptr;
+    } else if constexpr (K == FIELD_MS) {
+        return value >= 0 ? encodeField<FIELD_INT>(out, end, value) : encodeField<FIELD_CHAR>(out, end, '-');
+    } else if constexpr (K == FIELD_VERDICT) {
+        return encodeField<FIELD_TEXT>(out, end, value ? "TAMA" : "MALI");
+    } else {
+        if (end - out < TOKEN_DIGITS) return nullptr;
+        for (int i = TOKEN_DIGITS - 1; i >= 0; --i) {
+            out[i] = "0123456789abcdef"[value & 15];
+            value >>= 4;
+        }
+        return out + TOKEN_DIGITS;
+    }
+}
+
+// Text from outside (a player's name) made fit for a FIELD_TEXT: a '|' in
+// it would split the field, so each becomes a '/'
+inline std::string textField(std::string_view value) {
+    std::string text(value);
+    std::replace(text.begin(), text.end(), '|', '/');
+    return text;
+}
+
+template <class T>
+inline bool decodeNumber(std::string_view text, T& value, int base = 10) {
+    auto result = std::from_chars(text.data(), text.data() + text.size(), value, base);
+    return result.ec == std::errc() && result.ptr == text.data() + text.size();
+}
+
+// The reverse, false if `text` is not a valid field of this kind
+template <FieldKind K>
+inline bool decodeField(std::string_view text, typename FieldType<K>::type& value) {
+    if constexpr (K == FIELD_INT) {
+        return decodeNumber(text, value);
+    } else if constexpr (K == FIELD_CHAR) {
+        if (text.size() != 1) return false;
+        value = text[0];
+        return true;
+    } else if constexpr (K == FIELD_TEXT) {
+        value = text;
+        return true;
+    } else if constexpr (K == FIELD_PERCENT) {
+        auto result = std::from_chars(text.data(), text.data() + text.size(), value, std::chars_format::fixed);
+        return result.ec == std::errc() && result.ptr == text.data() + text.size();
+    } else if constexpr (K == FIELD_MS) {
+        value = -1;
+        return text == "-" || decodeNumber(text, value);
+    } else if constexpr (K == FIELD_VERDICT) {
+        value = text == "TAMA";
+        return value || text == "MALI";
+    } else {
+        return text.size() == TOKEN_DIGITS && decodeNumber(text, value, 16);
+    }
+}
+
+// Writes messages into [buffer, buffer + capacity). Whatever does not fit is
+// dropped and ok() turns false; the caller grows its buffer and starts over
+// (encodeFrame does that).
+class MessageWriter {
+private:
+    char* start;   // the frame header goes here
+    char* pos;     // nullptr once something did not fit
+    char* end;
+
+public:
+    MessageWriter(char* buffer, size_t capacity)
+        : start(buffer), pos(capacity >= FRAME_HEADER_SIZE ? buffer + FRAME_HEADER_SIZE : nullptr),
+          end(buffer + capacity) {}
+    
+    // TYPE|field|..., one value per field of S, in order. A message written
+    // after another one nests in it, as a multicast datagram's body does.
+    template <class S, class... Args>
+    MessageWriter& message(const Args&... values) {
+        if (pos != nullptr && pos != start + FRAME_HEADER_SIZE) put<FIELD_CHAR>('|');
+        put<FIELD_TEXT>(S::type);
+        return fields((S*)nullptr, values...);
+    }
+    
+    // |field|... for one group of a repeated section
+    template <class G, class... Args>
+    MessageWriter& group(const Args&... values) {
+        return fields((G*)nullptr, values...);
+    }
+    
+    // Fields encoded earlier by another writer (its payload()), e.g. a
+    // leaderboard every player's message ends with
+    MessageWriter& raw(std::string_view encoded) {
+        put<FIELD_TEXT>(encoded);
+        return *this;
+    }
+    
+    // Fields passed through from a decoded message (Tokenizer::remaining())
+    MessageWriter& rest(std::string_view remaining) {
+        if (!remaining.empty()) put<FIELD_CHAR>('|');
+        put<FIELD_TEXT>(remaining);
+        return *this;
+    }
+    
+    bool ok() const { return pos != nullptr; }
+    
+    std::string_view payload() const {
+        if (!ok()) return std::string_view();
+        return std::string_view(start + FRAME_HEADER_SIZE, pos - start - FRAME_HEADER_SIZE);
+    }
+    
+    // Header + payload, ready to send
+    std::string_view frame() {
+        if (!ok()) return std::string_view();
+        putFrameHeader(start, (uint32_t)(pos - start - FRAME_HEADER_SIZE));
+        return std::string_view(start, pos - start);
+    }
+
+private:
+    template <FieldKind K>
+    void put(typename FieldType<K>::type value) {
+        if (pos != nullptr) pos = encodeField<K>(pos, end, value);
+    }
+    
+    template <FieldKind... K, class... Args>
+    MessageWriter& fields(Fields<K...>*, const Args&... values) {
+        static_assert(sizeof...(K) == sizeof...(Args), "one value per field");
+        ((put<FIELD_CHAR>('|'), put<K>(values)), ...);
+        return *this;
+    }
+};
+
+// Encode with `write(MessageWriter&)` into `buffer`, scratch space the
+// caller keeps around. It only grows, and the message is encoded again, the
+// first time one this big comes along. Returns the frame, header included,
+// valid until the buffer is next used.
+template <class Write>
+inline std::string_view encodeFrame(std::string& buffer, Write&& write) {
+    if (buffer.empty()) buffer.resize(ENCODE_BUFFER_INITIAL);
+    while (true) {
+        MessageWriter writer(&buffer[0], buffer.size());
+        write(writer);
+        if (writer.ok()) return writer.frame();
+        buffer.resize(buffer.size() * 2);
+    }
+}
+
+// A message or group of schema S, decoded. Views point into the message.
+template <class S>
+class Decoded {
+private:
+    typename S::Values values;
+
+public:
+    Tokenizer rest;   // whatever follows the fields: groups, or a nested message
+    
+    // A whole message: its type, then its fields
+    bool parse(std::string_view message) {
+        Tokenizer tok(message);
+        std::string_view type;
+        return tok.next(type) && type == S::type && parseFrom(tok);
+    }
+    
+    // Just the fields, taken off `tok`: one group of a repeated section
+    bool parseFrom(Tokenizer& tok) {
+        if (!fields((S*)nullptr, tok)) return false;
+        rest = tok;
+        return true;
+    }
+    
+    template <int F>
+    const typename std::tuple_element<F, typename S::Values>::type& get() const {
+        return std::get<F>(values);
+    }
+    
+    // Nothing after the fields
+    bool complete() const {
+        Tokenizer tok = rest;
+        std::string_view extra;
+        return !tok.next(extra);
+    }
+
+private:
+    template <FieldKind... K>
+    bool fields(Fields<K...>*, Tokenizer& tok) {
+        return std::apply([&tok](auto&... value) {
+            std::string_view text;
+            return ((tok.next(text) && decodeField<K>(text, value)) && ...);
+        }, values);
+    }
+};
+
+// Walks a repeated section of groups of schema G
+template <class G>
+class GroupReader {
+private:
+    Tokenizer tok;
+
+public:
+    GroupReader(const Tokenizer& from) : tok(from) {}
+    
+    bool next(Decoded<G>& group) { return group.parseFrom(tok); }
+    bool skip(int groups) { return tok.skip(groups * G::count); }
+    
+    // Complete groups left, without consuming them
+    int count() const {
+        Tokenizer copy = tok;
+        std::string_view token;
+        int tokens = 0;
+        while (copy.next(token)) tokens++;
+        return tokens / G::count;
+    }
+    
+    // Where the section ends once `groups` more are skipped; an empty
+    // tokenizer if there are not that many
+    Tokenizer after(int groups) const {
+        Tokenizer copy = tok;
+        return copy.skip(groups * G::count) ? copy : Tokenizer();
+    }
+};
+
+// ---- The game ----
+
+// WELCOME|text                                server -> room
+struct WelcomeSchema : Fields<FIELD_TEXT> {
+    static constexpr std::string_view type = "WELCOME";
+    enum { TEXT };
+};
+
+// QUESTION|round|text|{option}...             server -> room
+struct QuestionSchema : Fields<FIELD_INT, FIELD_TEXT> {
+    static constexpr std::string_view type = "QUESTION";
+    enum { ROUND, TEXT };
+};
+
+struct OptionSchema : Fields<FIELD_TEXT> {
+    enum { TEXT };
+};
+
+// ANSWER|round|choice                         client -> server
+struct AnswerSchema : Fields<FIELD_INT, FIELD_CHAR> {
+    static constexpr std::string_view type = "ANSWER";
+    enum { ROUND, CHOICE };
+};
+
+// RESULT|round|correct|rank|players|answer|verdict|score|{entry}...
+// The recipient's own rank and result come first, then the top of the
+// leaderboard, best first.
+struct ResultSchema
+    : Fields<FIELD_INT, FIELD_CHAR, FIELD_INT, FIELD_INT, FIELD_CHAR, FIELD_VERDICT, FIELD_INT> {
+    static constexpr std::string_view type = "RESULT";
+    enum { ROUND, CORRECT, RANK, PLAYERS, ANSWER, VERDICT, SCORE };
+};
+
+struct ResultEntrySchema : Fields<FIELD_TEXT, FIELD_CHAR, FIELD_VERDICT, FIELD_INT> {
+    enum { NAME, ANSWER, VERDICT, SCORE };
+};
+
+// FINAL|rank|players|score|accuracy|answer_ms|rounds|{timing}...|{entry}...
+// Again the recipient's own standing (with their mean answer time, "-" if
+// they never answered in time), then how fast the room answered each of the
+// rounds, then the top of the leaderboard.
+struct FinalSchema : Fields<FIELD_INT, FIELD_INT, FIELD_INT, FIELD_PERCENT, FIELD_MS, FIELD_INT> {
+    static constexpr std::string_view type = "FINAL";
+    enum { RANK, PLAYERS, SCORE, ACCURACY, ANSWER_MS, ROUNDS };
+};
+
+struct RoundTimingSchema : Fields<FIELD_INT, FIELD_INT, FIELD_INT> {
+    enum { ANSWERS, P50_MS, P99_MS };   // timed answers that round
+};
+
+struct FinalEntrySchema : Fields<FIELD_INT, FIELD_TEXT, FIELD_INT, FIELD_PERCENT> {
+    enum { RANK, NAME, SCORE, ACCURACY };
+};
+
+// ---- Multicast (see multicast.h) ----
+// Set up over TCP:
+//   MCAST|group|port|room|slot    server -> client when it joins a room
+//   MCAST_OK                      client -> server, once it has joined the group
+//   MSTART|seq                    server -> client: broadcasts from seq on
+//                                 come by multicast instead of TCP
+//   NACK|first|last               client -> server: please resend these
+//
+// Datagrams, and the repairs the server sends back over TCP, are
+//   M|room|seq|message
+// where message is WELCOME or QUESTION as usual, MRESULT or MFINAL (a
+// RESULT/FINAL carrying every slot's own fields, see personalize), HB (a
+// heartbeat; seq is the last one sent, so a lost tail shows up) or LOST
+// (seq is too old to repair).
+
+struct McastOfferSchema : Fields<FIELD_TEXT, FIELD_INT, FIELD_INT, FIELD_INT> {
+    static constexpr std::string_view type = "MCAST";
+    enum { GROUP, PORT, ROOM, SLOT };
+};
+
+struct McastOkSchema : Fields<> {
+    static constexpr std::string_view type = "MCAST_OK";
+};
+
+struct McastStartSchema : Fields<FIELD_INT> {
+    static constexpr std::string_view type = "MSTART";
+    enum { SEQ };
+};
+
+struct NackSchema : Fields<FIELD_INT, FIELD_INT> {
+    static constexpr std::string_view type = "NACK";
+    enum { FIRST, LAST };
+};
+
+struct MulticastSchema : Fields<FIELD_INT, FIELD_INT> {
+    static constexpr std::string_view type = "M";
+    enum { ROOM, SEQ };
+};
+
+struct HeartbeatSchema : Fields<> {
+    static constexpr std::string_view type = "HB";
+};
+
+struct LostSchema : Fields<> {
+    static constexpr std::string_view type = "LOST";
+};
+
+// MRESULT|round|correct|players|slots|{slot}...|{entry}...
+struct McastResultSchema : Fields<FIELD_INT, FIELD_CHAR, FIELD_INT, FIELD_INT> {
+    static constexpr std::string_view type = "MRESULT";
+    enum { ROUND, CORRECT, PLAYERS, SLOTS };
+};
+
+struct McastResultSlotSchema : Fields<FIELD_INT, FIELD_CHAR, FIELD_VERDICT, FIELD_INT> {
+    enum { RANK, ANSWER, VERDICT, SCORE };
+};
+
+// MFINAL|players|slots|{slot}...|rounds|{timing}...|{entry}...
+struct McastFinalSchema : Fields<FIELD_INT, FIELD_INT> {
+    static constexpr std::string_view type = "MFINAL";
+    enum { PLAYERS, SLOTS };
+};
+
+struct McastFinalSlotSchema : Fields<FIELD_INT, FIELD_INT, FIELD_PERCENT, FIELD_MS> {
+    enum { RANK, SCORE, ACCURACY, ANSWER_MS };
+};
+
+// The round count after MFINAL's slots, where FINAL has it last
+struct RoundCountSchema : Fields<FIELD_INT> {
+    enum { ROUNDS };
+};
+
+// Turn a multicast body into the message this slot would have got over
+// TCP, encoded into `buffer` (see encodeFrame): MRESULT and MFINAL get the
+// slot's own fields moved into the head, other bodies pass through. False
+// for HB and LOST, which carry nothing, and for a body that does not parse.
+inline bool personalize(std::string_view body, int slot, std::string& buffer, std::string_view& out) {
+    std::string_view type = messageType(body);
+    if (type == HeartbeatSchema::type || type == LostSchema::type) return false;
+    
+    if (type == McastResultSchema::type) {
+        Decoded<McastResultSchema> msg;
+        Decoded<McastResultSlotSchema> own;
+        if (!msg.parse(body) || slot >= msg.get<McastResultSchema::SLOTS>()) return false;
+        GroupReader<McastResultSlotSchema> slots(msg.rest);
+        if (!slots.skip(slot) || !slots.next(own)) return false;
+        std::string_view board = slots.after(msg.get<McastResultSchema::SLOTS>() - slot - 1).remaining();
+        out = encodeFrame(buffer, [&](MessageWriter& w) {
+            w.message<ResultSchema>(msg.get<McastResultSchema::ROUND>(), msg.get<McastResultSchema::CORRECT>(),
+                                    own.get<McastResultSlotSchema::RANK>(), msg.get<McastResultSchema::PLAYERS>(),
+                                    own.get<McastResultSlotSchema::ANSWER>(),
+                                    own.get<McastResultSlotSchema::VERDICT>(),
+                                    own.get<McastResultSlotSchema::SCORE>());
+            w.rest(board);
+        }).substr(FRAME_HEADER_SIZE);
+        return true;
+    }
+    
+    if (type == McastFinalSchema::type) {
+        Decoded<McastFinalSchema> msg;
+        Decoded<McastFinalSlotSchema> own;
+        if (!msg.parse(body) || slot >= msg.get<McastFinalSchema::SLOTS>()) return false;
+        GroupReader<McastFinalSlotSchema> slots(msg.rest);
+        if (!slots.skip(slot) || !slots.next(own)) return false;
+        Tokenizer tail = slots.after(msg.get<McastFinalSchema::SLOTS>() - slot - 1);
+        Decoded<RoundCountSchema> rounds;
+        if (!rounds.parseFrom(tail)) return false;
+        std::string_view timings_and_board = tail.remaining();
+        out = encodeFrame(buffer, [&](MessageWriter& w) {
+            w.message<FinalSchema>(own.get<McastFinalSlotSchema::RANK>(), msg.get<McastFinalSchema::PLAYERS>(),
+                                   own.get<McastFinalSlotSchema::SCORE>(), own.get<McastFinalSlotSchema::ACCURACY>(),
+                                   own.get<McastFinalSlotSchema::ANSWER_MS>(), rounds.get<RoundCountSchema::ROUNDS>());
+            w.rest(timings_and_board);
+        }).substr(FRAME_HEADER_SIZE);
+        return true;
+    }
+    
+    out = body;
+    return true;
+}
+
+// ---- Coming back after a dropped connection ----
+// Once the game has started a player who drops keeps their slot, score and
+// answers until it ends:
+//   SESSION|room|slot|secret      server -> client when it joins a room
+//   RESUME|room|slot|secret       client -> server, first frame of a new
+//                                 connection, instead of the name
+//   STATE|...                     server -> client: where the game is
+//   RESUME_FAILED|reason          and the server hangs up
+// secret is TOKEN_DIGITS hex digits; it only keeps players out of each
+// other's slots.
+
+struct SessionSchema : Fields<FIELD_INT, FIELD_INT, FIELD_TOKEN> {
+    static constexpr std::string_view type = "SESSION";
+    enum { ROOM, SLOT, SECRET };
+};
+
+struct ResumeSchema : Fields<FIELD_INT, FIELD_INT, FIELD_TOKEN> {
+    static constexpr std::string_view type = "RESUME";
+    enum { ROOM, SLOT, SECRET };
+};
+
+// The RESUME that asks for the slot a SESSION message handed out; false if
+// `session` is not one
+inline bool writeResume(std::string_view session, MessageWriter& w) {
+    Decoded<SessionSchema> msg;
+    if (!msg.parse(session)) return false;
+    w.message<ResumeSchema>(msg.get<SessionSchema::ROOM>(), msg.get<SessionSchema::SLOT>(),
+                            msg.get<SessionSchema::SECRET>());
+    return true;
+}
+
+struct ResumeFailedSchema : Fields<FIELD_TEXT> {
+    static constexpr std::string_view type = "RESUME_FAILED";
+    enum { REASON };
+};
+
+// STATE|round|rounds|open|answer|rank|players|score|entries|{entry}...|[question|{option}...]
+// The player's own answer to the current round ('?' if none yet) and
+// standing, `entries` of the top of the leaderboard and, while the round is
+// still open, its question.
+struct StateSchema
+    : Fields<FIELD_INT, FIELD_INT, FIELD_INT, FIELD_CHAR, FIELD_INT, FIELD_INT, FIELD_INT, FIELD_INT> {
+    static constexpr std::string_view type = "STATE";
+    enum { ROUND, ROUNDS, OPEN, ANSWER, RANK, PLAYERS, SCORE, ENTRIES };
+};
+
+struct StateEntrySchema : Fields<FIELD_TEXT, FIELD_INT> {
+    enum { NAME, SCORE };
+};
+
+struct StateQuestionSchema : Fields<FIELD_TEXT> {
+    enum { TEXT };
+};
+
+// ---- Spectators (see spectator.h) ----
+// A viewer follows one room without playing in it:
+//   WATCH|room                    client -> server, first frame of the
+//                                 connection, instead of the name
+//   WATCH_FAILED|reason           and the server hangs up
+// After that it gets the room's WELCOME and QUESTION as they are, and in
+// place of RESULT and FINAL one message shared by every viewer, the
+// player's own fields left out:
+//   WRESULT|round|correct|players|{entry}...
+//   WFINAL|players|rounds|{timing}...|{entry}...
+// Once the game is over the server hangs up.
+
+struct WatchSchema : Fields<FIELD_INT> {
+    static constexpr std::string_view type = "WATCH";
+    enum { ROOM };
+};
+
+struct WatchFailedSchema : Fields<FIELD_TEXT> {
+    static constexpr std::string_view type = "WATCH_FAILED";
+    enum { REASON };
+};
+
+struct WatchResultSchema : Fields<FIELD_INT, FIELD_CHAR, FIELD_INT> {
+    static constexpr std::string_view type = "WRESULT";
+    enum { ROUND, CORRECT, PLAYERS };   // then ResultEntrySchema groups
+};
+
+struct WatchFinalSchema : Fields<FIELD_INT, FIELD_INT> {
+    static constexpr std::string_view type = "WFINAL";
+    enum { PLAYERS, ROUNDS };   // then RoundTimingSchema and FinalEntrySchema groups
+};
+
+// ---- Router (see router.h) ----
+// Between the front-door router and the game servers behind it, one message
+// per packet on its Unix socket, no frame header:
+//   BACKEND|slot|room_size        server -> router on connecting; the slot
+//                                 its journal's games came from, or -1
+//   SLOT|slot                     router -> server: its room ids start at
+//                                 slot * ROUTER_ROOM_BLOCK + 1
+//   LOAD|connections|rooms        server -> router, every ROUTER_LOAD_MS
+//   DRAIN                         server -> router: no new players, please;
+//                                 router -> server: there will be none
+//   CONN|count                    router -> server, carrying `count` client
+//                                 sockets as SCM_RIGHTS
+// A refused BACKEND is answered with a hangup.
+
+struct BackendSchema : Fields<FIELD_INT, FIELD_INT> {
+    static constexpr std::string_view type = "BACKEND";
+    enum { SLOT, ROOM_SIZE };
+};
+
+struct SlotSchema : Fields<FIELD_INT> {
+    static constexpr std::string_view type = "SLOT";
+    enum { SLOT };
+};
+
+struct LoadSchema : Fields<FIELD_INT, FIELD_INT> {
+    static constexpr std::string_view type = "LOAD";
+    enum { CONNECTIONS, ROOMS };
+};
+
+struct DrainSchema : Fields<> {
+    static constexpr std::string_view type = "DRAIN";
+};
+
+struct ConnSchema : Fields<FIELD_INT> {
+    static constexpr std::string_view type = "CONN";
+    enum { COUNT };
+};
+
+#endif
@@ -3,384 +3,481 @@
 #include <vector>
 #include <algorithm>
 #include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <csignal>
 #include <unistd.h>
+#include <getopt.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <pthread.h>
-#include <sstream>
+#include <atomic>
 #include <iomanip>
+#include <random>
+#include <time.h>
+#include "game.h"
+#include "router.h"
 
 #define PORT 8080
-#define BUFFER_SIZE 1024
-#define MAX_PLAYERS 3
+#define DEFAULT_REACTOR_THREADS 1
+#define DEFAULT_REPORT_INTERVAL_S 60
+#define DEFAULT_METRICS_PORT 9100   // on 127.0.0.1
 
-struct Question {
-    std::string text;
-    std::vector<std::string> options;
-    char correct_answer;
-    
-    Question(const std::string& q, const std::vector<std::string>& opts, char ans)
-        : text(q), options(opts), correct_answer(ans) {}
-};
+static long long wallNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
 
-struct Player {
-    int socket;
-    std::string name;
-    int score;
-    int accuracy;
-    std::vector<char> answers;
+// Play a recorded trace (-P) against the game engine alone. Every
+// connection is a stand-in with no socket behind it, the workers run on
+// this thread, and the virtual clock jumps from one message or timer to the
+// next. What it costs is the engine's own work: parsing, room events,
+// scoring, formatting and queueing every frame.
+int replayTrace(const char* path, TraceReader& trace, RoomManager& manager) {
+    manager.driveWorkers();
+    std::vector<Connection*> conns;
+    long long start_us = virtual_now_us;
+    long long engine_ns = 0;
+    uint64_t events = 0;
     
-    Player(int s, const std::string& n) 
-        : socket(s), name(n), score(0), accuracy(0) {}
-};
-
-class TriviaServer {
-private:
-    std::vector<Player> players;
-    std::vector<Question> questions;
-    pthread_mutex_t players_mutex = PTHREAD_MUTEX_INITIALIZER;
+    auto runWorkers = [&]() {
+        long long t = wallNs();
+        manager.runWorkersOnce();
+        engine_ns += wallNs() - t;
+    };
+    // Fire every timer due by `until`, at the time it is due
+    auto advanceTo = [&](long long until_us) {
+        long ms;
+        while ((ms = manager.msUntilNextTimer()) >= 0 && (nowMs() + ms) * 1000 <= until_us) {
+            virtual_now_us = (nowMs() + ms) * 1000;
+            runWorkers();
+        }
+        virtual_now_us = std::max(virtual_now_us, until_us);
+    };
+    auto hangUp = [&](Connection* conn) {
+        pthread_mutex_lock(&conn->out_mutex);
+        conn->closed = true;
+        pthread_mutex_unlock(&conn->out_mutex);
+        long long t = wallNs();
+        manager.onClose(conn);
+        engine_ns += wallNs() - t;
+        conn->release();
+    };
     
-public:
-    TriviaServer() {
-        // Initialize Filipino trivia questions
-        questions = {
-            Question(
-                "Sino ang pambansang bayani ng Pilipinas?",
-                {"A) Andres Bonifacio", "B) Jose Rizal", "C) Lapu-Lapu", "D) Emilio Aguinaldo"},
-                'B'
-            ),
-            Question(
-                "Ano ang tawag sa pinakamataas na bundok sa Pilipinas?",
-                {"A) Bundok Banahaw", "B) Bundok Mayon", "C) Bundok Apo", "D) Bundok Makiling"},
-                'C'
-            ),
-            Question(
-                "Ilang pulo ang bumubuo sa Pilipinas?",
-                {"A) 7,107", "B) 7,641", "C) 8,000", "D) 6,500"},
-                'B'
-            ),
-            Question(
-                "Ano ang pangunahing wika ng Pilipinas?",
-                {"A) Cebuano", "B) Ilocano", "C) Filipino", "D) Hiligaynon"},
-                'C'
-            ),
-            Question(
-                "Sino ang unang Pangulo ng Pilipinas?",
-                {"A) Jose Rizal", "B) Emilio Aguinaldo", "C) Manuel Quezon", "D) Andres Bonifacio"},
-                'B'
-            )
-        };
+    long long wall_start = wallNs();
+    TraceEvent ev;
+    while (trace.next(ev)) {
+        events++;
+        advanceTo(start_us + ev.time_us);
+        if (ev.conn >= conns.size()) conns.resize(ev.conn + 1, nullptr);
+        Connection*& conn = conns[ev.conn];
+        if (ev.type == TRACE_CLOSE) {
+            if (conn != nullptr) hangUp(conn);
+            conn = nullptr;
+        } else {
+            if (conn == nullptr) conn = new Connection(-1, -1);
+            conn->recv_us = virtual_now_us;
+            long long t = wallNs();
+            manager.onMessage(conn, ev.payload);
+            engine_ns += wallNs() - t;
+        }
+        runWorkers();
     }
+    long long recorded_us = virtual_now_us - start_us;
     
-    void sendToPlayer(int socket, const std::string& message) {
-        send(socket, message.c_str(), message.length(), 0);
+    // The recording stopped with these still connected
+    for (Connection* conn : conns) {
+        if (conn != nullptr) hangUp(conn);
     }
-    
-    void broadcastToAll(const std::string& message) {
-        pthread_mutex_lock(&players_mutex);
-        for (const auto& player : players) {
-            sendToPlayer(player.socket, message);
-        }
-        pthread_mutex_unlock(&players_mutex);
+    runWorkers();
+    // Let the games still running play out
+    while (manager.gamesRunning() && manager.msUntilNextTimer() >= 0) {
+        advanceTo((nowMs() + manager.msUntilNextTimer()) * 1000);
     }
+    double wall_s = (wallNs() - wall_start) / 1e9;
     
-    std::string formatQuestion(const Question& question, int round) {
-        std::stringstream ss;
-        ss << "QUESTION|" << (round + 1) << "|" << question.text;
-        for (const auto& option : question.options) {
-            ss << "|" << option;
+    LatencyStats stats = manager.takeStats();
+    uint64_t rounds = stats.fanout.count();
+    std::cout << "Replayed " << path << ": " << events << " events from " << trace.connections
+              << " connections" << (trace.truncated ? " (last record cut short)" : "") << std::endl;
+    std::cout << std::fixed << std::setprecision(2) << recorded_us / 1e6 << " s recorded, replayed in "
+              << wall_s * 1000 << " ms (" << std::setprecision(0) << recorded_us / 1e6 / std::max(wall_s, 1e-9)
+              << "x real time)" << std::endl;
+    std::cout << "Games finished: " << stats.games << ", rounds closed: " << rounds << ", resumes: "
+              << metricTotal(RESUMES) << ", frames out: "
+              << metricTotal(MESSAGES_OUT) << " (" << metricTotal(BYTES_OUT) << " bytes)" << std::endl;
+    std::cout << std::setprecision(2) << "Engine time: " << engine_ns / 1e6 << " ms, "
+              << engine_ns / 1e3 / std::max<uint64_t>(events, 1) << " us per event";
+    if (rounds > 0) std::cout << ", " << engine_ns / 1e3 / rounds << " us per round";
+    std::cout << std::endl;
+    return 0;
+}
+
+// Behind a router (-B), the main thread tells it our load every
+// ROUTER_LOAD_MS and reports latency on schedule. SIGTERM drains: the router
+// stops sending new players, and once it says the last one is here and the
+// games have played out, we exit, so a new server can take over without a
+// game being cut short.
+static volatile sig_atomic_t drain_requested = 0;
+
+static void requestDrain(int) {
+    drain_requested = 1;
+}
+
+static void serveRouter(RoomManager& manager, RouterLink& router, int report_interval_s) {
+    bool draining = false;
+    long long last_report = nowMs();
+    // A router that is gone will never answer the DRAIN, but has nobody
+    // left to send us either
+    while (!draining || !(router.drained || router.lost) || !manager.drained()) {
+        usleep(ROUTER_LOAD_MS * 1000);
+        if (drain_requested && !draining) {
+            draining = true;
+            router.drain();
+            LogEvent(LOG_WARN, "draining").kv("rooms", manager.activeRooms());
+            std::cout << "Draining: no new players, " << manager.activeRooms() << " room(s) to finish" << std::endl;
+        }
+        router.reportLoad((int)(metricTotal(CONNECTIONS_OPENED) - metricTotal(CONNECTIONS_CLOSED)),
+                          manager.activeRooms());
+        if (report_interval_s > 0 && nowMs() - last_report >= report_interval_s * 1000LL) {
+            manager.printReport(report_interval_s);
+            last_report = nowMs();
         }
-        return ss.str();
     }
+    std::cout << "Drained" << std::endl;
+}
+
+void usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [-t reactor_threads] [-w game_workers]"
+              << " [-a answer_timeout_s] [-d round_delay_s] [-l lobby_timeout_s]"
+              << " [-q question_bank] [-c category] [-D difficulty] [-r rounds]"
+              << " [-R report_interval_s] [-m metrics_port] [-L debug|info|warn|error|off]"
+              << " [-F log_lines_per_s] [-M multicast_group:port] [-I multicast_iface_addr]"
+              << " [-U local_socket_path] [-J journal_dir] [-T record_trace] [-P replay_trace]"
+              << " [-V spectator_threads] [-B router_socket_path] [-O direct|batch|uring]" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    int reactor_threads = DEFAULT_REACTOR_THREADS;
+    int worker_threads = std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+    GameConfig config = {DEFAULT_ANSWER_TIMEOUT_MS, DEFAULT_ROUND_DELAY_MS, DEFAULT_LOBBY_TIMEOUT_MS,
+                         DEFAULT_ROUNDS, DEFAULT_MAX_PLAYERS};
+    const char* bank_path = nullptr;
+    const char* category = nullptr;
+    int difficulty = -1;
+    int report_interval_s = DEFAULT_REPORT_INTERVAL_S;
+    int metrics_port = DEFAULT_METRICS_PORT;
+    LogLevel level = LOG_INFO;
+    int log_lines = DEFAULT_LOG_RATE;
+    const char* mcast_group = nullptr;
+    const char* mcast_iface = nullptr;
+    const char* local_path = DEFAULT_LOCAL_SOCKET;
+    const char* journal_dir = nullptr;
+    const char* record_path = nullptr;
+    const char* replay_path = nullptr;
+    int spectator_threads = DEFAULT_SPECTATOR_SHARDS;
+    const char* router_path = nullptr;
+    bool level_given = false;
+    bool local_given = false;
     
-    void waitForAllAnswers(int round) {
-        pthread_mutex_lock(&players_mutex);
-        
-        // Reset answers for this round
-        for (auto& player : players) {
-            if (player.answers.size() <= round) {
-                player.answers.resize(round + 1, '?');
-            }
-        }
-        
-        pthread_mutex_unlock(&players_mutex);
-        
-        // Wait for all players to answer
-        int answered = 0;
-        while (answered < MAX_PLAYERS) {
-            answered = 0;
-            pthread_mutex_lock(&players_mutex);
-            for (const auto& player : players) {
-                if (player.answers.size() > round && player.answers[round] != '?') {
-                    answered++;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:w:a:d:l:q:c:D:r:R:m:L:F:M:I:U:J:T:P:V:B:O:h")) != -1) {
+        switch (opt) {
+            case 't':
+                reactor_threads = atoi(optarg);
+                break;
+            case 'w':
+                worker_threads = atoi(optarg);
+                break;
+            case 'a':
+                config.answer_timeout_ms = (int)(atof(optarg) * 1000);
+                break;
+            case 'd':
+                config.round_delay_ms = (int)(atof(optarg) * 1000);
+                break;
+            case 'l':
+                config.lobby_timeout_ms = (int)(atof(optarg) * 1000);
+                break;
+            case 'q':
+                bank_path = optarg;
+                break;
+            case 'c':
+                category = optarg;
+                break;
+            case 'D':
+                difficulty = atoi(optarg);
+                break;
+            case 'r':
+                config.rounds = atoi(optarg);
+                break;
+            case 'R':
+                report_interval_s = atoi(optarg);
+                break;
+            case 'm':
+                metrics_port = atoi(optarg);
+                break;
+            case 'L':
+                if (!parseLogLevel(optarg, level)) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                level_given = true;
+                break;
+            case 'F':
+                log_lines = atoi(optarg);
+                break;
+            case 'M':
+                mcast_group = optarg;
+                break;
+            case 'I':
+                mcast_iface = optarg;
+                break;
+            case 'U':
+                local_path = optarg;
+                local_given = true;
+                break;
+            case 'J':
+                journal_dir = optarg;
+                break;
+            case 'T':
+                record_path = optarg;
+                break;
+            case 'P':
+                replay_path = optarg;
+                break;
+            case 'V':
+                spectator_threads = atoi(optarg);
+                break;
+            case 'B':
+                router_path = optarg;
+                break;
+            case 'O':
+                if (!parseIoBackend(optarg, io_backend)) {
+                    usage(argv[0]);
+                    return 1;
                 }
-            }
-            pthread_mutex_unlock(&players_mutex);
-            
-            if (answered < MAX_PLAYERS) {
-                usleep(100000); // Wait 100ms before checking again
-            }
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
         }
     }
-    
-    void evaluateAnswers(int round) {
-        pthread_mutex_lock(&players_mutex);
-        
-        for (auto& player : players) {
-            if (player.answers[round] == questions[round].correct_answer) {
-                player.score += 10;
-                player.accuracy++;
-            }
-        }
-        
-        pthread_mutex_unlock(&players_mutex);
+    if (reactor_threads < 1 || worker_threads < 1 || config.answer_timeout_ms < 0 ||
+        config.round_delay_ms < 0 || config.lobby_timeout_ms < 0 || config.rounds < 1 ||
+        report_interval_s < 0 || metrics_port < 0 || metrics_port > 65535 || log_lines < 0 ||
+        spectator_threads < 0) {
+        usage(argv[0]);
+        return 1;
     }
     
-    void sendRoundResults(int round) {
-        pthread_mutex_lock(&players_mutex);
-        
-        std::stringstream ss;
-        ss << "RESULT|" << (round + 1) << "|" << questions[round].correct_answer;
-        
-        for (const auto& player : players) {
-            bool correct = (player.answers[round] == questions[round].correct_answer);
-            ss << "|" << player.name << "|" << player.answers[round] 
-               << "|" << (correct ? "TAMA" : "MALI") << "|" << player.score;
-        }
-        
-        std::string result = ss.str();
-        
-        pthread_mutex_unlock(&players_mutex);
-        
-        broadcastToAll(result);
-    }
+    // Peers that vanish mid-write must not kill the server
+    signal(SIGPIPE, SIG_IGN);
     
-    void sendFinalResults() {
-        pthread_mutex_lock(&players_mutex);
-        
-        // Sort players by score
-        std::vector<Player> sorted_players = players;
-        std::sort(sorted_players.begin(), sorted_players.end(), 
-                  [](const Player& a, const Player& b) {
-                      return a.score > b.score;
-                  });
-        
-        std::stringstream ss;
-        ss << "FINAL";
-        
-        for (int i = 0; i < sorted_players.size(); ++i) {
-            const auto& player = sorted_players[i];
-            double accuracy_percent = (double)player.accuracy / questions.size() * 100;
-            ss << "|" << (i + 1) << "|" << player.name << "|" << player.score 
-               << "|" << std::fixed << std::setprecision(1) << accuracy_percent;
+    // A replay plays the recorded games with the recorded timing and seed,
+    // on a virtual clock, and quietly unless -L says otherwise
+    std::string error;
+    TraceReader trace;
+    uint64_t seed = std::random_device{}();
+    if (replay_path != nullptr) {
+        if (!trace.open(replay_path, error)) {
+            std::cerr << error << std::endl;
+            return 1;
         }
-        
-        std::string final_result = ss.str();
-        
-        pthread_mutex_unlock(&players_mutex);
-        
-        broadcastToAll(final_result);
+        config = {trace.header.answer_timeout_ms, trace.header.round_delay_ms, trace.header.lobby_timeout_ms,
+                  trace.header.rounds, config.max_players};
+        seed = trace.header.seed;
+        virtual_now_us = 1000000;
+        if (!level_given) level = LOG_OFF;
     }
     
-    void handlePlayerAnswer(int socket, const std::string& answer, int round) {
-        if (answer.length() != 1 || (answer[0] < 'A' || answer[0] > 'D')) {
-            return; // Invalid answer
-        }
-        
-        pthread_mutex_lock(&players_mutex);
-        
-        for (auto& player : players) {
-            if (player.socket == socket) {
-                if (player.answers.size() <= round) {
-                    player.answers.resize(round + 1, '?');
-                }
-                player.answers[round] = answer[0];
-                std::cout << "[" << player.name << "] answered: " << answer[0] << std::endl;
-                break;
-            }
-        }
-        
-        pthread_mutex_unlock(&players_mutex);
-    }
+    // Game events go through the asynchronous logger, never straight to
+    // std::cout from a reactor or game worker
+    logSetLevel(level);
+    logSetRate(log_lines);
+    logStart();
     
-    void startGame() {
-        std::cout << "\n╔══════════════════════════════════════════════╗" << std::endl;
-        std::cout << "║           HULAAN SA BAYAN TRIVIA             ║" << std::endl;
-        std::cout << "║        Multiplayer Network Version           ║" << std::endl;
-        std::cout << "╚══════════════════════════════════════════════╝" << std::endl;
-        
-        std::cout << "\nWaiting for " << MAX_PLAYERS << " players to connect..." << std::endl;
-        
-        // Wait for all players to connect
-        while (players.size() < MAX_PLAYERS) {
-            usleep(500000); // Wait 500ms
+    if (replay_path != nullptr) {
+        RoomManager manager(worker_threads, config, seed, nullptr, nullptr, nullptr, nullptr);
+        if (!manager.loadQuestions(bank_path, category, difficulty, error)) {
+            std::cerr << error << std::endl;
+            return 1;
         }
-        
-        std::cout << "\nAll players connected! Starting game..." << std::endl;
-        
-        // Send welcome message
-        broadcastToAll("WELCOME|Game starting! Get ready for trivia questions!");
-        
-        // Play each round
-        for (int round = 0; round < questions.size(); ++round) {
-            std::cout << "\n--- Round " << (round + 1) << " ---" << std::endl;
-            
-            // Send question to all players
-            std::string question_msg = formatQuestion(questions[round], round);
-            broadcastToAll(question_msg);
-            
-            // Wait for all answers
-            waitForAllAnswers(round);
-            
-            // Evaluate answers
-            evaluateAnswers(round);
-            
-            // Send results
-            sendRoundResults(round);
-            
-            std::cout << "Round " << (round + 1) << " completed!" << std::endl;
-            
-            if (round < questions.size() - 1) {
-                sleep(3); // Wait 3 seconds between rounds
-            }
+        if (manager.bankSize() != trace.header.bank_questions) {
+            std::cerr << replay_path << " was recorded with a " << trace.header.bank_questions
+                      << "-question bank; replay it with the same -q" << std::endl;
+            return 1;
         }
-        
-        // Send final results
-        sendFinalResults();
-        
-        std::cout << "\nGame completed! Final results sent to all players." << std::endl;
+        return replayTrace(replay_path, trace, manager);
     }
     
-    void addPlayer(int socket, const std::string& name) {
-        pthread_mutex_lock(&players_mutex);
-        players.emplace_back(socket, name);
-        std::cout << "Player " << name << " joined (" << players.size() << "/" << MAX_PLAYERS << ")" << std::endl;
-        pthread_mutex_unlock(&players_mutex);
+    // Optional: room broadcasts by multicast, with repair over TCP
+    MulticastSender mcast;
+    if (mcast_group != nullptr && !mcast.open(mcast_group, mcast_iface, error)) {
+        std::cerr << error << std::endl;
+        return 1;
     }
     
-    void removePlayer(int socket) {
-        pthread_mutex_lock(&players_mutex);
-        players.erase(std::remove_if(players.begin(), players.end(),
-            [socket](const Player& p) { return p.socket == socket; }), 
-            players.end());
-        pthread_mutex_unlock(&players_mutex);
+    // Viewers are fanned out on threads of their own; -V 0 turns them away
+    SpectatorHub spectators(spectator_threads);
+    if (spectator_threads > 0) {
+        metricGauge("trivia_spectators", "Viewers watching a game", &spectators.viewers);
+        spectators.start();
     }
     
-    bool hasPlayer(int socket) {
-        pthread_mutex_lock(&players_mutex);
-        bool found = std::any_of(players.begin(), players.end(),
-            [socket](const Player& p) { return p.socket == socket; });
-        pthread_mutex_unlock(&players_mutex);
-        return found;
+    Journal journal;
+    TraceRecorder recorder;
+    RoomManager manager(worker_threads, config, seed, mcast_group != nullptr ? &mcast : nullptr,
+                        journal_dir != nullptr ? &journal : nullptr, record_path != nullptr ? &recorder : nullptr,
+                        spectator_threads > 0 ? &spectators : nullptr);
+    if (!manager.loadQuestions(bank_path, category, difficulty, error)) {
+        std::cerr << error << std::endl;
+        return 1;
     }
     
-    void processAnswer(int socket, const std::string& message) {
-        // Expected format: "ANSWER|round|answer"
-        std::istringstream iss(message);
-        std::string token;
-        std::vector<std::string> parts;
-        
-        while (std::getline(iss, token, '|')) {
-            parts.push_back(token);
-        }
-        
-        if (parts.size() == 3 && parts[0] == "ANSWER") {
-            int round = std::stoi(parts[1]) - 1; // Convert to 0-based
-            std::string answer = parts[2];
-            handlePlayerAnswer(socket, answer, round);
+    // Optional: record every inbound message for replaying with -P
+    if (record_path != nullptr) {
+        TraceHeader header{};
+        header.bank_questions = manager.bankSize();
+        header.seed = seed;
+        header.answer_timeout_ms = config.answer_timeout_ms;
+        header.round_delay_ms = config.round_delay_ms;
+        header.lobby_timeout_ms = config.lobby_timeout_ms;
+        header.rounds = config.rounds;
+        if (!recorder.open(record_path, header, nowUs(), error)) {
+            std::cerr << error << std::endl;
+            return 1;
         }
+        recorder.start();
+        std::cout << "Recording inbound messages to " << record_path << std::endl;
     }
-};
-
-TriviaServer* server_instance = nullptr;
-
-void* handle_client(void* arg) {
-    int client_socket = *static_cast<int*>(arg);
-    delete static_cast<int*>(arg);
     
-    char buffer[BUFFER_SIZE];
-    memset(buffer, 0, BUFFER_SIZE);
-    
-    // Get client name
-    if (recv(client_socket, buffer, BUFFER_SIZE, 0) <= 0) {
-        close(client_socket);
-        return nullptr;
+    // Optional: journal games and pick up the ones a crash interrupted
+    if (journal_dir != nullptr) {
+        JournalReplay replay;
+        long long start = nowUs();
+        if (!replay.run(journal_dir, manager.bankSize(), error) ||
+            !journal.open(journal_dir, manager.bankSize(), replay, error)) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        int restored = manager.recover(replay);
+        std::cout << "Journal: " << journal_dir << ", " << replay.records << " record(s) in "
+                  << replay.segments.size() << " segment(s) replayed in " << (nowUs() - start) / 1000 << " ms, "
+                  << restored << " game(s) recovered" << (replay.torn ? " (torn tail skipped)" : "") << std::endl;
+        journal.start();
     }
     
-    std::string client_name(buffer);
-    server_instance->addPlayer(client_socket, client_name);
+    // Optional: take clients from a router instead of a port of our own.
+    // A server with recovered games asks for the slot their ids came from.
+    RouterLink router;
+    if (router_path != nullptr) {
+        int wanted = manager.nextRoomId() > 1 ? (manager.nextRoomId() - 1) / ROUTER_ROOM_BLOCK : -1;
+        if (!router.connectTo(router_path, wanted, config.max_players, error)) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        manager.setFirstRoomId(router.firstRoomId());
+        signal(SIGTERM, requestDrain);
+    }
     
-    // Handle client messages
-    while (true) {
-        memset(buffer, 0, BUFFER_SIZE);
-        int n = recv(client_socket, buffer, BUFFER_SIZE, 0);
-        if (n <= 0) break;
-        
-        std::string message(buffer);
-        server_instance->processAnswer(client_socket, message);
+    // One epoll reactor per thread, each with its own SO_REUSEPORT listener
+    // (or none, behind a router)
+    std::vector<Reactor*> reactors;
+    // io_uring can be missing from the kernel or turned off; batching
+    // without it still saves most of the system calls
+    if (io_backend == IO_URING && !uringAvailable(error)) {
+        std::cerr << "No io_uring (" << error << "), using -O batch" << std::endl;
+        io_backend = IO_BATCH;
     }
     
-    server_instance->removePlayer(client_socket);
-    close(client_socket);
-    return nullptr;
-}
-
-int main() {
-    TriviaServer server;
-    server_instance = &server;
+    for (int i = 0; i < reactor_threads; ++i) {
+        Reactor* reactor = new Reactor(&manager);
+        if (!(router_path != nullptr ? reactor->init() : reactor->listenOn(PORT))) {
+            return 1;
+        }
+        reactors.push_back(reactor);
+    }
     
-    int server_socket = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_socket < 0) {
-        perror("socket");
+    // Same-host clients come in on the first reactor; "" turns it off. Behind
+    // a router only with -U, since every server would want the same path.
+    bool local = local_path[0] != '\0' && (router_path == nullptr || local_given);
+    if (local && !reactors[0]->listenLocal(local_path)) {
         return 1;
     }
     
-    int opt = 1;
-    setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-    
-    sockaddr_in server_addr{};
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = INADDR_ANY;
-    server_addr.sin_port = htons(PORT);
+    std::cout << "\n╔══════════════════════════════════════════════╗" << std::endl;
+    std::cout << "║           HULAAN SA BAYAN TRIVIA             ║" << std::endl;
+    std::cout << "║        Multiplayer Network Version           ║" << std::endl;
+    std::cout << "╚══════════════════════════════════════════════╝" << std::endl;
     
-    if (bind(server_socket, (sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-        perror("bind");
-        return 1;
+    if (router_path != nullptr) {
+        std::cout << "Trivia Server behind the router at " << router_path << ", slot " << router.slot()
+                  << " (rooms from " << manager.nextRoomId() << "; " << reactor_threads << " reactor thread(s), "
+                  << worker_threads << " game worker(s))..." << std::endl;
+    } else {
+        std::cout << "Trivia Server listening on port " << PORT << " ("
+                  << reactor_threads << " reactor thread(s), "
+                  << worker_threads << " game worker(s))..." << std::endl;
     }
-    
-    if (listen(server_socket, MAX_PLAYERS) < 0) {
-        perror("listen");
-        return 1;
+    std::cout << "\nEvery " << config.max_players << " players that connect start their own game." << std::endl;
+    std::cout << "Answer time: " << config.answer_timeout_ms / 1000.0 << "s, between rounds: "
+              << config.round_delay_ms / 1000.0 << "s, lobby timeout: "
+              << config.lobby_timeout_ms / 1000.0 << "s" << std::endl;
+    static const char* io_names[] = {"a read and a write per message", "batched reads and writev",
+                                     "io_uring, multishot receives and batched sends"};
+    std::cout << "Socket I/O: " << io_names[io_backend] << std::endl;
+    if (local) {
+        std::cout << "Same-host clients: " << local_path << " (shared memory)" << std::endl;
+    }
+    if (spectator_threads > 0) {
+        std::cout << "Spectators: WATCH|room, " << spectator_threads << " fan-out thread(s)" << std::endl;
+    }
+    if (mcast_group != nullptr) {
+        std::cout << "Broadcasts by multicast: " << mcast_group << " (+ room % " << MCAST_GROUPS << ")"
+                  << (mcast_iface ? std::string(" via ") + mcast_iface : std::string()) << std::endl;
     }
     
-    std::cout << "Trivia Server listening on port " << PORT << "..." << std::endl;
+    for (Reactor* reactor : reactors) {
+        pthread_t tid;
+        pthread_create(&tid, nullptr, Reactor::threadMain, reactor);
+        pthread_detach(tid);
+    }
     
-    // Accept connections in a separate thread
-    pthread_t accept_thread;
-    pthread_create(&accept_thread, nullptr, [](void* arg) -> void* {
-        int server_socket = *static_cast<int*>(arg);
-        
-        while (true) {
-            sockaddr_in client_addr{};
-            socklen_t len = sizeof(client_addr);
-            int client_socket = accept(server_socket, (sockaddr*)&client_addr, &len);
-            if (client_socket < 0) {
-                perror("accept");
-                continue;
-            }
-            
-            int* p = new int(client_socket);
+    // Metrics are optional: a busy port costs the endpoint, not the game
+    MetricsServer metrics;
+    if (metrics_port > 0) {
+        if (metrics.listenOn(metrics_port)) {
             pthread_t tid;
-            pthread_create(&tid, nullptr, handle_client, p);
+            pthread_create(&tid, nullptr, MetricsServer::threadMain, &metrics);
             pthread_detach(tid);
+            std::cout << "Metrics: http://127.0.0.1:" << metrics_port << "/metrics" << std::endl;
+        } else {
+            std::cerr << "Metrics endpoint disabled" << std::endl;
         }
-        return nullptr;
-    }, &server_socket);
+    }
     
-    // Start the game
-    server.startGame();
+    manager.startWorkers();
+    
+    if (router_path != nullptr) {
+        router.start(reactors);
+        serveRouter(manager, router, report_interval_s);
+        // The reactors and workers never return; flush what is buffered
+        // and leave without them
+        if (journal_dir != nullptr) journal.stop();
+        if (record_path != nullptr) recorder.stop();
+        logStop();
+        std::cout << std::flush;
+        _exit(0);
+    }
+    
+    // The main thread only reports; 0 turns the report off
+    while (report_interval_s > 0) {
+        sleep(report_interval_s);
+        manager.printReport(report_interval_s);
+    }
+    manager.joinWorkers();
     
-    pthread_cancel(accept_thread);
-    close(server_socket);
     return 0;
 }
+
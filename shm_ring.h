@@ -0,0 +1,303 @@
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+// Same-host transport. A client connects to the server's Unix domain socket
+// and gets back, as SCM_RIGHTS, a shared memory segment holding two
+// single-producer single-consumer byte rings (one each way) and two eventfd
+// doorbells. From then on frames travel through the rings exactly as they
+// would through a TCP stream, header and all, so FrameBuffer and everything
+// above it cannot tell the difference. Sending a frame is a memcpy; the
+// kernel is only entered to ring a doorbell, and only when the other side
+// has said it is about to sleep.
+//
+// The Unix socket stays open but carries nothing after the handshake: its
+// hangup is how either side learns that the other has gone.
+
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <algorithm>
+#include <new>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/uio.h>
+#include <sys/eventfd.h>
+#include "protocol.h"
+
+#define CACHE_LINE 64
+#define SHM_RING_SIZE (256 * 1024)      // bytes each way, a power of two
+#define SHM_HELLO "SHM|1"
+#define SHM_FDS 3                       // segment, server doorbell, client doorbell
+#define DEFAULT_LOCAL_SOCKET "/tmp/hulaan.sock"
+
+// One direction. head and tail only grow: the producer owns tail, the
+// consumer owns head. The sleeping flags are the doorbell protocol: a side
+// that runs out of work sets its flag, looks once more and only then
+// sleeps, and the other side rings only when it sees the flag.
+//
+// The other process can write anything into the segment. So each side
+// keeps the index it owns in its own memory and only publishes it here,
+// and takes the other side's index only once it is within SHM_RING_SIZE
+// of its own, in the right direction. That bounds every copy by the ring;
+// an index out of bounds is a protocol error.
+struct ShmRing {
+    alignas(CACHE_LINE) std::atomic<uint64_t> head;
+    alignas(CACHE_LINE) std::atomic<uint64_t> tail;
+    alignas(CACHE_LINE) std::atomic<uint32_t> consumer_sleeping;   // wants a ring on new data
+    alignas(CACHE_LINE) std::atomic<uint32_t> producer_sleeping;   // wants a ring on free space
+    alignas(CACHE_LINE) char data[SHM_RING_SIZE];
+    
+    // The consumer starts out asleep: nobody has looked at the ring yet
+    ShmRing() : head(0), tail(0), consumer_sleeping(1), producer_sleeping(0) {}
+    
+    // Producer, at our tail `t`: copy as much of iov as fits and return how
+    // much that was, or -1 if the consumer's head is out of bounds
+    ssize_t write(uint64_t& t, const iovec* iov, int count) {
+        uint64_t used = t - head.load(std::memory_order_acquire);
+        if (used > SHM_RING_SIZE) return -1;
+        size_t room = SHM_RING_SIZE - used;
+        size_t done = 0;
+        for (int i = 0; i < count && done < room; ++i) {
+            size_t n = std::min(iov[i].iov_len, room - done);
+            copyIn(t + done, (const char*)iov[i].iov_base, n);
+            done += n;
+        }
+        t += done;
+        tail.store(t, std::memory_order_release);
+        return (ssize_t)done;
+    }
+    
+    // Consumer, at our head `h`: move everything there is into `in`, or
+    // return -1 if the producer's tail is out of bounds
+    ssize_t readInto(uint64_t& h, FrameBuffer& in) {
+        uint64_t n = tail.load(std::memory_order_acquire) - h;
+        if (n > SHM_RING_SIZE) return -1;
+        if (n == 0) return 0;
+        size_t start = h & (SHM_RING_SIZE - 1);
+        size_t first = std::min(n, SHM_RING_SIZE - start);
+        in.append(data + start, first);
+        in.append(data, n - first);
+        h += n;
+        head.store(h, std::memory_order_release);
+        return (ssize_t)n;
+    }
+
+private:
+    // len <= SHM_RING_SIZE, so the wrapped part ends before `start`
+    void copyIn(uint64_t pos, const char* bytes, size_t len) {
+        size_t start = pos & (SHM_RING_SIZE - 1);
+        size_t first = std::min(len, SHM_RING_SIZE - start);
+        memcpy(data + start, bytes, first);
+        memcpy(data, bytes + first, len - first);
+    }
+};
+
+struct ShmSegment {
+    ShmRing to_server;
+    ShmRing to_client;
+};
+
+// One end of a connection's ring pair; the server's and the client's are
+// mirror images. A doorbell is rung for new data and for freed space alike,
+// so each side sleeps on just its own.
+class ShmEndpoint {
+private:
+    ShmSegment* segment;
+    ShmRing* tx;
+    ShmRing* rx;
+    int own_bell;    // the peer rings it, we wait on it
+    int peer_bell;
+    uint64_t tx_tail;   // ours; the segment only holds a copy
+    uint64_t rx_head;
+
+public:
+    ShmEndpoint(ShmSegment* seg, bool server, int own, int peer)
+        : segment(seg), tx(server ? &seg->to_client : &seg->to_server),
+          rx(server ? &seg->to_server : &seg->to_client), own_bell(own), peer_bell(peer), tx_tail(0), rx_head(0) {}
+    
+    ~ShmEndpoint() {
+        munmap(segment, sizeof(ShmSegment));
+        close(own_bell);
+        close(peer_bell);
+    }
+    
+    ShmEndpoint(const ShmEndpoint&) = delete;
+    ShmEndpoint& operator=(const ShmEndpoint&) = delete;
+    
+    // Readable when the peer rang; safe to poll or epoll
+    int bell() const { return own_bell; }
+    
+    // Like sendmsg on a non-blocking socket: the bytes written, which may
+    // be fewer than asked, or -1 with EAGAIN while the ring is full (the
+    // peer rings once it has made room), or with EPROTO once the peer has
+    // corrupted the ring
+    ssize_t send(const iovec* iov, int count) {
+        ssize_t n = tx->write(tx_tail, iov, count);
+        if (n == 0) {
+            tx->producer_sleeping.store(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            n = tx->write(tx_tail, iov, count);   // the consumer may have made room since
+            if (n == 0) errno = EAGAIN;
+        }
+        if (n <= 0) {
+            if (n < 0) errno = EPROTO;
+            return -1;
+        }
+        wake(tx->consumer_sleeping);
+        return (ssize_t)n;
+    }
+    
+    // Like read(): the bytes appended to `in`; -1 with EAGAIN when there is
+    // nothing yet (wait for bell()), or with EPROTO once the peer has
+    // corrupted the ring; 0 once the peer has hung up and everything it
+    // sent has been read
+    ssize_t receive(FrameBuffer& in, bool hangup) {
+        ssize_t n = rx->readInto(rx_head, in);
+        if (n == 0) {
+            if (hangup) return 0;
+            uint64_t rings;
+            while (read(own_bell, &rings, sizeof(rings)) > 0) {}
+            rx->consumer_sleeping.store(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            n = rx->readInto(rx_head, in);   // a write may have raced the flag
+            if (n == 0) errno = EAGAIN;
+        }
+        if (n <= 0) {
+            if (n < 0) errno = EPROTO;
+            return -1;
+        }
+        wake(rx->producer_sleeping);
+        return (ssize_t)n;
+    }
+    
+    // Blocking send of one frame, waiting out a full ring. Used by the
+    // client, whose answers are tiny next to the ring. False only if the
+    // ring is corrupt.
+    bool sendFrame(std::string_view payload) {
+        char header[FRAME_HEADER_SIZE];
+        putFrameHeader(header, (uint32_t)payload.size());
+        iovec iov[2] = {{header, sizeof(header)}, {(void*)payload.data(), payload.size()}};
+        
+        int first = 0;
+        while (first < 2) {
+            ssize_t n = send(iov + first, 2 - first);
+            if (n < 0) {
+                if (errno != EAGAIN) return false;
+                usleep(100);   // the server drains its side as it reads; this is rare
+                continue;
+            }
+            while (first < 2 && (size_t)n >= iov[first].iov_len) {
+                n -= iov[first].iov_len;
+                first++;
+            }
+            if (first < 2) {
+                iov[first].iov_base = (char*)iov[first].iov_base + n;
+                iov[first].iov_len -= n;
+            }
+        }
+        return true;
+    }
+
+private:
+    // Pairs with the sleeper's flag store and fence: either it sees our
+    // data, or we see its flag and ring
+    void wake(std::atomic<uint32_t>& sleeping) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleeping.load(std::memory_order_relaxed) && sleeping.exchange(0)) {
+            uint64_t one = 1;
+            (void)!write(peer_bell, &one, sizeof(one));
+        }
+    }
+};
+
+// Server: build a ring pair for a freshly accepted Unix socket and hand it
+// over. nullptr when anything fails; the caller closes the socket.
+inline ShmEndpoint* shmAccept(int sock) {
+    int memfd = memfd_create("hulaan-rings", MFD_CLOEXEC);
+    if (memfd < 0) return nullptr;
+    if (ftruncate(memfd, sizeof(ShmSegment)) < 0) {
+        close(memfd);
+        return nullptr;
+    }
+    void* mapping = mmap(nullptr, sizeof(ShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (mapping == MAP_FAILED) {
+        close(memfd);
+        return nullptr;
+    }
+    ShmSegment* segment = new (mapping) ShmSegment();
+    int server_bell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    int client_bell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    
+    int fds[SHM_FDS] = {memfd, server_bell, client_bell};
+    char control[CMSG_SPACE(sizeof(fds))] = {};
+    iovec iov = {(void*)SHM_HELLO, sizeof(SHM_HELLO) - 1};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    
+    bool ok = server_bell >= 0 && client_bell >= 0 && sendmsg(sock, &msg, MSG_NOSIGNAL) == (ssize_t)iov.iov_len;
+    close(memfd);   // the mapping keeps the segment alive
+    if (!ok) {
+        munmap(mapping, sizeof(ShmSegment));
+        if (server_bell >= 0) close(server_bell);
+        if (client_bell >= 0) close(client_bell);
+        return nullptr;
+    }
+    return new ShmEndpoint(segment, true, server_bell, client_bell);
+}
+
+// Client: connect to the server's socket at `path` and map the rings it
+// sends. `sock` stays open for hangup detection.
+inline ShmEndpoint* shmConnect(const char* path, int& sock, std::string& error) {
+    sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    if (sock < 0 || connect(sock, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        error = std::string("connect ") + path + ": " + strerror(errno);
+        return nullptr;
+    }
+    
+    int fds[SHM_FDS];
+    char hello[16];
+    char control[CMSG_SPACE(sizeof(fds))];
+    iovec iov = {hello, sizeof(hello)};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    cmsghdr* cmsg = n > 0 ? CMSG_FIRSTHDR(&msg) : nullptr;
+    if (cmsg == nullptr || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(sizeof(fds)) ||
+        std::string_view(hello, n) != SHM_HELLO) {
+        error = "unexpected handshake from the server";
+        return nullptr;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    
+    void* mapping = mmap(nullptr, sizeof(ShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+    close(fds[0]);
+    if (mapping == MAP_FAILED) {
+        error = std::string("mmap: ") + strerror(errno);
+        close(fds[1]);
+        close(fds[2]);
+        return nullptr;
+    }
+    return new ShmEndpoint((ShmSegment*)mapping, false, fds[2], fds[1]);
+}
+
+#endif
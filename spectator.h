@@ -0,0 +1,350 @@
+#ifndef SPECTATOR_H
+#define SPECTATOR_H
+
+// Read-only viewers of a game, kept off the game's path. A room publishes
+// each of its broadcasts to its SpectatorChannel once: WELCOME and QUESTION
+// are the very frames the players got, RESULT and FINAL become one WRESULT
+// and one WFINAL for every viewer (schema.h). Fan-out threads (shards) own
+// the viewers and queue that one refcounted frame on each of them, so a
+// publish costs the room's worker a lock and a task per shard that has
+// viewers in the room, however many there are, and the lobby mutex never
+// sees a viewer. A viewer that falls too far behind is evicted like any
+// connection (reactor.h); the players do not notice.
+//
+// A viewer who joins mid-game first gets the room's frames since the
+// current QUESTION (or the WELCOME), then everything live. A relay
+// (relay.cpp) is a viewer that publishes what it receives into a hub of its
+// own, so one upstream connection can feed any number of local viewers.
+//
+// Order: a channel pushes publishes and subscribes under its mutex and
+// every shard runs its tasks in order, so a viewer gets each frame exactly
+// once, either in its catch-up or live.
+
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <unordered_map>
+#include <cstdint>
+#include <pthread.h>
+#include "reactor.h"
+#include "schema.h"
+#include "metrics.h"
+
+#define SPECTATOR_CATCH_UP_MAX 8     // frames a channel keeps for viewers who join late
+#define DEFAULT_SPECTATOR_SHARDS 1
+
+class SpectatorHub;
+class SpectatorChannel;
+
+struct SpectatorTask {
+    enum Type : uint8_t { PUBLISH, SUBSCRIBE, UNSUBSCRIBE, CLOSE };
+    
+    Type type;
+    int room;
+    Connection* conn;                            // SUBSCRIBE, UNSUBSCRIBE
+    FramePtr frame;                              // PUBLISH
+    std::shared_ptr<SpectatorChannel> channel;   // SUBSCRIBE
+    std::vector<FramePtr> catch_up;              // SUBSCRIBE
+};
+
+// One room's broadcasts as its viewers see them. The room publishes and
+// closes it; viewers come in through the hub.
+class SpectatorChannel {
+    friend class SpectatorHub;
+
+private:
+    SpectatorHub* hub;
+    int room_id;
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    std::vector<FramePtr> catch_up;   // since the last QUESTION or WELCOME
+    std::vector<int> shard_viewers;   // this room's viewers on each shard
+    bool closed;
+
+public:
+    SpectatorChannel(SpectatorHub* h, int id, size_t shards)
+        : hub(h), room_id(id), shard_viewers(shards, 0), closed(false) {}
+    
+    int id() const { return room_id; }
+    
+    // Any thread; for a game, its worker after the players have theirs
+    void publish(const FramePtr& frame);
+    
+    // No more frames: viewers are hung up once what they have is written,
+    // and the room can no longer be watched. Idempotent.
+    void close();
+    
+    // A shard dropped one of our viewers
+    void viewerLeft(int shard) {
+        pthread_mutex_lock(&mutex);
+        shard_viewers[shard]--;
+        pthread_mutex_unlock(&mutex);
+    }
+};
+
+// A fan-out thread and the viewers it owns. Tasks come in through a
+// mutex-guarded queue; everything else is the thread's alone.
+struct SpectatorShard {
+    struct Room {
+        std::shared_ptr<SpectatorChannel> channel;
+        std::vector<Connection*> viewers;   // each holds a reference
+    };
+    
+    int index;
+    std::atomic<int>* viewers;    // the hub's count
+    pthread_t thread;
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t wakeup = PTHREAD_COND_INITIALIZER;
+    std::vector<SpectatorTask> tasks;   // queued
+    std::vector<SpectatorTask> batch;   // being run, swapped with tasks
+    bool stopping;
+    
+    // Fan-out thread only
+    std::unordered_map<int, Room> rooms;
+    std::unordered_map<Connection*, size_t> positions;   // index in its room's viewers
+    
+    SpectatorShard(int i, std::atomic<int>* count) : index(i), viewers(count), stopping(false) {}
+    
+    void push(SpectatorTask&& task) {
+        pthread_mutex_lock(&mutex);
+        bool idle = tasks.empty();
+        tasks.push_back(std::move(task));
+        pthread_mutex_unlock(&mutex);
+        if (idle) pthread_cond_signal(&wakeup);
+    }
+    
+    // Runs until stop() and the queue is empty; then lets every viewer go
+    void run() {
+        pthread_mutex_lock(&mutex);
+        while (true) {
+            while (tasks.empty() && !stopping) pthread_cond_wait(&wakeup, &mutex);
+            if (tasks.empty()) break;
+            batch.swap(tasks);
+            pthread_mutex_unlock(&mutex);
+            {
+                SendBatch writes;   // a viewer sent several frames gets one write
+                for (SpectatorTask& task : batch) apply(task);
+            }
+            batch.clear();
+            pthread_mutex_lock(&mutex);
+        }
+        pthread_mutex_unlock(&mutex);
+        
+        for (auto& entry : rooms) {
+            for (Connection* conn : entry.second.viewers) release(conn);
+        }
+        rooms.clear();
+        positions.clear();
+    }
+    
+    void stop() {
+        pthread_mutex_lock(&mutex);
+        stopping = true;
+        pthread_mutex_unlock(&mutex);
+        pthread_cond_signal(&wakeup);
+    }
+    
+    static void* threadMain(void* arg) {
+        static_cast<SpectatorShard*>(arg)->run();
+        return nullptr;
+    }
+
+private:
+    void apply(SpectatorTask& task) {
+        switch (task.type) {
+            case SpectatorTask::PUBLISH: {
+                auto it = rooms.find(task.room);
+                if (it == rooms.end()) return;
+                Room& room = it->second;
+                size_t sent = 0;
+                for (size_t i = 0; i < room.viewers.size();) {
+                    if (room.viewers[i]->send(task.frame)) {
+                        sent++;
+                        i++;
+                    } else {
+                        remove(room, i);   // evicted; the last viewer moved into i
+                    }
+                }
+                metricAdd(SPECTATOR_FRAMES, sent);
+                if (room.viewers.empty()) rooms.erase(it);
+                break;
+            }
+            case SpectatorTask::SUBSCRIBE: {
+                for (const FramePtr& frame : task.catch_up) {
+                    if (!task.conn->send(frame)) {
+                        task.channel->viewerLeft(index);
+                        release(task.conn);
+                        return;
+                    }
+                }
+                Room& room = rooms[task.room];
+                room.channel = std::move(task.channel);
+                positions[task.conn] = room.viewers.size();
+                room.viewers.push_back(task.conn);
+                break;
+            }
+            case SpectatorTask::UNSUBSCRIBE: {
+                // Gone already if it was evicted or its game ended
+                if (positions.find(task.conn) == positions.end()) return;
+                auto it = rooms.find(task.room);
+                remove(it->second, positions[task.conn]);
+                if (it->second.viewers.empty()) rooms.erase(it);
+                break;
+            }
+            case SpectatorTask::CLOSE: {
+                auto it = rooms.find(task.room);
+                if (it == rooms.end()) return;
+                for (Connection* conn : it->second.viewers) {
+                    conn->closeWhenFlushed();
+                    positions.erase(conn);
+                    release(conn);
+                }
+                rooms.erase(it);
+                break;
+            }
+        }
+    }
+    
+    void remove(Room& room, size_t i) {
+        Connection* conn = room.viewers[i];
+        Connection* last = room.viewers.back();
+        room.viewers[i] = last;
+        positions[last] = i;
+        room.viewers.pop_back();
+        positions.erase(conn);
+        room.channel->viewerLeft(index);
+        release(conn);
+    }
+    
+    void release(Connection* conn) {
+        viewers->fetch_sub(1, std::memory_order_relaxed);
+        conn->release();
+    }
+};
+
+// The channels of every room that may be watched, and the shards their
+// viewers are spread over. A viewer's shard follows from its connection, so
+// its hangup finds it again without a lookup.
+class SpectatorHub {
+    friend class SpectatorChannel;
+
+private:
+    std::vector<SpectatorShard*> shards;
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    std::unordered_map<int, std::shared_ptr<SpectatorChannel>> channels;   // open ones
+    bool started;
+
+public:
+    std::atomic<int> viewers;   // subscribed, over every shard
+    
+    explicit SpectatorHub(int shard_count) : started(false), viewers(0) {
+        for (int i = 0; i < shard_count; ++i) shards.push_back(new SpectatorShard(i, &viewers));
+    }
+    
+    ~SpectatorHub() {
+        stop();
+        for (SpectatorShard* shard : shards) delete shard;
+    }
+    
+    void start() {
+        for (SpectatorShard* shard : shards) {
+            pthread_create(&shard->thread, nullptr, SpectatorShard::threadMain, shard);
+        }
+        started = true;
+    }
+    
+    // Runs what is queued, then lets every viewer go
+    void stop() {
+        if (!started) return;
+        for (SpectatorShard* shard : shards) shard->stop();
+        for (SpectatorShard* shard : shards) pthread_join(shard->thread, nullptr);
+        started = false;
+    }
+    
+    // The room's channel, opened if it is not already
+    std::shared_ptr<SpectatorChannel> open(int room) {
+        pthread_mutex_lock(&mutex);
+        std::shared_ptr<SpectatorChannel>& channel = channels[room];
+        if (!channel) channel = std::make_shared<SpectatorChannel>(this, room, shards.size());
+        std::shared_ptr<SpectatorChannel> result = channel;
+        pthread_mutex_unlock(&mutex);
+        return result;
+    }
+    
+    // Reactor thread: `conn` watches `room` from now on, and its context
+    // points at the hub. False if the room is not open (anymore).
+    bool subscribe(Connection* conn, int room) {
+        pthread_mutex_lock(&mutex);
+        auto it = channels.find(room);
+        std::shared_ptr<SpectatorChannel> channel = it == channels.end() ? nullptr : it->second;
+        pthread_mutex_unlock(&mutex);
+        if (!channel) return false;
+        
+        int shard = shardOf(conn);
+        pthread_mutex_lock(&channel->mutex);
+        if (channel->closed) {
+            pthread_mutex_unlock(&channel->mutex);
+            return false;
+        }
+        conn->context = this;
+        conn->slot = (uint32_t)room;
+        conn->retain();   // released by the shard
+        viewers.fetch_add(1, std::memory_order_relaxed);
+        channel->shard_viewers[shard]++;
+        shards[shard]->push(SpectatorTask{SpectatorTask::SUBSCRIBE, room, conn, nullptr, channel,
+                                          channel->catch_up});
+        pthread_mutex_unlock(&channel->mutex);
+        return true;
+    }
+    
+    // Reactor thread, from onClose of a connection subscribe took
+    void unsubscribe(Connection* conn) {
+        shards[shardOf(conn)]->push(SpectatorTask{SpectatorTask::UNSUBSCRIBE, (int)conn->slot, conn, nullptr,
+                                                  nullptr, {}});
+    }
+
+private:
+    int shardOf(const Connection* conn) const {
+        uint64_t h = (uint64_t)(uintptr_t)conn * 0x9e3779b97f4a7c15ULL;
+        return (int)((h >> 32) % shards.size());
+    }
+    
+    void forget(SpectatorChannel* channel) {
+        pthread_mutex_lock(&mutex);
+        auto it = channels.find(channel->id());
+        if (it != channels.end() && it->second.get() == channel) channels.erase(it);
+        pthread_mutex_unlock(&mutex);
+    }
+};
+
+inline void SpectatorChannel::publish(const FramePtr& frame) {
+    std::string_view type = messageType(std::string_view(*frame).substr(FRAME_HEADER_SIZE));
+    pthread_mutex_lock(&mutex);
+    if (!closed) {
+        if (type == QuestionSchema::type || type == WelcomeSchema::type) catch_up.clear();
+        if (catch_up.size() < SPECTATOR_CATCH_UP_MAX) catch_up.push_back(frame);
+        for (size_t s = 0; s < shard_viewers.size(); ++s) {
+            if (shard_viewers[s] > 0) {
+                hub->shards[s]->push(SpectatorTask{SpectatorTask::PUBLISH, room_id, nullptr, frame, nullptr, {}});
+            }
+        }
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+inline void SpectatorChannel::close() {
+    hub->forget(this);
+    pthread_mutex_lock(&mutex);
+    if (!closed) {
+        closed = true;
+        catch_up.clear();
+        for (size_t s = 0; s < shard_viewers.size(); ++s) {
+            if (shard_viewers[s] > 0) {
+                hub->shards[s]->push(SpectatorTask{SpectatorTask::CLOSE, room_id, nullptr, nullptr, nullptr, {}});
+            }
+        }
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+#endif
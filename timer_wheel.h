@@ -0,0 +1,201 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+// Hierarchical timing wheel (Varghese & Lauck, as in the Linux kernel's
+// classic timer code). Timers are intrusive list nodes, so scheduling and
+// cancelling are O(1) and need no allocation; a wheel holds as many timers
+// as there are Timer objects.
+//
+// One tick is one millisecond. Level 0 has a slot per tick for the next 64
+// ms, each higher level covers 64 times the span of the one below, so four
+// levels reach about 4.6 hours. Further deadlines are clamped to the last
+// slot and simply re-cascade. A wheel is not thread-safe: it belongs to the
+// thread that advances it.
+
+#include <cstdint>
+#include <cstddef>
+
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4
+
+struct Timer {
+    Timer* next;
+    Timer* prev;
+    uint64_t expires;          // absolute tick
+    void (*callback)(Timer*);
+    void* arg;
+
+    Timer() : next(nullptr), prev(nullptr), expires(0), callback(nullptr), arg(nullptr) {}
+
+    bool armed() const { return next != nullptr; }
+};
+
+class TimerWheel {
+private:
+    Timer slots[WHEEL_LEVELS][WHEEL_SIZE];   // list heads (sentinels)
+    uint64_t current;                        // last tick processed
+    size_t pending;
+
+    // Stats on how late timers fire, for monitoring
+    uint64_t fired_count;
+    uint64_t lag_total;
+    uint64_t lag_max;
+
+public:
+    TimerWheel(uint64_t now)
+        : current(now), pending(0), fired_count(0), lag_total(0), lag_max(0) {
+        for (int level = 0; level < WHEEL_LEVELS; ++level) {
+            for (int i = 0; i < WHEEL_SIZE; ++i) {
+                slots[level][i].next = &slots[level][i];
+                slots[level][i].prev = &slots[level][i];
+            }
+        }
+    }
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    size_t size() const { return pending; }
+    uint64_t now() const { return current; }
+    uint64_t firedCount() const { return fired_count; }
+    uint64_t lagTotal() const { return lag_total; }
+    uint64_t lagMax() const { return lag_max; }
+
+    // (Re)arm t to fire at absolute tick `expires`
+    void schedule(Timer* t, uint64_t expires) {
+        if (t->armed()) unlink(t);
+        t->expires = expires;
+        place(t, current + 1);
+        pending++;
+    }
+
+    void cancel(Timer* t) {
+        if (!t->armed()) return;
+        unlink(t);
+        pending--;
+    }
+
+    // Process every tick up to `now`, firing due timers. A callback may
+    // schedule or cancel any timer, including the one that fired.
+    void advance(uint64_t now) {
+        if (pending == 0) {
+            if (now > current) current = now;
+            return;
+        }
+
+        while (current < now) {
+            current++;
+
+            // Wrapping a level pulls the next slot of the level above down
+            int level = 0;
+            uint64_t tick = current;
+            while (level + 1 < WHEEL_LEVELS && (tick & WHEEL_MASK) == 0) {
+                tick >>= WHEEL_BITS;
+                level++;
+            }
+            for (int l = level; l > 0; --l) {
+                cascade(l, (current >> (l * WHEEL_BITS)) & WHEEL_MASK);
+            }
+
+            fire(&slots[0][current & WHEEL_MASK], now);
+            if (pending == 0) {
+                current = now;
+                return;
+            }
+        }
+    }
+
+    // Milliseconds the owner may sleep before calling advance again, or -1
+    // when nothing is scheduled. Only level 0 is scanned; past it the answer
+    // is the next level-0 wrap, where the next cascade happens.
+    long msUntilNext() const {
+        if (pending == 0) return -1;
+        for (uint64_t t = current + 1; t <= current + WHEEL_SIZE; ++t) {
+            const Timer* head = &slots[0][t & WHEEL_MASK];
+            if (head->next != head) return (long)(t - current);
+            if ((t & WHEEL_MASK) == 0) return (long)(t - current);
+        }
+        return WHEEL_SIZE;
+    }
+
+private:
+    static void unlink(Timer* t) {
+        t->prev->next = t->next;
+        t->next->prev = t->prev;
+        t->next = nullptr;
+        t->prev = nullptr;
+    }
+
+    static void pushBack(Timer* head, Timer* t) {
+        t->prev = head->prev;
+        t->next = head;
+        head->prev->next = t;
+        head->prev = t;
+    }
+
+    // Timers due before `earliest` go in its slot. Cascades pass the tick
+    // being processed (its slot fires right after); everything else passes
+    // the next tick, since the current slot has already fired.
+    void place(Timer* t, uint64_t earliest) {
+        uint64_t expires = t->expires > earliest ? t->expires : earliest;
+        uint64_t delta = expires - current;
+
+        int level = 0;
+        while (level + 1 < WHEEL_LEVELS && delta >= ((uint64_t)1 << ((level + 1) * WHEEL_BITS))) {
+            level++;
+        }
+        if (level == WHEEL_LEVELS - 1) {
+            uint64_t max_delta = ((uint64_t)1 << (WHEEL_LEVELS * WHEEL_BITS)) - 1;
+            if (delta > max_delta) expires = current + max_delta;
+        }
+
+        pushBack(&slots[level][(expires >> (level * WHEEL_BITS)) & WHEEL_MASK], t);
+    }
+
+    void cascade(int level, uint64_t index) {
+        Timer* head = &slots[level][index];
+        Timer list;
+        takeAll(head, &list);
+        while (list.next != &list) {
+            Timer* t = list.next;
+            unlink(t);
+            place(t, current);
+        }
+    }
+
+    void fire(Timer* head, uint64_t now) {
+        Timer list;
+        takeAll(head, &list);
+        while (list.next != &list) {
+            Timer* t = list.next;
+            unlink(t);
+            pending--;
+
+            uint64_t lag = now > t->expires ? now - t->expires : 0;
+            fired_count++;
+            lag_total += lag;
+            if (lag > lag_max) lag_max = lag;
+
+            t->callback(t);   // may free t, so it is not touched after this
+        }
+    }
+
+    // Move a whole slot list onto a local sentinel
+    static void takeAll(Timer* head, Timer* list) {
+        if (head->next == head) {
+            list->next = list;
+            list->prev = list;
+            return;
+        }
+        list->next = head->next;
+        list->prev = head->prev;
+        list->next->prev = list;
+        list->prev->next = list;
+        head->next = head;
+        head->prev = head;
+    }
+};
+
+#endif
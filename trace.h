@@ -0,0 +1,285 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Message traces for replaying games without clients. A recording server
+// (-T) writes every frame it receives, and every hangup, with the time it
+// arrived; the server replays one (-P) in-process against the game engine
+// alone: no sockets, no threads, and a virtual clock that jumps straight to
+// the next message or timer, so an hour of games replays in well under a
+// second and the same trace always plays out the same way. That makes it
+// the tool for profiling and regression-testing the round logic.
+//
+// File: TraceHeader, then one record per event, LEB128 varints throughout:
+//
+//   delta_us  time since the previous record (the first: since recording started)
+//   conn      connection number, in order of each one's first frame
+//   type      TRACE_MESSAGE (then: length, payload) or TRACE_CLOSE
+//
+// The header carries what a replay must match for the games to come out
+// the same: the game timing, the bank's size and the seed the server drew
+// questions and session secrets with. Connections are numbered on their
+// first frame, so ones that never sent anything are not recorded.
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#define TRACE_MAGIC "TRIVTR1"
+#define TRACE_VERSION 1
+#define TRACE_FLUSH_BYTES (256 * 1024)   // wake the writer early past this
+#define TRACE_FLUSH_INTERVAL_MS 1000
+
+enum TraceType : uint8_t { TRACE_MESSAGE, TRACE_CLOSE };
+
+struct TraceHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t bank_questions;
+    uint64_t seed;
+    int32_t answer_timeout_ms;
+    int32_t round_delay_ms;
+    int32_t lobby_timeout_ms;
+    int32_t rounds;
+};
+
+struct TraceEvent {
+    long long time_us;   // since recording started
+    uint32_t conn;
+    TraceType type;
+    std::string_view payload;   // TRACE_MESSAGE only; a view into the trace
+};
+
+inline void tracePutVarint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back((char)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((char)v);
+}
+
+// Reactor threads record; a writer thread appends to the file about once a
+// second, so recording costs a lock and a few bytes of copying per frame
+class TraceRecorder {
+private:
+    int fd;
+    long long start_us;
+    long long last_us;
+    uint32_t next_conn;
+    std::unordered_map<const void*, uint32_t> conns;   // open connections
+    std::string pending;
+    std::string writing;
+    bool running;
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+    pthread_t thread;
+
+public:
+    uint64_t events = 0;   // under mutex
+    
+    TraceRecorder() : fd(-1), start_us(0), last_us(0), next_conn(0), running(false) {}
+    
+    ~TraceRecorder() {
+        stop();
+        if (fd >= 0) close(fd);
+    }
+    
+    TraceRecorder(const TraceRecorder&) = delete;
+    TraceRecorder& operator=(const TraceRecorder&) = delete;
+    
+    // Create the trace at `path`; times are recorded from `now_us` on
+    bool open(const char* path, TraceHeader header, long long now_us, std::string& error) {
+        fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            error = std::string("cannot create ") + path + ": " + strerror(errno);
+            return false;
+        }
+        memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+        header.version = TRACE_VERSION;
+        if (write(fd, &header, sizeof(header)) != (ssize_t)sizeof(header)) {
+            error = std::string("cannot write ") + path + ": " + strerror(errno);
+            return false;
+        }
+        start_us = last_us = now_us;
+        return true;
+    }
+    
+    void start() {
+        running = true;
+        pthread_create(&thread, nullptr, threadMain, this);
+    }
+    
+    // Write out what is left and stop the writer
+    void stop() {
+        pthread_mutex_lock(&mutex);
+        bool was_running = running;
+        running = false;
+        pthread_cond_signal(&wake);
+        pthread_mutex_unlock(&mutex);
+        if (was_running) pthread_join(thread, nullptr);
+    }
+    
+    // A frame from connection `conn` (any stable identity while it is open)
+    void message(const void* conn, long long time_us, std::string_view payload) {
+        pthread_mutex_lock(&mutex);
+        auto it = conns.emplace(conn, next_conn);
+        if (it.second) next_conn++;
+        put(time_us, it.first->second, TRACE_MESSAGE);
+        tracePutVarint(pending, payload.size());
+        pending.append(payload);
+        if (pending.size() >= TRACE_FLUSH_BYTES) pthread_cond_signal(&wake);
+        pthread_mutex_unlock(&mutex);
+    }
+    
+    // The connection hung up; ignored if it never sent a frame
+    void hangup(const void* conn, long long time_us) {
+        pthread_mutex_lock(&mutex);
+        auto it = conns.find(conn);
+        if (it != conns.end()) {
+            put(time_us, it->second, TRACE_CLOSE);
+            conns.erase(it);
+        }
+        pthread_mutex_unlock(&mutex);
+    }
+
+private:
+    // Reactors stamp frames before taking the lock, so times can come in
+    // slightly out of order; never go backwards
+    void put(long long time_us, uint32_t conn, TraceType type) {
+        long long delta = time_us > last_us ? time_us - last_us : 0;
+        last_us += delta;
+        tracePutVarint(pending, (uint64_t)delta);
+        tracePutVarint(pending, conn);
+        pending.push_back((char)type);
+        events++;
+    }
+    
+    void run() {
+        pthread_mutex_lock(&mutex);
+        while (true) {
+            if (pending.empty() && running) {
+                timespec deadline;
+                clock_gettime(CLOCK_REALTIME, &deadline);
+                deadline.tv_sec += TRACE_FLUSH_INTERVAL_MS / 1000;
+                pthread_cond_timedwait(&wake, &mutex, &deadline);
+            }
+            if (pending.empty() && !running) break;
+            writing.swap(pending);
+            pthread_mutex_unlock(&mutex);
+            
+            size_t done = 0;
+            while (done < writing.size()) {
+                ssize_t n = write(fd, writing.data() + done, writing.size() - done);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) {
+                    perror("trace write");
+                    break;
+                }
+                done += n;
+            }
+            writing.clear();
+            
+            pthread_mutex_lock(&mutex);
+        }
+        pthread_mutex_unlock(&mutex);
+    }
+    
+    static void* threadMain(void* arg) {
+        static_cast<TraceRecorder*>(arg)->run();
+        return nullptr;
+    }
+};
+
+// Reads a whole trace into memory and walks it
+class TraceReader {
+private:
+    std::string data;
+    size_t pos;
+    long long time_us;
+
+public:
+    TraceHeader header;
+    uint32_t connections;   // highest connection number seen so far, plus one
+    bool truncated;         // the last record was cut short
+    
+    TraceReader() : pos(0), time_us(0), header{}, connections(0), truncated(false) {}
+    
+    bool open(const char* path, std::string& error) {
+        int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) < 0) {
+            error = std::string("cannot open ") + path + ": " + strerror(errno);
+            if (fd >= 0) close(fd);
+            return false;
+        }
+        data.resize(st.st_size);
+        size_t done = 0;
+        while (done < data.size()) {
+            ssize_t n = read(fd, &data[done], data.size() - done);
+            if (n <= 0) break;
+            done += n;
+        }
+        close(fd);
+        data.resize(done);
+        
+        if (data.size() < sizeof(header)) {
+            error = std::string(path) + ": not a trace";
+            return false;
+        }
+        memcpy(&header, data.data(), sizeof(header));
+        if (memcmp(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 || header.version != TRACE_VERSION) {
+            error = std::string(path) + ": not a trace (bad magic or version)";
+            return false;
+        }
+        pos = sizeof(header);
+        return true;
+    }
+    
+    size_t bytes() const { return data.size(); }
+    
+    // False at the end of the trace
+    bool next(TraceEvent& ev) {
+        uint64_t delta, conn, length = 0;
+        size_t start = pos;
+        if (pos >= data.size()) return false;
+        if (!varint(delta) || !varint(conn) || pos >= data.size()) return cut(start);
+        ev.type = (TraceType)data[pos++];
+        if (ev.type == TRACE_MESSAGE && (!varint(length) || data.size() - pos < length)) return cut(start);
+        
+        time_us += (long long)delta;
+        ev.time_us = time_us;
+        ev.conn = (uint32_t)conn;
+        ev.payload = std::string_view(data).substr(pos, length);
+        pos += length;
+        if (ev.conn >= connections) connections = ev.conn + 1;
+        return true;
+    }
+
+private:
+    bool varint(uint64_t& v) {
+        v = 0;
+        for (int shift = 0; shift < 64 && pos < data.size(); shift += 7) {
+            uint8_t b = (uint8_t)data[pos++];
+            v |= (uint64_t)(b & 0x7f) << shift;
+            if (!(b & 0x80)) return true;
+        }
+        return false;
+    }
+    
+    // The recorder died mid-record; everything before it still replays
+    bool cut(size_t start) {
+        pos = data.size();
+        truncated = start < data.size();
+        return false;
+    }
+};
+
+#endif
@@ -0,0 +1,239 @@
+#ifndef URING_H
+#define URING_H
+
+// Just enough io_uring for the reactor, on the raw system calls (there is no
+// liburing to lean on): a submission and a completion ring mapped from the
+// kernel, and a ring of provided buffers that multishot receives pick from.
+// One thread owns an IoUring; nothing here is locked.
+//
+// Queue work with prepare(), hand everything prepared to the kernel with one
+// submit(), and read what finished with peek()/advance() without entering
+// the kernel at all.
+
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "metrics.h"
+
+#define URING_ENTRIES 256   // submission slots; the kernel makes twice as many for completions
+
+inline int uringSetup(unsigned entries, io_uring_params* params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+inline int uringEnter(int fd, unsigned submit, unsigned wait, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, submit, wait, flags, nullptr, 0);
+}
+
+inline int uringRegister(int fd, unsigned opcode, void* arg, unsigned count) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+class IoUring {
+private:
+    int ring_fd;
+    void* sq_map;
+    size_t sq_map_size;
+    void* cq_map;
+    size_t cq_map_size;
+    io_uring_sqe* sqes;
+    size_t sqes_size;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_flags;
+    unsigned* sq_array;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned cq_mask;
+    io_uring_cqe* cqes;
+    unsigned prepared;   // since the last submit
+
+public:
+    IoUring() : ring_fd(-1), sq_map(MAP_FAILED), sq_map_size(0), cq_map(MAP_FAILED), cq_map_size(0),
+                sqes((io_uring_sqe*)MAP_FAILED), sqes_size(0), prepared(0) {}
+    
+    ~IoUring() {
+        if (sqes != MAP_FAILED) munmap(sqes, sqes_size);
+        if (cq_map != MAP_FAILED && cq_map != sq_map) munmap(cq_map, cq_map_size);
+        if (sq_map != MAP_FAILED) munmap(sq_map, sq_map_size);
+        if (ring_fd >= 0) close(ring_fd);
+    }
+    
+    // `completions`, if given, sizes the completion ring instead of the
+    // kernel's twice `entries`
+    bool init(unsigned entries, std::string& error, unsigned completions = 0) {
+        io_uring_params params{};
+        if (completions > 0) {
+            params.flags = IORING_SETUP_CQSIZE;
+            params.cq_entries = completions;
+        }
+        ring_fd = uringSetup(entries, &params);
+        if (ring_fd < 0) {
+            error = std::string("io_uring_setup: ") + strerror(errno);
+            return false;
+        }
+        
+        sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single) sq_map_size = cq_map_size = std::max(sq_map_size, cq_map_size);
+        sq_map = mmap(nullptr, sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                      IORING_OFF_SQ_RING);
+        cq_map = single || sq_map == MAP_FAILED
+                     ? sq_map
+                     : mmap(nullptr, cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                            IORING_OFF_CQ_RING);
+        sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = (io_uring_sqe*)mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                                   IORING_OFF_SQES);
+        if (sq_map == MAP_FAILED || cq_map == MAP_FAILED || sqes == MAP_FAILED) {
+            error = std::string("io_uring mmap: ") + strerror(errno);
+            return false;
+        }
+        
+        char* sq = (char*)sq_map;
+        sq_head = (unsigned*)(sq + params.sq_off.head);
+        sq_tail = (unsigned*)(sq + params.sq_off.tail);
+        sq_flags = (unsigned*)(sq + params.sq_off.flags);
+        sq_mask = *(unsigned*)(sq + params.sq_off.ring_mask);
+        sq_entries = params.sq_entries;
+        sq_array = (unsigned*)(sq + params.sq_off.array);
+        char* cq = (char*)cq_map;
+        cq_head = (unsigned*)(cq + params.cq_off.head);
+        cq_tail = (unsigned*)(cq + params.cq_off.tail);
+        cq_mask = *(unsigned*)(cq + params.cq_off.ring_mask);
+        cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+        return true;
+    }
+    
+    int fd() const { return ring_fd; }
+    unsigned capacity() const { return sq_entries; }
+    unsigned pending() const { return prepared; }
+    
+    // Completions that did not fit wait in the kernel, out of peek()'s
+    // sight, until the next submit
+    bool overflowed() const { return __atomic_load_n(sq_flags, __ATOMIC_ACQUIRE) & IORING_SQ_CQ_OVERFLOW; }
+    
+    // The next submission slot, zeroed; nullptr while every slot is taken
+    // (submit first)
+    io_uring_sqe* prepare() {
+        unsigned tail = *sq_tail;
+        if (tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) return nullptr;
+        unsigned index = tail & sq_mask;
+        io_uring_sqe* sqe = &sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sq_array[index] = index;
+        __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+        prepared++;
+        return sqe;
+    }
+    
+    // Everything prepared, in one system call; with `wait`, also until that
+    // many completions are in. Returns what the kernel took, or -errno;
+    // whatever it did not take goes with the next submit. Also moves any
+    // overflowed completions into the ring.
+    int submit(unsigned wait = 0) {
+        while (true) {
+            int n = uringEnter(ring_fd, prepared, wait, IORING_ENTER_GETEVENTS);
+            metricAdd(IO_URING_ENTERS);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) return -errno;
+            prepared -= std::min((unsigned)n, prepared);
+            return n;
+        }
+    }
+    
+    // The oldest completion not yet consumed, or nullptr
+    io_uring_cqe* peek() {
+        unsigned head = *cq_head;
+        if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) return nullptr;
+        return &cqes[head & cq_mask];
+    }
+    
+    void advance() {
+        __atomic_store_n(cq_head, *cq_head + 1, __ATOMIC_RELEASE);
+    }
+};
+
+// Buffers the kernel picks from for receives with IOSQE_BUFFER_SELECT, in
+// group `group`. A completion names the buffer it filled; recycle() gives
+// it back once its bytes have been copied out, publish() makes the recycled
+// ones visible to the kernel in one store.
+class IoBufferRing {
+private:
+    io_uring_buf_ring* ring;
+    size_t ring_size;
+    char* memory;
+    unsigned count;        // a power of two
+    unsigned buffer_size;
+    uint16_t tail;         // ours, published by publish()
+
+public:
+    IoBufferRing() : ring((io_uring_buf_ring*)MAP_FAILED), ring_size(0), memory((char*)MAP_FAILED), count(0),
+                     buffer_size(0), tail(0) {}
+    
+    ~IoBufferRing() {
+        if (ring != MAP_FAILED) munmap(ring, ring_size);
+        if (memory != MAP_FAILED) munmap(memory, (size_t)count * buffer_size);
+    }
+    
+    bool init(IoUring& uring, uint16_t group, unsigned buffers, unsigned size, std::string& error) {
+        count = buffers;
+        buffer_size = size;
+        ring_size = count * sizeof(io_uring_buf);
+        ring = (io_uring_buf_ring*)mmap(nullptr, ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                                        -1, 0);
+        memory = (char*)mmap(nullptr, (size_t)count * buffer_size, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ring == MAP_FAILED || memory == MAP_FAILED) {
+            error = std::string("mmap: ") + strerror(errno);
+            return false;
+        }
+        
+        io_uring_buf_reg reg{};
+        reg.ring_addr = (uint64_t)(uintptr_t)ring;
+        reg.ring_entries = count;
+        reg.bgid = group;
+        if (uringRegister(uring.fd(), IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+            error = std::string("io_uring buffer ring: ") + strerror(errno);
+            return false;
+        }
+        for (unsigned i = 0; i < count; ++i) recycle((uint16_t)i);
+        publish();
+        return true;
+    }
+    
+    const char* data(uint16_t id) const { return memory + (size_t)id * buffer_size; }
+    
+    void recycle(uint16_t id) {
+        // Not ring->bufs: the header's flexible array sits behind an empty
+        // struct, which is a byte in C++, so it lands 8 bytes in
+        io_uring_buf* buf = (io_uring_buf*)ring + (tail & (count - 1));
+        buf->addr = (uint64_t)(uintptr_t)data(id);
+        buf->len = buffer_size;
+        buf->bid = id;
+        tail++;
+    }
+    
+    void publish() {
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+    }
+};
+
+// Whether this kernel lets us have a ring and provided buffers at all
+// (io_uring can be compiled out, or turned off by sysctl or seccomp)
+inline bool uringAvailable(std::string& error) {
+    IoUring uring;
+    IoBufferRing buffers;
+    return uring.init(8, error) && buffers.init(uring, 0, 1, 64, error);
+}
+
+#endif